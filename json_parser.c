@@ -1,17 +1,95 @@
+#if defined(JSON_PARSER_ASYNC) && defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stdio.h>
+#include <limits.h>
 #include <math.h>
 #include "list.h"
 #include "json_parser.h"
 
 #define JSON_DEPTH_LIMIT	1024
 
+#define JSON_NODE_GRANULE	8
+#define JSON_NODE_CLASSES	16
+
+#define JSON_RECYCLE_NAME_MAX	64
+
+#define JSON_FLAG_FROZEN	0x1
+#define JSON_FLAG_BLOCK		0x2
+#define JSON_FLAG_DIGEST	0x4
+#define JSON_FLAG_SORTED	0x8
+#define JSON_FLAG_INDEX		0x10
+#define JSON_FLAG_RAW		0x20
+#define JSON_FLAG_LAZY		0x40
+
+#define JSON_SORTED_INDEX_MIN	8
+
+#if defined(__GNUC__)
+# define __json_atomic_inc(ptr)	__atomic_add_fetch(ptr, 1, __ATOMIC_RELAXED)
+# define __json_atomic_dec(ptr)	__atomic_sub_fetch(ptr, 1, __ATOMIC_ACQ_REL)
+#elif defined(_MSC_VER)
+# include <intrin.h>
+# define __json_atomic_inc(ptr)	_InterlockedIncrement((long volatile *)(ptr))
+# define __json_atomic_dec(ptr)	_InterlockedDecrement((long volatile *)(ptr))
+#else
+# define __json_atomic_inc(ptr)	(++*(ptr))
+# define __json_atomic_dec(ptr)	(--*(ptr))
+#endif
+
+#if __STDC_VERSION__ >= 201112L
+# define JSON_THREAD_LOCAL	_Thread_local
+#elif defined(_MSC_VER)
+# define JSON_THREAD_LOCAL	__declspec(thread)
+#else
+# define JSON_THREAD_LOCAL	__thread
+#endif
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+	  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define JSON_SSE2
+#endif
+
+#ifdef JSON_PARSER_ASYNC
+# include <pthread.h>
+# include <unistd.h>
+# ifdef __linux__
+#  include <sched.h>
+# endif
+#endif
+
+#ifdef JSON_PARSER_STATS
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define __json_ticks()	((unsigned long long)__builtin_ia32_rdtsc())
+# elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#  define __json_ticks()	((unsigned long long)__rdtsc())
+# else
+#  include <time.h>
+#  define __json_ticks()	((unsigned long long)clock())
+# endif
+# define JSON_STATS_ADD(field, n)	(__parse_stats.field += (n))
+# define JSON_STATS_MAX(field, n) \
+	((void)(__parse_stats.field < (size_t)(n) && \
+			(__parse_stats.field = (n))))
+#else
+# define JSON_STATS_ADD(field, n)	((void)0)
+# define JSON_STATS_MAX(field, n)	((void)0)
+#endif
+
 struct __json_object
 {
 	struct list_head head;
 	size_t size;
+#ifdef JSON_PARSER_INDEX
+	struct __json_member **index;
+#endif
 };
 
 struct __json_array
@@ -26,10 +104,18 @@ struct __json_value
 	{
 		char *string;
 		double number;
+		char *raw;
+		char text[sizeof (json_array_t)];
 		json_object_t object;
 		json_array_t array;
 	} value;
-	int type;
+	const json_allocator_t *allocator;
+	short type;
+	unsigned short flags;
+	int refs;
+#ifdef JSON_PARSER_DIGEST
+	unsigned long long digest;
+#endif
 };
 
 struct __json_member
@@ -48,6 +134,195 @@ struct __json_element
 typedef struct __json_member json_member_t;
 typedef struct __json_element json_element_t;
 
+struct __json_recycler
+{
+	struct list_head elements;
+	struct list_head members[JSON_RECYCLE_NAME_MAX];
+	const json_allocator_t *allocator;
+	char *string;
+	size_t capacity;
+};
+
+struct __json_parser
+{
+	const json_allocator_t *allocator;
+	struct __json_recycler *recycler;
+	int duplicates;
+	int relaxed;
+	int numbers;
+	int max_depth;
+	size_t max_string;
+	size_t max_members;
+	size_t max_elements;
+	size_t nodes_left;
+	size_t memory_left;
+};
+
+typedef struct __json_parser json_parser_t;
+
+#ifdef JSON_PARSER_STATS
+static JSON_THREAD_LOCAL json_parse_stats_t __parse_stats;
+#endif
+
+static void *__json_malloc(size_t size, const json_allocator_t *allocator)
+{
+	JSON_STATS_ADD(allocs, 1);
+	if (!allocator)
+		return malloc(size);
+
+	return allocator->alloc(size, allocator->context);
+}
+
+static void *__json_realloc(void *ptr, size_t size,
+							const json_allocator_t *allocator)
+{
+	if (!allocator)
+		return realloc(ptr, size);
+
+	return allocator->realloc(ptr, size, allocator->context);
+}
+
+static void __json_free(void *ptr, const json_allocator_t *allocator)
+{
+	if (!allocator)
+		free(ptr);
+	else
+		allocator->free(ptr, allocator->context);
+}
+
+struct __json_node_pool
+{
+	void *free_list[JSON_NODE_CLASSES];
+	size_t nodes;
+	size_t max_nodes;
+	json_node_pool_stats_t stats;
+};
+
+static JSON_THREAD_LOCAL struct __json_node_pool __node_pool;
+
+/* Nodes of the default allocator are rounded up to JSON_NODE_GRANULE, so
+   that a node freed into the pool may serve any later node of the same
+   size class, whichever thread or pool state it was allocated under. */
+static void *__json_node_alloc(size_t size, const json_allocator_t *allocator)
+{
+	struct __json_node_pool *pool = &__node_pool;
+	size_t index;
+	void *node;
+
+	if (allocator)
+	{
+		JSON_STATS_ADD(allocs, 1);
+		return allocator->alloc(size, allocator->context);
+	}
+
+	index = (size - 1) / JSON_NODE_GRANULE;
+	if (pool->max_nodes != 0 && index < JSON_NODE_CLASSES)
+	{
+		node = pool->free_list[index];
+		if (node)
+		{
+			pool->free_list[index] = *(void **)node;
+			pool->nodes--;
+			pool->stats.hits++;
+			return node;
+		}
+
+		pool->stats.misses++;
+	}
+
+	JSON_STATS_ADD(allocs, 1);
+	return malloc((index + 1) * JSON_NODE_GRANULE);
+}
+
+static void __json_node_free(void *node, size_t size,
+							 const json_allocator_t *allocator)
+{
+	struct __json_node_pool *pool = &__node_pool;
+	size_t index;
+
+	if (allocator)
+	{
+		allocator->free(node, allocator->context);
+		return;
+	}
+
+	index = (size - 1) / JSON_NODE_GRANULE;
+	if (pool->max_nodes != 0 && index < JSON_NODE_CLASSES)
+	{
+		if (pool->nodes < pool->max_nodes)
+		{
+			*(void **)node = pool->free_list[index];
+			pool->free_list[index] = node;
+			pool->nodes++;
+			pool->stats.recycled++;
+			return;
+		}
+
+		pool->stats.released++;
+	}
+
+	free(node);
+}
+
+static json_value_t *__json_value_alloc(const json_allocator_t *allocator)
+{
+	json_value_t *val;
+
+	val = (json_value_t *)__json_node_alloc(sizeof (json_value_t), allocator);
+	if (val)
+		val->refs = 1;
+
+	return val;
+}
+
+static void __json_value_free(json_value_t *val,
+							  const json_allocator_t *allocator)
+{
+	__json_node_free(val, sizeof (json_value_t), allocator);
+}
+
+/* The name is terminated at its full length up front. A member freed
+   before its name is written, such as on a bad escape, then goes back to
+   the pool under a size class no larger than its block. */
+static json_member_t *__json_member_alloc(size_t len,
+										  const json_allocator_t *allocator)
+{
+	json_member_t *memb;
+
+	memb = (json_member_t *)__json_node_alloc(offsetof(json_member_t, name) +
+											  len + 1, allocator);
+	if (memb)
+		memb->name[len] = '\0';
+
+	return memb;
+}
+
+static void __json_member_free(json_member_t *memb,
+							   const json_allocator_t *allocator)
+{
+	size_t len;
+
+	if (allocator || __node_pool.max_nodes == 0)
+		__json_free(memb, allocator);
+	else
+	{
+		len = strlen(memb->name);
+		__json_node_free(memb, offsetof(json_member_t, name) + len + 1, NULL);
+	}
+}
+
+static json_element_t *__json_element_alloc(const json_allocator_t *allocator)
+{
+	return (json_element_t *)__json_node_alloc(sizeof (json_element_t),
+											   allocator);
+}
+
+static void __json_element_free(json_element_t *elem,
+								const json_allocator_t *allocator)
+{
+	__json_node_free(elem, sizeof (json_element_t), allocator);
+}
+
 static const int __whitespace_map[256] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -286,77 +561,787 @@ static int __parse_json_string(const char *cursor, const char **end,
 	return 0;
 }
 
-static const double __power_of_10[309] = {
+static const double __power_of_10[23] = {
 	1e0,	1e1,	1e2,	1e3,	1e4,
 	1e5,	1e6,	1e7,	1e8,	1e9,
 	1e10,	1e11,	1e12,	1e13,	1e14,
 	1e15,	1e16,	1e17,	1e18,	1e19,
-	1e20,	1e21,	1e22,	1e23,	1e24,
-	1e25,	1e26,	1e27,	1e28,	1e29,
-	1e30,	1e31,	1e32,	1e33,	1e34,
-	1e35,	1e36,	1e37,	1e38,	1e39,
-	1e40,	1e41,	1e42,	1e43,	1e44,
-	1e45,	1e46,	1e47,	1e48,	1e49,
-	1e50,	1e51,	1e52,	1e53,	1e54,
-	1e55,	1e56,	1e57,	1e58,	1e59,
-	1e60,	1e61,	1e62,	1e63,	1e64,
-	1e65,	1e66,	1e67,	1e68,	1e69,
-	1e70,	1e71,	1e72,	1e73,	1e74,
-	1e75,	1e76,	1e77,	1e78,	1e79,
-	1e80,	1e81,	1e82,	1e83,	1e84,
-	1e85,	1e86,	1e87,	1e88,	1e89,
-	1e90,	1e91,	1e92,	1e93,	1e94,
-	1e95,	1e96,	1e97,	1e98,	1e99,
-	1e100,	1e101,	1e102,	1e103,	1e104,
-	1e105,	1e106,	1e107,	1e108,	1e109,
-	1e110,	1e111,	1e112,	1e113,	1e114,
-	1e115,	1e116,	1e117,	1e118,	1e119,
-	1e120,	1e121,	1e122,	1e123,	1e124,
-	1e125,	1e126,	1e127,	1e128,	1e129,
-	1e130,	1e131,	1e132,	1e133,	1e134,
-	1e135,	1e136,	1e137,	1e138,	1e139,
-	1e140,	1e141,	1e142,	1e143,	1e144,
-	1e145,	1e146,	1e147,	1e148,	1e149,
-	1e150,	1e151,	1e152,	1e153,	1e154,
-	1e155,	1e156,	1e157,	1e158,	1e159,
-	1e160,	1e161,	1e162,	1e163,	1e164,
-	1e165,	1e166,	1e167,	1e168,	1e169,
-	1e170,	1e171,	1e172,	1e173,	1e174,
-	1e175,	1e176,	1e177,	1e178,	1e179,
-	1e180,	1e181,	1e182,	1e183,	1e184,
-	1e185,	1e186,	1e187,	1e188,	1e189,
-	1e190,	1e191,	1e192,	1e193,	1e194,
-	1e195,	1e196,	1e197,	1e198,	1e199,
-	1e200,	1e201,	1e202,	1e203,	1e204,
-	1e205,	1e206,	1e207,	1e208,	1e209,
-	1e210,	1e211,	1e212,	1e213,	1e214,
-	1e215,	1e216,	1e217,	1e218,	1e219,
-	1e220,	1e221,	1e222,	1e223,	1e224,
-	1e225,	1e226,	1e227,	1e228,	1e229,
-	1e230,	1e231,	1e232,	1e233,	1e234,
-	1e235,	1e236,	1e237,	1e238,	1e239,
-	1e240,	1e241,	1e242,	1e243,	1e244,
-	1e245,	1e246,	1e247,	1e248,	1e249,
-	1e250,	1e251,	1e252,	1e253,	1e254,
-	1e255,	1e256,	1e257,	1e258,	1e259,
-	1e260,	1e261,	1e262,	1e263,	1e264,
-	1e265,	1e266,	1e267,	1e268,	1e269,
-	1e270,	1e271,	1e272,	1e273,	1e274,
-	1e275,	1e276,	1e277,	1e278,	1e279,
-	1e280,	1e281,	1e282,	1e283,	1e284,
-	1e285,	1e286,	1e287,	1e288,	1e289,
-	1e290,	1e291,	1e292,	1e293,	1e294,
-	1e295,	1e296,	1e297,	1e298,	1e299,
-	1e300,	1e301,	1e302,	1e303,	1e304,
-	1e305,	1e306,	1e307,	1e308
+	1e20,	1e21,	1e22
 };
 
+#define JSON_POWER_OF_5_MIN		(-342)
+#define JSON_POWER_OF_5_MAX		308
+
+/* 5^q for q in [-342, 308], normalized to 128 bits: high and low halves. */
+static const unsigned long long __power_of_5[2 * (JSON_POWER_OF_5_MAX - JSON_POWER_OF_5_MIN + 1)] = {
+	0xeef453d6923bd65aULL, 0x113faa2906a13b3fULL,
+	0x9558b4661b6565f8ULL, 0x4ac7ca59a424c507ULL,
+	0xbaaee17fa23ebf76ULL, 0x5d79bcf00d2df649ULL,
+	0xe95a99df8ace6f53ULL, 0xf4d82c2c107973dcULL,
+	0x91d8a02bb6c10594ULL, 0x79071b9b8a4be869ULL,
+	0xb64ec836a47146f9ULL, 0x9748e2826cdee284ULL,
+	0xe3e27a444d8d98b7ULL, 0xfd1b1b2308169b25ULL,
+	0x8e6d8c6ab0787f72ULL, 0xfe30f0f5e50e20f7ULL,
+	0xb208ef855c969f4fULL, 0xbdbd2d335e51a935ULL,
+	0xde8b2b66b3bc4723ULL, 0xad2c788035e61382ULL,
+	0x8b16fb203055ac76ULL, 0x4c3bcb5021afcc31ULL,
+	0xaddcb9e83c6b1793ULL, 0xdf4abe242a1bbf3dULL,
+	0xd953e8624b85dd78ULL, 0xd71d6dad34a2af0dULL,
+	0x87d4713d6f33aa6bULL, 0x8672648c40e5ad68ULL,
+	0xa9c98d8ccb009506ULL, 0x680efdaf511f18c2ULL,
+	0xd43bf0effdc0ba48ULL, 0x0212bd1b2566def2ULL,
+	0x84a57695fe98746dULL, 0x014bb630f7604b57ULL,
+	0xa5ced43b7e3e9188ULL, 0x419ea3bd35385e2dULL,
+	0xcf42894a5dce35eaULL, 0x52064cac828675b9ULL,
+	0x818995ce7aa0e1b2ULL, 0x7343efebd1940993ULL,
+	0xa1ebfb4219491a1fULL, 0x1014ebe6c5f90bf8ULL,
+	0xca66fa129f9b60a6ULL, 0xd41a26e077774ef6ULL,
+	0xfd00b897478238d0ULL, 0x8920b098955522b4ULL,
+	0x9e20735e8cb16382ULL, 0x55b46e5f5d5535b0ULL,
+	0xc5a890362fddbc62ULL, 0xeb2189f734aa831dULL,
+	0xf712b443bbd52b7bULL, 0xa5e9ec7501d523e4ULL,
+	0x9a6bb0aa55653b2dULL, 0x47b233c92125366eULL,
+	0xc1069cd4eabe89f8ULL, 0x999ec0bb696e840aULL,
+	0xf148440a256e2c76ULL, 0xc00670ea43ca250dULL,
+	0x96cd2a865764dbcaULL, 0x380406926a5e5728ULL,
+	0xbc807527ed3e12bcULL, 0xc605083704f5ecf2ULL,
+	0xeba09271e88d976bULL, 0xf7864a44c633682eULL,
+	0x93445b8731587ea3ULL, 0x7ab3ee6afbe0211dULL,
+	0xb8157268fdae9e4cULL, 0x5960ea05bad82964ULL,
+	0xe61acf033d1a45dfULL, 0x6fb92487298e33bdULL,
+	0x8fd0c16206306babULL, 0xa5d3b6d479f8e056ULL,
+	0xb3c4f1ba87bc8696ULL, 0x8f48a4899877186cULL,
+	0xe0b62e2929aba83cULL, 0x331acdabfe94de87ULL,
+	0x8c71dcd9ba0b4925ULL, 0x9ff0c08b7f1d0b14ULL,
+	0xaf8e5410288e1b6fULL, 0x07ecf0ae5ee44dd9ULL,
+	0xdb71e91432b1a24aULL, 0xc9e82cd9f69d6150ULL,
+	0x892731ac9faf056eULL, 0xbe311c083a225cd2ULL,
+	0xab70fe17c79ac6caULL, 0x6dbd630a48aaf406ULL,
+	0xd64d3d9db981787dULL, 0x092cbbccdad5b108ULL,
+	0x85f0468293f0eb4eULL, 0x25bbf56008c58ea5ULL,
+	0xa76c582338ed2621ULL, 0xaf2af2b80af6f24eULL,
+	0xd1476e2c07286faaULL, 0x1af5af660db4aee1ULL,
+	0x82cca4db847945caULL, 0x50d98d9fc890ed4dULL,
+	0xa37fce126597973cULL, 0xe50ff107bab528a0ULL,
+	0xcc5fc196fefd7d0cULL, 0x1e53ed49a96272c8ULL,
+	0xff77b1fcbebcdc4fULL, 0x25e8e89c13bb0f7aULL,
+	0x9faacf3df73609b1ULL, 0x77b191618c54e9acULL,
+	0xc795830d75038c1dULL, 0xd59df5b9ef6a2417ULL,
+	0xf97ae3d0d2446f25ULL, 0x4b0573286b44ad1dULL,
+	0x9becce62836ac577ULL, 0x4ee367f9430aec32ULL,
+	0xc2e801fb244576d5ULL, 0x229c41f793cda73fULL,
+	0xf3a20279ed56d48aULL, 0x6b43527578c1110fULL,
+	0x9845418c345644d6ULL, 0x830a13896b78aaa9ULL,
+	0xbe5691ef416bd60cULL, 0x23cc986bc656d553ULL,
+	0xedec366b11c6cb8fULL, 0x2cbfbe86b7ec8aa8ULL,
+	0x94b3a202eb1c3f39ULL, 0x7bf7d71432f3d6a9ULL,
+	0xb9e08a83a5e34f07ULL, 0xdaf5ccd93fb0cc53ULL,
+	0xe858ad248f5c22c9ULL, 0xd1b3400f8f9cff68ULL,
+	0x91376c36d99995beULL, 0x23100809b9c21fa1ULL,
+	0xb58547448ffffb2dULL, 0xabd40a0c2832a78aULL,
+	0xe2e69915b3fff9f9ULL, 0x16c90c8f323f516cULL,
+	0x8dd01fad907ffc3bULL, 0xae3da7d97f6792e3ULL,
+	0xb1442798f49ffb4aULL, 0x99cd11cfdf41779cULL,
+	0xdd95317f31c7fa1dULL, 0x40405643d711d583ULL,
+	0x8a7d3eef7f1cfc52ULL, 0x482835ea666b2572ULL,
+	0xad1c8eab5ee43b66ULL, 0xda3243650005eecfULL,
+	0xd863b256369d4a40ULL, 0x90bed43e40076a82ULL,
+	0x873e4f75e2224e68ULL, 0x5a7744a6e804a291ULL,
+	0xa90de3535aaae202ULL, 0x711515d0a205cb36ULL,
+	0xd3515c2831559a83ULL, 0x0d5a5b44ca873e03ULL,
+	0x8412d9991ed58091ULL, 0xe858790afe9486c2ULL,
+	0xa5178fff668ae0b6ULL, 0x626e974dbe39a872ULL,
+	0xce5d73ff402d98e3ULL, 0xfb0a3d212dc8128fULL,
+	0x80fa687f881c7f8eULL, 0x7ce66634bc9d0b99ULL,
+	0xa139029f6a239f72ULL, 0x1c1fffc1ebc44e80ULL,
+	0xc987434744ac874eULL, 0xa327ffb266b56220ULL,
+	0xfbe9141915d7a922ULL, 0x4bf1ff9f0062baa8ULL,
+	0x9d71ac8fada6c9b5ULL, 0x6f773fc3603db4a9ULL,
+	0xc4ce17b399107c22ULL, 0xcb550fb4384d21d3ULL,
+	0xf6019da07f549b2bULL, 0x7e2a53a146606a48ULL,
+	0x99c102844f94e0fbULL, 0x2eda7444cbfc426dULL,
+	0xc0314325637a1939ULL, 0xfa911155fefb5308ULL,
+	0xf03d93eebc589f88ULL, 0x793555ab7eba27caULL,
+	0x96267c7535b763b5ULL, 0x4bc1558b2f3458deULL,
+	0xbbb01b9283253ca2ULL, 0x9eb1aaedfb016f16ULL,
+	0xea9c227723ee8bcbULL, 0x465e15a979c1cadcULL,
+	0x92a1958a7675175fULL, 0x0bfacd89ec191ec9ULL,
+	0xb749faed14125d36ULL, 0xcef980ec671f667bULL,
+	0xe51c79a85916f484ULL, 0x82b7e12780e7401aULL,
+	0x8f31cc0937ae58d2ULL, 0xd1b2ecb8b0908810ULL,
+	0xb2fe3f0b8599ef07ULL, 0x861fa7e6dcb4aa15ULL,
+	0xdfbdcece67006ac9ULL, 0x67a791e093e1d49aULL,
+	0x8bd6a141006042bdULL, 0xe0c8bb2c5c6d24e0ULL,
+	0xaecc49914078536dULL, 0x58fae9f773886e18ULL,
+	0xda7f5bf590966848ULL, 0xaf39a475506a899eULL,
+	0x888f99797a5e012dULL, 0x6d8406c952429603ULL,
+	0xaab37fd7d8f58178ULL, 0xc8e5087ba6d33b83ULL,
+	0xd5605fcdcf32e1d6ULL, 0xfb1e4a9a90880a64ULL,
+	0x855c3be0a17fcd26ULL, 0x5cf2eea09a55067fULL,
+	0xa6b34ad8c9dfc06fULL, 0xf42faa48c0ea481eULL,
+	0xd0601d8efc57b08bULL, 0xf13b94daf124da26ULL,
+	0x823c12795db6ce57ULL, 0x76c53d08d6b70858ULL,
+	0xa2cb1717b52481edULL, 0x54768c4b0c64ca6eULL,
+	0xcb7ddcdda26da268ULL, 0xa9942f5dcf7dfd09ULL,
+	0xfe5d54150b090b02ULL, 0xd3f93b35435d7c4cULL,
+	0x9efa548d26e5a6e1ULL, 0xc47bc5014a1a6dafULL,
+	0xc6b8e9b0709f109aULL, 0x359ab6419ca1091bULL,
+	0xf867241c8cc6d4c0ULL, 0xc30163d203c94b62ULL,
+	0x9b407691d7fc44f8ULL, 0x79e0de63425dcf1dULL,
+	0xc21094364dfb5636ULL, 0x985915fc12f542e4ULL,
+	0xf294b943e17a2bc4ULL, 0x3e6f5b7b17b2939dULL,
+	0x979cf3ca6cec5b5aULL, 0xa705992ceecf9c42ULL,
+	0xbd8430bd08277231ULL, 0x50c6ff782a838353ULL,
+	0xece53cec4a314ebdULL, 0xa4f8bf5635246428ULL,
+	0x940f4613ae5ed136ULL, 0x871b7795e136be99ULL,
+	0xb913179899f68584ULL, 0x28e2557b59846e3fULL,
+	0xe757dd7ec07426e5ULL, 0x331aeada2fe589cfULL,
+	0x9096ea6f3848984fULL, 0x3ff0d2c85def7621ULL,
+	0xb4bca50b065abe63ULL, 0x0fed077a756b53a9ULL,
+	0xe1ebce4dc7f16dfbULL, 0xd3e8495912c62894ULL,
+	0x8d3360f09cf6e4bdULL, 0x64712dd7abbbd95cULL,
+	0xb080392cc4349decULL, 0xbd8d794d96aacfb3ULL,
+	0xdca04777f541c567ULL, 0xecf0d7a0fc5583a0ULL,
+	0x89e42caaf9491b60ULL, 0xf41686c49db57244ULL,
+	0xac5d37d5b79b6239ULL, 0x311c2875c522ced5ULL,
+	0xd77485cb25823ac7ULL, 0x7d633293366b828bULL,
+	0x86a8d39ef77164bcULL, 0xae5dff9c02033197ULL,
+	0xa8530886b54dbdebULL, 0xd9f57f830283fdfcULL,
+	0xd267caa862a12d66ULL, 0xd072df63c324fd7bULL,
+	0x8380dea93da4bc60ULL, 0x4247cb9e59f71e6dULL,
+	0xa46116538d0deb78ULL, 0x52d9be85f074e608ULL,
+	0xcd795be870516656ULL, 0x67902e276c921f8bULL,
+	0x806bd9714632dff6ULL, 0x00ba1cd8a3db53b6ULL,
+	0xa086cfcd97bf97f3ULL, 0x80e8a40eccd228a4ULL,
+	0xc8a883c0fdaf7df0ULL, 0x6122cd128006b2cdULL,
+	0xfad2a4b13d1b5d6cULL, 0x796b805720085f81ULL,
+	0x9cc3a6eec6311a63ULL, 0xcbe3303674053bb0ULL,
+	0xc3f490aa77bd60fcULL, 0xbedbfc4411068a9cULL,
+	0xf4f1b4d515acb93bULL, 0xee92fb5515482d44ULL,
+	0x991711052d8bf3c5ULL, 0x751bdd152d4d1c4aULL,
+	0xbf5cd54678eef0b6ULL, 0xd262d45a78a0635dULL,
+	0xef340a98172aace4ULL, 0x86fb897116c87c34ULL,
+	0x9580869f0e7aac0eULL, 0xd45d35e6ae3d4da0ULL,
+	0xbae0a846d2195712ULL, 0x8974836059cca109ULL,
+	0xe998d258869facd7ULL, 0x2bd1a438703fc94bULL,
+	0x91ff83775423cc06ULL, 0x7b6306a34627ddcfULL,
+	0xb67f6455292cbf08ULL, 0x1a3bc84c17b1d542ULL,
+	0xe41f3d6a7377eecaULL, 0x20caba5f1d9e4a93ULL,
+	0x8e938662882af53eULL, 0x547eb47b7282ee9cULL,
+	0xb23867fb2a35b28dULL, 0xe99e619a4f23aa43ULL,
+	0xdec681f9f4c31f31ULL, 0x6405fa00e2ec94d4ULL,
+	0x8b3c113c38f9f37eULL, 0xde83bc408dd3dd04ULL,
+	0xae0b158b4738705eULL, 0x9624ab50b148d445ULL,
+	0xd98ddaee19068c76ULL, 0x3badd624dd9b0957ULL,
+	0x87f8a8d4cfa417c9ULL, 0xe54ca5d70a80e5d6ULL,
+	0xa9f6d30a038d1dbcULL, 0x5e9fcf4ccd211f4cULL,
+	0xd47487cc8470652bULL, 0x7647c3200069671fULL,
+	0x84c8d4dfd2c63f3bULL, 0x29ecd9f40041e073ULL,
+	0xa5fb0a17c777cf09ULL, 0xf468107100525890ULL,
+	0xcf79cc9db955c2ccULL, 0x7182148d4066eeb4ULL,
+	0x81ac1fe293d599bfULL, 0xc6f14cd848405530ULL,
+	0xa21727db38cb002fULL, 0xb8ada00e5a506a7cULL,
+	0xca9cf1d206fdc03bULL, 0xa6d90811f0e4851cULL,
+	0xfd442e4688bd304aULL, 0x908f4a166d1da663ULL,
+	0x9e4a9cec15763e2eULL, 0x9a598e4e043287feULL,
+	0xc5dd44271ad3cdbaULL, 0x40eff1e1853f29fdULL,
+	0xf7549530e188c128ULL, 0xd12bee59e68ef47cULL,
+	0x9a94dd3e8cf578b9ULL, 0x82bb74f8301958ceULL,
+	0xc13a148e3032d6e7ULL, 0xe36a52363c1faf01ULL,
+	0xf18899b1bc3f8ca1ULL, 0xdc44e6c3cb279ac1ULL,
+	0x96f5600f15a7b7e5ULL, 0x29ab103a5ef8c0b9ULL,
+	0xbcb2b812db11a5deULL, 0x7415d448f6b6f0e7ULL,
+	0xebdf661791d60f56ULL, 0x111b495b3464ad21ULL,
+	0x936b9fcebb25c995ULL, 0xcab10dd900beec34ULL,
+	0xb84687c269ef3bfbULL, 0x3d5d514f40eea742ULL,
+	0xe65829b3046b0afaULL, 0x0cb4a5a3112a5112ULL,
+	0x8ff71a0fe2c2e6dcULL, 0x47f0e785eaba72abULL,
+	0xb3f4e093db73a093ULL, 0x59ed216765690f56ULL,
+	0xe0f218b8d25088b8ULL, 0x306869c13ec3532cULL,
+	0x8c974f7383725573ULL, 0x1e414218c73a13fbULL,
+	0xafbd2350644eeacfULL, 0xe5d1929ef90898faULL,
+	0xdbac6c247d62a583ULL, 0xdf45f746b74abf39ULL,
+	0x894bc396ce5da772ULL, 0x6b8bba8c328eb783ULL,
+	0xab9eb47c81f5114fULL, 0x066ea92f3f326564ULL,
+	0xd686619ba27255a2ULL, 0xc80a537b0efefebdULL,
+	0x8613fd0145877585ULL, 0xbd06742ce95f5f36ULL,
+	0xa798fc4196e952e7ULL, 0x2c48113823b73704ULL,
+	0xd17f3b51fca3a7a0ULL, 0xf75a15862ca504c5ULL,
+	0x82ef85133de648c4ULL, 0x9a984d73dbe722fbULL,
+	0xa3ab66580d5fdaf5ULL, 0xc13e60d0d2e0ebbaULL,
+	0xcc963fee10b7d1b3ULL, 0x318df905079926a8ULL,
+	0xffbbcfe994e5c61fULL, 0xfdf17746497f7052ULL,
+	0x9fd561f1fd0f9bd3ULL, 0xfeb6ea8bedefa633ULL,
+	0xc7caba6e7c5382c8ULL, 0xfe64a52ee96b8fc0ULL,
+	0xf9bd690a1b68637bULL, 0x3dfdce7aa3c673b0ULL,
+	0x9c1661a651213e2dULL, 0x06bea10ca65c084eULL,
+	0xc31bfa0fe5698db8ULL, 0x486e494fcff30a62ULL,
+	0xf3e2f893dec3f126ULL, 0x5a89dba3c3efccfaULL,
+	0x986ddb5c6b3a76b7ULL, 0xf89629465a75e01cULL,
+	0xbe89523386091465ULL, 0xf6bbb397f1135823ULL,
+	0xee2ba6c0678b597fULL, 0x746aa07ded582e2cULL,
+	0x94db483840b717efULL, 0xa8c2a44eb4571cdcULL,
+	0xba121a4650e4ddebULL, 0x92f34d62616ce413ULL,
+	0xe896a0d7e51e1566ULL, 0x77b020baf9c81d17ULL,
+	0x915e2486ef32cd60ULL, 0x0ace1474dc1d122eULL,
+	0xb5b5ada8aaff80b8ULL, 0x0d819992132456baULL,
+	0xe3231912d5bf60e6ULL, 0x10e1fff697ed6c69ULL,
+	0x8df5efabc5979c8fULL, 0xca8d3ffa1ef463c1ULL,
+	0xb1736b96b6fd83b3ULL, 0xbd308ff8a6b17cb2ULL,
+	0xddd0467c64bce4a0ULL, 0xac7cb3f6d05ddbdeULL,
+	0x8aa22c0dbef60ee4ULL, 0x6bcdf07a423aa96bULL,
+	0xad4ab7112eb3929dULL, 0x86c16c98d2c953c6ULL,
+	0xd89d64d57a607744ULL, 0xe871c7bf077ba8b7ULL,
+	0x87625f056c7c4a8bULL, 0x11471cd764ad4972ULL,
+	0xa93af6c6c79b5d2dULL, 0xd598e40d3dd89bcfULL,
+	0xd389b47879823479ULL, 0x4aff1d108d4ec2c3ULL,
+	0x843610cb4bf160cbULL, 0xcedf722a585139baULL,
+	0xa54394fe1eedb8feULL, 0xc2974eb4ee658828ULL,
+	0xce947a3da6a9273eULL, 0x733d226229feea32ULL,
+	0x811ccc668829b887ULL, 0x0806357d5a3f525fULL,
+	0xa163ff802a3426a8ULL, 0xca07c2dcb0cf26f7ULL,
+	0xc9bcff6034c13052ULL, 0xfc89b393dd02f0b5ULL,
+	0xfc2c3f3841f17c67ULL, 0xbbac2078d443ace2ULL,
+	0x9d9ba7832936edc0ULL, 0xd54b944b84aa4c0dULL,
+	0xc5029163f384a931ULL, 0x0a9e795e65d4df11ULL,
+	0xf64335bcf065d37dULL, 0x4d4617b5ff4a16d5ULL,
+	0x99ea0196163fa42eULL, 0x504bced1bf8e4e45ULL,
+	0xc06481fb9bcf8d39ULL, 0xe45ec2862f71e1d6ULL,
+	0xf07da27a82c37088ULL, 0x5d767327bb4e5a4cULL,
+	0x964e858c91ba2655ULL, 0x3a6a07f8d510f86fULL,
+	0xbbe226efb628afeaULL, 0x890489f70a55368bULL,
+	0xeadab0aba3b2dbe5ULL, 0x2b45ac74ccea842eULL,
+	0x92c8ae6b464fc96fULL, 0x3b0b8bc90012929dULL,
+	0xb77ada0617e3bbcbULL, 0x09ce6ebb40173744ULL,
+	0xe55990879ddcaabdULL, 0xcc420a6a101d0515ULL,
+	0x8f57fa54c2a9eab6ULL, 0x9fa946824a12232dULL,
+	0xb32df8e9f3546564ULL, 0x47939822dc96abf9ULL,
+	0xdff9772470297ebdULL, 0x59787e2b93bc56f7ULL,
+	0x8bfbea76c619ef36ULL, 0x57eb4edb3c55b65aULL,
+	0xaefae51477a06b03ULL, 0xede622920b6b23f1ULL,
+	0xdab99e59958885c4ULL, 0xe95fab368e45ecedULL,
+	0x88b402f7fd75539bULL, 0x11dbcb0218ebb414ULL,
+	0xaae103b5fcd2a881ULL, 0xd652bdc29f26a119ULL,
+	0xd59944a37c0752a2ULL, 0x4be76d3346f0495fULL,
+	0x857fcae62d8493a5ULL, 0x6f70a4400c562ddbULL,
+	0xa6dfbd9fb8e5b88eULL, 0xcb4ccd500f6bb952ULL,
+	0xd097ad07a71f26b2ULL, 0x7e2000a41346a7a7ULL,
+	0x825ecc24c873782fULL, 0x8ed400668c0c28c8ULL,
+	0xa2f67f2dfa90563bULL, 0x728900802f0f32faULL,
+	0xcbb41ef979346bcaULL, 0x4f2b40a03ad2ffb9ULL,
+	0xfea126b7d78186bcULL, 0xe2f610c84987bfa8ULL,
+	0x9f24b832e6b0f436ULL, 0x0dd9ca7d2df4d7c9ULL,
+	0xc6ede63fa05d3143ULL, 0x91503d1c79720dbbULL,
+	0xf8a95fcf88747d94ULL, 0x75a44c6397ce912aULL,
+	0x9b69dbe1b548ce7cULL, 0xc986afbe3ee11abaULL,
+	0xc24452da229b021bULL, 0xfbe85badce996168ULL,
+	0xf2d56790ab41c2a2ULL, 0xfae27299423fb9c3ULL,
+	0x97c560ba6b0919a5ULL, 0xdccd879fc967d41aULL,
+	0xbdb6b8e905cb600fULL, 0x5400e987bbc1c920ULL,
+	0xed246723473e3813ULL, 0x290123e9aab23b68ULL,
+	0x9436c0760c86e30bULL, 0xf9a0b6720aaf6521ULL,
+	0xb94470938fa89bceULL, 0xf808e40e8d5b3e69ULL,
+	0xe7958cb87392c2c2ULL, 0xb60b1d1230b20e04ULL,
+	0x90bd77f3483bb9b9ULL, 0xb1c6f22b5e6f48c2ULL,
+	0xb4ecd5f01a4aa828ULL, 0x1e38aeb6360b1af3ULL,
+	0xe2280b6c20dd5232ULL, 0x25c6da63c38de1b0ULL,
+	0x8d590723948a535fULL, 0x579c487e5a38ad0eULL,
+	0xb0af48ec79ace837ULL, 0x2d835a9df0c6d851ULL,
+	0xdcdb1b2798182244ULL, 0xf8e431456cf88e65ULL,
+	0x8a08f0f8bf0f156bULL, 0x1b8e9ecb641b58ffULL,
+	0xac8b2d36eed2dac5ULL, 0xe272467e3d222f3fULL,
+	0xd7adf884aa879177ULL, 0x5b0ed81dcc6abb0fULL,
+	0x86ccbb52ea94baeaULL, 0x98e947129fc2b4e9ULL,
+	0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL,
+	0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL,
+	0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL,
+	0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL,
+	0xcdb02555653131b6ULL, 0x3792f412cb06794dULL,
+	0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL,
+	0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL,
+	0xc8de047564d20a8bULL, 0xf245825a5a445275ULL,
+	0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL,
+	0x9ced737bb6c4183dULL, 0x55464dd69685606bULL,
+	0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL,
+	0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL,
+	0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL,
+	0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL,
+	0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL,
+	0x95a8637627989aadULL, 0xdde7001379a44aa8ULL,
+	0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL,
+	0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL,
+	0x9226712162ab070dULL, 0xcab3961304ca70e8ULL,
+	0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL,
+	0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL,
+	0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL,
+	0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL,
+	0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL,
+	0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL,
+	0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL,
+	0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL,
+	0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL,
+	0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL,
+	0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL,
+	0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL,
+	0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL,
+	0xcfb11ead453994baULL, 0x67de18eda5814af2ULL,
+	0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL,
+	0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL,
+	0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL,
+	0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL,
+	0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL,
+	0xc612062576589ddaULL, 0x95364afe032a819eULL,
+	0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL,
+	0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL,
+	0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL,
+	0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL,
+	0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL,
+	0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL,
+	0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL,
+	0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL,
+	0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL,
+	0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL,
+	0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL,
+	0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL,
+	0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL,
+	0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL,
+	0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL,
+	0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL,
+	0x89705f4136b4a597ULL, 0x31680a88f8953031ULL,
+	0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL,
+	0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL,
+	0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL,
+	0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL,
+	0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL,
+	0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL,
+	0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL,
+	0xccccccccccccccccULL, 0xcccccccccccccccdULL,
+	0x8000000000000000ULL, 0x0000000000000000ULL,
+	0xa000000000000000ULL, 0x0000000000000000ULL,
+	0xc800000000000000ULL, 0x0000000000000000ULL,
+	0xfa00000000000000ULL, 0x0000000000000000ULL,
+	0x9c40000000000000ULL, 0x0000000000000000ULL,
+	0xc350000000000000ULL, 0x0000000000000000ULL,
+	0xf424000000000000ULL, 0x0000000000000000ULL,
+	0x9896800000000000ULL, 0x0000000000000000ULL,
+	0xbebc200000000000ULL, 0x0000000000000000ULL,
+	0xee6b280000000000ULL, 0x0000000000000000ULL,
+	0x9502f90000000000ULL, 0x0000000000000000ULL,
+	0xba43b74000000000ULL, 0x0000000000000000ULL,
+	0xe8d4a51000000000ULL, 0x0000000000000000ULL,
+	0x9184e72a00000000ULL, 0x0000000000000000ULL,
+	0xb5e620f480000000ULL, 0x0000000000000000ULL,
+	0xe35fa931a0000000ULL, 0x0000000000000000ULL,
+	0x8e1bc9bf04000000ULL, 0x0000000000000000ULL,
+	0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL,
+	0xde0b6b3a76400000ULL, 0x0000000000000000ULL,
+	0x8ac7230489e80000ULL, 0x0000000000000000ULL,
+	0xad78ebc5ac620000ULL, 0x0000000000000000ULL,
+	0xd8d726b7177a8000ULL, 0x0000000000000000ULL,
+	0x878678326eac9000ULL, 0x0000000000000000ULL,
+	0xa968163f0a57b400ULL, 0x0000000000000000ULL,
+	0xd3c21bcecceda100ULL, 0x0000000000000000ULL,
+	0x84595161401484a0ULL, 0x0000000000000000ULL,
+	0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL,
+	0xcecb8f27f4200f3aULL, 0x0000000000000000ULL,
+	0x813f3978f8940984ULL, 0x4000000000000000ULL,
+	0xa18f07d736b90be5ULL, 0x5000000000000000ULL,
+	0xc9f2c9cd04674edeULL, 0xa400000000000000ULL,
+	0xfc6f7c4045812296ULL, 0x4d00000000000000ULL,
+	0x9dc5ada82b70b59dULL, 0xf020000000000000ULL,
+	0xc5371912364ce305ULL, 0x6c28000000000000ULL,
+	0xf684df56c3e01bc6ULL, 0xc732000000000000ULL,
+	0x9a130b963a6c115cULL, 0x3c7f400000000000ULL,
+	0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL,
+	0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL,
+	0x96769950b50d88f4ULL, 0x1314448000000000ULL,
+	0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL,
+	0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL,
+	0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL,
+	0xb7abc627050305adULL, 0xf14a3d9e40000000ULL,
+	0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL,
+	0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL,
+	0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL,
+	0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL,
+	0x8c213d9da502de45ULL, 0x4526f422cc340000ULL,
+	0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL,
+	0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL,
+	0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL,
+	0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL,
+	0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL,
+	0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL,
+	0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL,
+	0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL,
+	0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL,
+	0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL,
+	0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL,
+	0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL,
+	0x9f4f2726179a2245ULL, 0x01d762422c946590ULL,
+	0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL,
+	0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL,
+	0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL,
+	0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL,
+	0xf316271c7fc3908aULL, 0x8bef464e3945ef7aULL,
+	0x97edd871cfda3a56ULL, 0x97758bf0e3cbb5acULL,
+	0xbde94e8e43d0c8ecULL, 0x3d52eeed1cbea317ULL,
+	0xed63a231d4c4fb27ULL, 0x4ca7aaa863ee4bddULL,
+	0x945e455f24fb1cf8ULL, 0x8fe8caa93e74ef6aULL,
+	0xb975d6b6ee39e436ULL, 0xb3e2fd538e122b44ULL,
+	0xe7d34c64a9c85d44ULL, 0x60dbbca87196b616ULL,
+	0x90e40fbeea1d3a4aULL, 0xbc8955e946fe31cdULL,
+	0xb51d13aea4a488ddULL, 0x6babab6398bdbe41ULL,
+	0xe264589a4dcdab14ULL, 0xc696963c7eed2dd1ULL,
+	0x8d7eb76070a08aecULL, 0xfc1e1de5cf543ca2ULL,
+	0xb0de65388cc8ada8ULL, 0x3b25a55f43294bcbULL,
+	0xdd15fe86affad912ULL, 0x49ef0eb713f39ebeULL,
+	0x8a2dbf142dfcc7abULL, 0x6e3569326c784337ULL,
+	0xacb92ed9397bf996ULL, 0x49c2c37f07965404ULL,
+	0xd7e77a8f87daf7fbULL, 0xdc33745ec97be906ULL,
+	0x86f0ac99b4e8dafdULL, 0x69a028bb3ded71a3ULL,
+	0xa8acd7c0222311bcULL, 0xc40832ea0d68ce0cULL,
+	0xd2d80db02aabd62bULL, 0xf50a3fa490c30190ULL,
+	0x83c7088e1aab65dbULL, 0x792667c6da79e0faULL,
+	0xa4b8cab1a1563f52ULL, 0x577001b891185938ULL,
+	0xcde6fd5e09abcf26ULL, 0xed4c0226b55e6f86ULL,
+	0x80b05e5ac60b6178ULL, 0x544f8158315b05b4ULL,
+	0xa0dc75f1778e39d6ULL, 0x696361ae3db1c721ULL,
+	0xc913936dd571c84cULL, 0x03bc3a19cd1e38e9ULL,
+	0xfb5878494ace3a5fULL, 0x04ab48a04065c723ULL,
+	0x9d174b2dcec0e47bULL, 0x62eb0d64283f9c76ULL,
+	0xc45d1df942711d9aULL, 0x3ba5d0bd324f8394ULL,
+	0xf5746577930d6500ULL, 0xca8f44ec7ee36479ULL,
+	0x9968bf6abbe85f20ULL, 0x7e998b13cf4e1ecbULL,
+	0xbfc2ef456ae276e8ULL, 0x9e3fedd8c321a67eULL,
+	0xefb3ab16c59b14a2ULL, 0xc5cfe94ef3ea101eULL,
+	0x95d04aee3b80ece5ULL, 0xbba1f1d158724a12ULL,
+	0xbb445da9ca61281fULL, 0x2a8a6e45ae8edc97ULL,
+	0xea1575143cf97226ULL, 0xf52d09d71a3293bdULL,
+	0x924d692ca61be758ULL, 0x593c2626705f9c56ULL,
+	0xb6e0c377cfa2e12eULL, 0x6f8b2fb00c77836cULL,
+	0xe498f455c38b997aULL, 0x0b6dfb9c0f956447ULL,
+	0x8edf98b59a373fecULL, 0x4724bd4189bd5eacULL,
+	0xb2977ee300c50fe7ULL, 0x58edec91ec2cb657ULL,
+	0xdf3d5e9bc0f653e1ULL, 0x2f2967b66737e3edULL,
+	0x8b865b215899f46cULL, 0xbd79e0d20082ee74ULL,
+	0xae67f1e9aec07187ULL, 0xecd8590680a3aa11ULL,
+	0xda01ee641a708de9ULL, 0xe80e6f4820cc9495ULL,
+	0x884134fe908658b2ULL, 0x3109058d147fdcddULL,
+	0xaa51823e34a7eedeULL, 0xbd4b46f0599fd415ULL,
+	0xd4e5e2cdc1d1ea96ULL, 0x6c9e18ac7007c91aULL,
+	0x850fadc09923329eULL, 0x03e2cf6bc604ddb0ULL,
+	0xa6539930bf6bff45ULL, 0x84db8346b786151cULL,
+	0xcfe87f7cef46ff16ULL, 0xe612641865679a63ULL,
+	0x81f14fae158c5f6eULL, 0x4fcb7e8f3f60c07eULL,
+	0xa26da3999aef7749ULL, 0xe3be5e330f38f09dULL,
+	0xcb090c8001ab551cULL, 0x5cadf5bfd3072cc5ULL,
+	0xfdcb4fa002162a63ULL, 0x73d9732fc7c8f7f6ULL,
+	0x9e9f11c4014dda7eULL, 0x2867e7fddcdd9afaULL,
+	0xc646d63501a1511dULL, 0xb281e1fd541501b8ULL,
+	0xf7d88bc24209a565ULL, 0x1f225a7ca91a4226ULL,
+	0x9ae757596946075fULL, 0x3375788de9b06958ULL,
+	0xc1a12d2fc3978937ULL, 0x0052d6b1641c83aeULL,
+	0xf209787bb47d6b84ULL, 0xc0678c5dbd23a49aULL,
+	0x9745eb4d50ce6332ULL, 0xf840b7ba963646e0ULL,
+	0xbd176620a501fbffULL, 0xb650e5a93bc3d898ULL,
+	0xec5d3fa8ce427affULL, 0xa3e51f138ab4cebeULL,
+	0x93ba47c980e98cdfULL, 0xc66f336c36b10137ULL,
+	0xb8a8d9bbe123f017ULL, 0xb80b0047445d4184ULL,
+	0xe6d3102ad96cec1dULL, 0xa60dc059157491e5ULL,
+	0x9043ea1ac7e41392ULL, 0x87c89837ad68db2fULL,
+	0xb454e4a179dd1877ULL, 0x29babe4598c311fbULL,
+	0xe16a1dc9d8545e94ULL, 0xf4296dd6fef3d67aULL,
+	0x8ce2529e2734bb1dULL, 0x1899e4a65f58660cULL,
+	0xb01ae745b101e9e4ULL, 0x5ec05dcff72e7f8fULL,
+	0xdc21a1171d42645dULL, 0x76707543f4fa1f73ULL,
+	0x899504ae72497ebaULL, 0x6a06494a791c53a8ULL,
+	0xabfa45da0edbde69ULL, 0x0487db9d17636892ULL,
+	0xd6f8d7509292d603ULL, 0x45a9d2845d3c42b6ULL,
+	0x865b86925b9bc5c2ULL, 0x0b8a2392ba45a9b2ULL,
+	0xa7f26836f282b732ULL, 0x8e6cac7768d7141eULL,
+	0xd1ef0244af2364ffULL, 0x3207d795430cd926ULL,
+	0x8335616aed761f1fULL, 0x7f44e6bd49e807b8ULL,
+	0xa402b9c5a8d3a6e7ULL, 0x5f16206c9c6209a6ULL,
+	0xcd036837130890a1ULL, 0x36dba887c37a8c0fULL,
+	0x802221226be55a64ULL, 0xc2494954da2c9789ULL,
+	0xa02aa96b06deb0fdULL, 0xf2db9baa10b7bd6cULL,
+	0xc83553c5c8965d3dULL, 0x6f92829494e5acc7ULL,
+	0xfa42a8b73abbf48cULL, 0xcb772339ba1f17f9ULL,
+	0x9c69a97284b578d7ULL, 0xff2a760414536efbULL,
+	0xc38413cf25e2d70dULL, 0xfef5138519684abaULL,
+	0xf46518c2ef5b8cd1ULL, 0x7eb258665fc25d69ULL,
+	0x98bf2f79d5993802ULL, 0xef2f773ffbd97a61ULL,
+	0xbeeefb584aff8603ULL, 0xaafb550ffacfd8faULL,
+	0xeeaaba2e5dbf6784ULL, 0x95ba2a53f983cf38ULL,
+	0x952ab45cfa97a0b2ULL, 0xdd945a747bf26183ULL,
+	0xba756174393d88dfULL, 0x94f971119aeef9e4ULL,
+	0xe912b9d1478ceb17ULL, 0x7a37cd5601aab85dULL,
+	0x91abb422ccb812eeULL, 0xac62e055c10ab33aULL,
+	0xb616a12b7fe617aaULL, 0x577b986b314d6009ULL,
+	0xe39c49765fdf9d94ULL, 0xed5a7e85fda0b80bULL,
+	0x8e41ade9fbebc27dULL, 0x14588f13be847307ULL,
+	0xb1d219647ae6b31cULL, 0x596eb2d8ae258fc8ULL,
+	0xde469fbd99a05fe3ULL, 0x6fca5f8ed9aef3bbULL,
+	0x8aec23d680043beeULL, 0x25de7bb9480d5854ULL,
+	0xada72ccc20054ae9ULL, 0xaf561aa79a10ae6aULL,
+	0xd910f7ff28069da4ULL, 0x1b2ba1518094da04ULL,
+	0x87aa9aff79042286ULL, 0x90fb44d2f05d0842ULL,
+	0xa99541bf57452b28ULL, 0x353a1607ac744a53ULL,
+	0xd3fa922f2d1675f2ULL, 0x42889b8997915ce8ULL,
+	0x847c9b5d7c2e09b7ULL, 0x69956135febada11ULL,
+	0xa59bc234db398c25ULL, 0x43fab9837e699095ULL,
+	0xcf02b2c21207ef2eULL, 0x94f967e45e03f4bbULL,
+	0x8161afb94b44f57dULL, 0x1d1be0eebac278f5ULL,
+	0xa1ba1ba79e1632dcULL, 0x6462d92a69731732ULL,
+	0xca28a291859bbf93ULL, 0x7d7b8f7503cfdcfeULL,
+	0xfcb2cb35e702af78ULL, 0x5cda735244c3d43eULL,
+	0x9defbf01b061adabULL, 0x3a0888136afa64a7ULL,
+	0xc56baec21c7a1916ULL, 0x088aaa1845b8fdd0ULL,
+	0xf6c69a72a3989f5bULL, 0x8aad549e57273d45ULL,
+	0x9a3c2087a63f6399ULL, 0x36ac54e2f678864bULL,
+	0xc0cb28a98fcf3c7fULL, 0x84576a1bb416a7ddULL,
+	0xf0fdf2d3f3c30b9fULL, 0x656d44a2a11c51d5ULL,
+	0x969eb7c47859e743ULL, 0x9f644ae5a4b1b325ULL,
+	0xbc4665b596706114ULL, 0x873d5d9f0dde1feeULL,
+	0xeb57ff22fc0c7959ULL, 0xa90cb506d155a7eaULL,
+	0x9316ff75dd87cbd8ULL, 0x09a7f12442d588f2ULL,
+	0xb7dcbf5354e9beceULL, 0x0c11ed6d538aeb2fULL,
+	0xe5d3ef282a242e81ULL, 0x8f1668c8a86da5faULL,
+	0x8fa475791a569d10ULL, 0xf96e017d694487bcULL,
+	0xb38d92d760ec4455ULL, 0x37c981dcc395a9acULL,
+	0xe070f78d3927556aULL, 0x85bbe253f47b1417ULL,
+	0x8c469ab843b89562ULL, 0x93956d7478ccec8eULL,
+	0xaf58416654a6babbULL, 0x387ac8d1970027b2ULL,
+	0xdb2e51bfe9d0696aULL, 0x06997b05fcc0319eULL,
+	0x88fcf317f22241e2ULL, 0x441fece3bdf81f03ULL,
+	0xab3c2fddeeaad25aULL, 0xd527e81cad7626c3ULL,
+	0xd60b3bd56a5586f1ULL, 0x8a71e223d8d3b074ULL,
+	0x85c7056562757456ULL, 0xf6872d5667844e49ULL,
+	0xa738c6bebb12d16cULL, 0xb428f8ac016561dbULL,
+	0xd106f86e69d785c7ULL, 0xe13336d701beba52ULL,
+	0x82a45b450226b39cULL, 0xecc0024661173473ULL,
+	0xa34d721642b06084ULL, 0x27f002d7f95d0190ULL,
+	0xcc20ce9bd35c78a5ULL, 0x31ec038df7b441f4ULL,
+	0xff290242c83396ceULL, 0x7e67047175a15271ULL,
+	0x9f79a169bd203e41ULL, 0x0f0062c6e984d386ULL,
+	0xc75809c42c684dd1ULL, 0x52c07b78a3e60868ULL,
+	0xf92e0c3537826145ULL, 0xa7709a56ccdf8a82ULL,
+	0x9bbcc7a142b17ccbULL, 0x88a66076400bb691ULL,
+	0xc2abf989935ddbfeULL, 0x6acff893d00ea435ULL,
+	0xf356f7ebf83552feULL, 0x0583f6b8c4124d43ULL,
+	0x98165af37b2153deULL, 0xc3727a337a8b704aULL,
+	0xbe1bf1b059e9a8d6ULL, 0x744f18c0592e4c5cULL,
+	0xeda2ee1c7064130cULL, 0x1162def06f79df73ULL,
+	0x9485d4d1c63e8be7ULL, 0x8addcb5645ac2ba8ULL,
+	0xb9a74a0637ce2ee1ULL, 0x6d953e2bd7173692ULL,
+	0xe8111c87c5c1ba99ULL, 0xc8fa8db6ccdd0437ULL,
+	0x910ab1d4db9914a0ULL, 0x1d9c9892400a22a2ULL,
+	0xb54d5e4a127f59c8ULL, 0x2503beb6d00cab4bULL,
+	0xe2a0b5dc971f303aULL, 0x2e44ae64840fd61dULL,
+	0x8da471a9de737e24ULL, 0x5ceaecfed289e5d2ULL,
+	0xb10d8e1456105dadULL, 0x7425a83e872c5f47ULL,
+	0xdd50f1996b947518ULL, 0xd12f124e28f77719ULL,
+	0x8a5296ffe33cc92fULL, 0x82bd6b70d99aaa6fULL,
+	0xace73cbfdc0bfb7bULL, 0x636cc64d1001550bULL,
+	0xd8210befd30efa5aULL, 0x3c47f7e05401aa4eULL,
+	0x8714a775e3e95c78ULL, 0x65acfaec34810a71ULL,
+	0xa8d9d1535ce3b396ULL, 0x7f1839a741a14d0dULL,
+	0xd31045a8341ca07cULL, 0x1ede48111209a050ULL,
+	0x83ea2b892091e44dULL, 0x934aed0aab460432ULL,
+	0xa4e4b66b68b65d60ULL, 0xf81da84d5617853fULL,
+	0xce1de40642e3f4b9ULL, 0x36251260ab9d668eULL,
+	0x80d2ae83e9ce78f3ULL, 0xc1d72b7c6b426019ULL,
+	0xa1075a24e4421730ULL, 0xb24cf65b8612f81fULL,
+	0xc94930ae1d529cfcULL, 0xdee033f26797b627ULL,
+	0xfb9b7cd9a4a7443cULL, 0x169840ef017da3b1ULL,
+	0x9d412e0806e88aa5ULL, 0x8e1f289560ee864eULL,
+	0xc491798a08a2ad4eULL, 0xf1a6f2bab92a27e2ULL,
+	0xf5b5d7ec8acb58a2ULL, 0xae10af696774b1dbULL,
+	0x9991a6f3d6bf1765ULL, 0xacca6da1e0a8ef29ULL,
+	0xbff610b0cc6edd3fULL, 0x17fd090a58d32af3ULL,
+	0xeff394dcff8a948eULL, 0xddfc4b4cef07f5b0ULL,
+	0x95f83d0a1fb69cd9ULL, 0x4abdaf101564f98eULL,
+	0xbb764c4ca7a4440fULL, 0x9d6d1ad41abe37f1ULL,
+	0xea53df5fd18d5513ULL, 0x84c86189216dc5edULL,
+	0x92746b9be2f8552cULL, 0x32fd3cf5b4e49bb4ULL,
+	0xb7118682dbb66a77ULL, 0x3fbc8c33221dc2a1ULL,
+	0xe4d5e82392a40515ULL, 0x0fabaf3feaa5334aULL,
+	0x8f05b1163ba6832dULL, 0x29cb4d87f2a7400eULL,
+	0xb2c71d5bca9023f8ULL, 0x743e20e9ef511012ULL,
+	0xdf78e4b2bd342cf6ULL, 0x914da9246b255416ULL,
+	0x8bab8eefb6409c1aULL, 0x1ad089b6c2f7548eULL,
+	0xae9672aba3d0c320ULL, 0xa184ac2473b529b1ULL,
+	0xda3c0f568cc4f3e8ULL, 0xc9e5d72d90a2741eULL,
+	0x8865899617fb1871ULL, 0x7e2fa67c7a658892ULL,
+	0xaa7eebfb9df9de8dULL, 0xddbb901b98feeab7ULL,
+	0xd51ea6fa85785631ULL, 0x552a74227f3ea565ULL,
+	0x8533285c936b35deULL, 0xd53a88958f87275fULL,
+	0xa67ff273b8460356ULL, 0x8a892abaf368f137ULL,
+	0xd01fef10a657842cULL, 0x2d2b7569b0432d85ULL,
+	0x8213f56a67f6b29bULL, 0x9c3b29620e29fc73ULL,
+	0xa298f2c501f45f42ULL, 0x8349f3ba91b47b8fULL,
+	0xcb3f2f7642717713ULL, 0x241c70a936219a73ULL,
+	0xfe0efb53d30dd4d7ULL, 0xed238cd383aa0110ULL,
+	0x9ec95d1463e8a506ULL, 0xf4363804324a40aaULL,
+	0xc67bb4597ce2ce48ULL, 0xb143c6053edcd0d5ULL,
+	0xf81aa16fdc1b81daULL, 0xdd94b7868e94050aULL,
+	0x9b10a4e5e9913128ULL, 0xca7cf2b4191c8326ULL,
+	0xc1d4ce1f63f57d72ULL, 0xfd1c2f611f63a3f0ULL,
+	0xf24a01a73cf2dccfULL, 0xbc633b39673c8cecULL,
+	0x976e41088617ca01ULL, 0xd5be0503e085d813ULL,
+	0xbd49d14aa79dbc82ULL, 0x4b2d8644d8a74e18ULL,
+	0xec9c459d51852ba2ULL, 0xddf8e7d60ed1219eULL,
+	0x93e1ab8252f33b45ULL, 0xcabb90e5c942b503ULL,
+	0xb8da1662e7b00a17ULL, 0x3d6a751f3b936243ULL,
+	0xe7109bfba19c0c9dULL, 0x0cc512670a783ad4ULL,
+	0x906a617d450187e2ULL, 0x27fb2b80668b24c5ULL,
+	0xb484f9dc9641e9daULL, 0xb1f9f660802dedf6ULL,
+	0xe1a63853bbd26451ULL, 0x5e7873f8a0396973ULL,
+	0x8d07e33455637eb2ULL, 0xdb0b487b6423e1e8ULL,
+	0xb049dc016abc5e5fULL, 0x91ce1a9a3d2cda62ULL,
+	0xdc5c5301c56b75f7ULL, 0x7641a140cc7810fbULL,
+	0x89b9b3e11b6329baULL, 0xa9e904c87fcb0a9dULL,
+	0xac2820d9623bf429ULL, 0x546345fa9fbdcd44ULL,
+	0xd732290fbacaf133ULL, 0xa97c177947ad4095ULL,
+	0x867f59a9d4bed6c0ULL, 0x49ed8eabcccc485dULL,
+	0xa81f301449ee8c70ULL, 0x5c68f256bfff5a74ULL,
+	0xd226fc195c6a2f8cULL, 0x73832eec6fff3111ULL,
+	0x83585d8fd9c25db7ULL, 0xc831fd53c5ff7eabULL,
+	0xa42e74f3d032f525ULL, 0xba3e7ca8b77f5e55ULL,
+	0xcd3a1230c43fb26fULL, 0x28ce1bd2e55f35ebULL,
+	0x80444b5e7aa7cf85ULL, 0x7980d163cf5b81b3ULL,
+	0xa0555e361951c366ULL, 0xd7e105bcc332621fULL,
+	0xc86ab5c39fa63440ULL, 0x8dd9472bf3fefaa7ULL,
+	0xfa856334878fc150ULL, 0xb14f98f6f0feb951ULL,
+	0x9c935e00d4b9d8d2ULL, 0x6ed1bf9a569f33d3ULL,
+	0xc3b8358109e84f07ULL, 0x0a862f80ec4700c8ULL,
+	0xf4a642e14c6262c8ULL, 0xcd27bb612758c0faULL,
+	0x98e7e9cccfbd7dbdULL, 0x8038d51cb897789cULL,
+	0xbf21e44003acdd2cULL, 0xe0470a63e6bd56c3ULL,
+	0xeeea5d5004981478ULL, 0x1858ccfce06cac74ULL,
+	0x95527a5202df0ccbULL, 0x0f37801e0c43ebc8ULL,
+	0xbaa718e68396cffdULL, 0xd30560258f54e6baULL,
+	0xe950df20247c83fdULL, 0x47c6b82ef32a2069ULL,
+	0x91d28b7416cdd27eULL, 0x4cdc331d57fa5441ULL,
+	0xb6472e511c81471dULL, 0xe0133fe4adf8e952ULL,
+	0xe3d8f9e563a198e5ULL, 0x58180fddd97723a6ULL,
+	0x8e679c2f5e44ff8fULL, 0x570f09eaa7ea7648ULL
+};
+
+static void __json_mul64(unsigned long long a, unsigned long long b,
+						 unsigned long long *hi, unsigned long long *lo)
+{
+#if defined(__SIZEOF_INT128__)
+	unsigned __int128 r = (unsigned __int128)a * b;
+
+	*hi = (unsigned long long)(r >> 64);
+	*lo = (unsigned long long)r;
+#else
+	unsigned long long a0 = a & 0xffffffff, a1 = a >> 32;
+	unsigned long long b0 = b & 0xffffffff, b1 = b >> 32;
+	unsigned long long p00 = a0 * b0, p01 = a0 * b1;
+	unsigned long long p10 = a1 * b0, p11 = a1 * b1;
+	unsigned long long mid = (p00 >> 32) + (p10 & 0xffffffff) + p01;
+
+	*hi = p11 + (p10 >> 32) + (mid >> 32);
+	*lo = (mid << 32) | (p00 & 0xffffffff);
+#endif
+}
+
+static int __json_clz64(unsigned long long x)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+
+	while (!(x & 0x8000000000000000ULL))
+	{
+		x <<= 1;
+		n++;
+	}
+
+	return n;
+#endif
+}
+
+/* Correctly rounded w * 10^q (Eisel-Lemire) for any w > 0.
+   Returns the bits of the positive double. */
+static unsigned long long __json_decimal_to_bits(unsigned long long w,
+												 long long q)
+{
+	const unsigned long long *p;
+	unsigned long long hi, lo;
+	unsigned long long mant;
+	int upper;
+	int shift;
+	int lz;
+	int e2;
+
+	if (q < JSON_POWER_OF_5_MIN)
+		return 0;
+
+	if (q > JSON_POWER_OF_5_MAX)
+		return 0x7ffULL << 52;
+
+	lz = __json_clz64(w);
+	w <<= lz;
+	p = &__power_of_5[2 * (q - JSON_POWER_OF_5_MIN)];
+	__json_mul64(w, p[0], &hi, &lo);
+	if ((hi & 0x1ff) == 0x1ff)
+	{
+		unsigned long long hi2, lo2;
+
+		__json_mul64(w, p[1], &hi2, &lo2);
+		lo += hi2;
+		if (hi2 > lo)
+			hi++;
+	}
+
+	upper = (int)(hi >> 63);
+	shift = upper + 9;
+	mant = hi >> shift;
+	/* floor(q * log2(10)) plus the exponent bias */
+	e2 = (int)(((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+	if (e2 <= 0)
+	{
+		if (-e2 + 1 >= 64)
+			return 0;
+
+		mant >>= -e2 + 1;
+		mant += mant & 1;
+		mant >>= 1;
+		return mant;
+	}
+
+	/* Exactly halfway between two doubles: round to even. This can only
+	   happen when 5^q is exact in 64 bits, that's q in [-4, 23]. */
+	if (lo <= 1 && q >= -4 && q <= 23 && (mant & 3) == 1 &&
+		(mant << shift) == hi)
+	{
+		mant &= ~1ULL;
+	}
+
+	mant += mant & 1;
+	mant >>= 1;
+	if (mant >= 1ULL << 53)
+	{
+		mant = 1ULL << 52;
+		e2++;
+	}
+
+	if (e2 >= 0x7ff)
+		return 0x7ffULL << 52;
+
+	return (mant & ~(1ULL << 52)) | ((unsigned long long)e2 << 52);
+}
+
 static int __parse_json_number(const char *cursor, const char **end,
 							   double *num)
 {
 	unsigned int digit;
+	unsigned long long mant;
+	unsigned long long bits;
 	long long exp = 0;
-	long long mant;
 	int figures;
 	int minus;
 	double n;
@@ -365,15 +1350,16 @@ static int __parse_json_number(const char *cursor, const char **end,
 	if (minus)
 		cursor++;
 
-	mant = *cursor - '0';
-	if (mant >= 1 && mant <= 9)
+	digit = (unsigned int)(*cursor - '0');
+	mant = digit;
+	if (digit >= 1 && digit <= 9)
 	{
 		figures = 1;
 		cursor++;
 		while (1)
 		{
 			digit = (unsigned int)(*cursor - '0');
-			if (digit <= 9 && figures < 18)
+			if (digit <= 9 && figures < 19)
 			{
 				mant = 10 * mant + digit;
 				figures++;
@@ -389,7 +1375,7 @@ static int __parse_json_number(const char *cursor, const char **end,
 			cursor++;
 		}
 	}
-	else if (mant == 0)
+	else if (digit == 0)
 	{
 		figures = 0;
 		cursor++;
@@ -415,7 +1401,7 @@ static int __parse_json_number(const char *cursor, const char **end,
 		while (1)
 		{
 			digit = (unsigned int)(*cursor - '0');
-			if (digit <= 9 && figures < 18)
+			if (digit <= 9 && figures < 19)
 			{
 				mant = 10 * mant + digit;
 				figures++;
@@ -468,7 +1454,7 @@ static int __parse_json_number(const char *cursor, const char **end,
 
 	if (exp != 0 && figures != 0)
 	{
-		while (exp > 0 && figures < 18)
+		while (exp > 0 && figures < 19)
 		{
 			mant *= 10;
 			figures++;
@@ -483,28 +1469,23 @@ static int __parse_json_number(const char *cursor, const char **end,
 		}
 	}
 
-	n = mant;
-	if (exp != 0 && figures != 0)
+	if (figures == 0)
+		n = 0.0;
+	else if (mant <= 1ULL << 53 && exp >= -22 && exp <= 22)
 	{
+		/* Both operands are exact, so is the result after one rounding. */
+		n = (double)mant;
 		if (exp > 0)
-		{
-			if (exp > 291)
-				n = INFINITY;
-			else
-				n *= __power_of_10[exp];
-		}
-		else
-		{
-			if (exp > -309)
-				n /= __power_of_10[-exp];
-			else if (exp > -324 - figures)
-			{
-				n /= __power_of_10[-exp - 308];
-				n /= __power_of_10[308];
-			}
-			else
-				n = 0.0;
-		}
+			n *= __power_of_10[exp];
+		else if (exp < 0)
+			n /= __power_of_10[-exp];
+	}
+	else
+	{
+		/* Correctly rounded too, except that digits after the 19th have
+		   been dropped and the result may then be 1 ulp too small. */
+		bits = __json_decimal_to_bits(mant, exp);
+		memcpy(&n, &bits, sizeof (double));
 	}
 
 	if (minus)
@@ -515,166 +1496,637 @@ static int __parse_json_number(const char *cursor, const char **end,
 	return 0;
 }
 
-static int __parse_json_value(const char *cursor, const char **end,
-							  int depth, json_value_t *val);
-
-static void __destroy_json_value(json_value_t *val);
-
-static int __parse_json_member(const char *cursor, const char **end,
-							   size_t escape, size_t len,
-							   int depth, json_member_t *memb)
+/* Check the grammar of a number without converting it. */
+static int __json_number_length(const char *cursor, size_t *len)
 {
-	int ret;
+	const char *p = cursor;
 
-	if (escape != 0)
+	if (*p == '-')
+		p++;
+
+	if (*p == '0')
+		p++;
+	else if (isdigit(*p))
 	{
-		ret = __parse_json_string(cursor, &cursor, escape, memb->name);
-		if (ret < 0)
-			return ret;
+		while (isdigit(*p))
+			p++;
 	}
 	else
+		return -2;
+
+	if (*p == '.')
 	{
-		memcpy(memb->name, cursor, len);
-		memb->name[len] = '\0';
-		cursor += len + 1;
-	}
+		p++;
+		if (!isdigit(*p))
+			return -2;
 
-	while (isspace(*cursor))
-		cursor++;
+		while (isdigit(*p))
+			p++;
+	}
 
-	if (*cursor != ':')
-		return -2;
+	if (*p == 'E' || *p == 'e')
+	{
+		p++;
+		if (*p == '+' || *p == '-')
+			p++;
 
-	cursor++;
-	while (isspace(*cursor))
-		cursor++;
+		if (!isdigit(*p))
+			return -2;
 
-	ret = __parse_json_value(cursor, &cursor, depth, &memb->value);
-	if (ret < 0)
-		return ret;
+		while (isdigit(*p))
+			p++;
+	}
 
-	*end = cursor;
+	*len = p - cursor;
 	return 0;
 }
 
-static int __parse_json_members(const char *cursor, const char **end,
-								int depth, json_object_t *obj)
+/* Raw numbers are converted each time their value is needed, lazy ones
+   only the first time. A lazy number then becomes an ordinary one, which
+   is why this writes to a const value. Frozen values may be read by many
+   threads, so freezing converts them all beforehand. */
+static double __json_number_value(const json_value_t *val)
 {
-	json_member_t *memb;
-	size_t escape;
-	size_t len;
-	int ret;
+	json_value_t *lazy;
+	const char *end;
+	double number;
 
-	while (isspace(*cursor))
-		cursor++;
+	if (!(val->flags & (JSON_FLAG_RAW | JSON_FLAG_LAZY)))
+		return val->value.number;
 
-	if (*cursor == '}')
+	if (val->flags & JSON_FLAG_RAW)
 	{
-		*end = cursor + 1;
-		return 0;
+		__parse_json_number(val->value.raw, &end, &number);
+		return number;
 	}
 
-	while (1)
-	{
-		if (*cursor != '\"')
-			return -2;
+	/* The cache is written through a const pointer, which is only safe
+	   because json_value_freeze() converts every lazy number first: the
+	   values of frozen documents, read by many threads, are never lazy.
+	   Should one be, it is converted on each call instead of cached. */
+	__parse_json_number(val->value.text, &end, &number);
+	if (val->flags & JSON_FLAG_FROZEN)
+		return number;
+
+	lazy = (json_value_t *)val;
+	lazy->value.number = number;
+	lazy->flags &= ~JSON_FLAG_LAZY;
+	return number;
+}
 
-		cursor++;
-		ret = __json_string_length(cursor, &escape, &len);
-		if (ret < 0)
-			return ret;
+static int __parse_json_value(const char *cursor, const char **end,
+							  int depth, json_parser_t *parser,
+							  json_value_t *val);
 
-		memb = (json_member_t *)malloc(offsetof(json_member_t, name) + len + 1);
-		if (!memb)
-			return -1;
+static void __destroy_json_value(json_value_t *val);
+static void __move_json_value(json_value_t *src, json_value_t *dest);
+static int __clone_json_value(const json_value_t *src,
+							  const json_allocator_t *allocator,
+							  json_value_t *dest);
+static void *__json_arena_alloc(size_t size, void *context);
+static void __json_block_retain(json_value_t *val);
+static void __json_block_release(json_value_t *val);
+
+/* Nodes taken from the recycler still hold their old value. Its string
+   buffer becomes the spare one, which the next string value parsed may
+   reuse if it is large enough. */
+static void __recycler_take_string(struct __json_recycler *recycler,
+								   const json_value_t *val)
+{
+	if (recycler->string)
+		__json_free(recycler->string, recycler->allocator);
 
-		ret = __parse_json_member(cursor, &cursor, escape, len, depth, memb);
-		if (ret < 0)
-		{
-			free(memb);
-			return ret;
-		}
+	if (val->type == JSON_VALUE_STRING)
+	{
+		recycler->string = val->value.string;
+		recycler->capacity = strlen(val->value.string) + 1;
+	}
+	else if (val->type == JSON_VALUE_NUMBER && (val->flags & JSON_FLAG_RAW))
+	{
+		recycler->string = val->value.raw;
+		recycler->capacity = strlen(val->value.raw) + 1;
+	}
+	else
+		recycler->string = NULL;
+}
 
-		list_add_tail(&memb->list, &obj->head);
-		obj->size++;
+/* Count a node of @size bytes against the limits of the parser. Recycled
+   nodes count as well, so the limits don't depend on what is reused. */
+static int __parser_charge(size_t size, json_parser_t *parser)
+{
+	if (parser->nodes_left == 0 || parser->memory_left < size)
+		return -1;
 
-		while (isspace(*cursor))
-			cursor++;
+	parser->nodes_left--;
+	parser->memory_left -= size;
+	return 0;
+}
 
-		if (*cursor == ',')
-		{
-			cursor++;
-			while (isspace(*cursor))
-				cursor++;
-		}
-		else if (*cursor == '}')
-			break;
-		else
-			return -2;
-	}
+/* The limit on strings and names applies after unescaping. @len counts
+   the text of a string with @escape escape sequences, less one backslash
+   each, and every sequence decodes to at least 4 bytes fewer than that
+   (\uXXXX to a single byte). Strings that are too long even so are
+   rejected before being copied; escaped ones are checked again once
+   decoded, by __parser_check_string(). */
+static int __parser_string_fits(size_t len, size_t escape,
+								const json_parser_t *parser)
+{
+	if (escape > len / 4)
+		escape = len / 4;
+
+	return len - 4 * escape <= parser->max_string;
+}
+
+static int __parser_check_string(const char *str, const json_parser_t *parser)
+{
+	if (parser->max_string != (size_t)-1 && strlen(str) > parser->max_string)
+		return -1;
 
-	*end = cursor + 1;
 	return 0;
 }
 
-static void __destroy_json_members(json_object_t *obj)
+static json_member_t *__parser_member_alloc(size_t len, size_t escape,
+											json_parser_t *parser)
 {
-	struct list_head *pos, *tmp;
+	struct __json_recycler *recycler = parser->recycler;
 	json_member_t *memb;
 
-	list_for_each_safe(pos, tmp, &obj->head)
+	if (!__parser_string_fits(len, escape, parser) ||
+		__parser_charge(offsetof(json_member_t, name) + len + 1, parser) < 0)
+		return NULL;
+
+	if (recycler && len < JSON_RECYCLE_NAME_MAX &&
+		!list_empty(&recycler->members[len]))
 	{
-		memb = list_entry(pos, json_member_t, list);
-		__destroy_json_value(&memb->value);
-		free(memb);
+		memb = list_entry(recycler->members[len].next, json_member_t, list);
+		list_del(&memb->list);
+		__recycler_take_string(recycler, &memb->value);
+		return memb;
 	}
+
+	return __json_member_alloc(len, parser->allocator);
 }
 
-static int __parse_json_object(const char *cursor, const char **end,
-							   int depth, json_object_t *obj)
+static json_element_t *__parser_element_alloc(json_parser_t *parser)
 {
-	int ret;
+	struct __json_recycler *recycler = parser->recycler;
+	json_element_t *elem;
 
-	if (depth == JSON_DEPTH_LIMIT)
-		return -3;
+	if (__parser_charge(sizeof (json_element_t), parser) < 0)
+		return NULL;
 
-	INIT_LIST_HEAD(&obj->head);
-	obj->size = 0;
-	ret = __parse_json_members(cursor, end, depth + 1, obj);
-	if (ret < 0)
+	if (recycler && !list_empty(&recycler->elements))
 	{
-		__destroy_json_members(obj);
-		return ret;
+		elem = list_entry(recycler->elements.next, json_element_t, list);
+		list_del(&elem->list);
+		__recycler_take_string(recycler, &elem->value);
+		return elem;
 	}
 
-	return 0;
+	return __json_element_alloc(parser->allocator);
 }
 
-static int __parse_json_elements(const char *cursor, const char **end,
-								 int depth, json_array_t *arr)
+static char *__parser_string_alloc(size_t size, size_t escape,
+								   json_parser_t *parser)
 {
-	json_element_t *elem;
-	int ret;
+	struct __json_recycler *recycler = parser->recycler;
+	char *str;
 
-	while (isspace(*cursor))
-		cursor++;
+	if (!__parser_string_fits(size - 1, escape, parser) ||
+		parser->memory_left < size)
+		return NULL;
 
-	if (*cursor == ']')
+	parser->memory_left -= size;
+	if (recycler && recycler->string && recycler->capacity >= size)
 	{
-		*end = cursor + 1;
-		return 0;
+		str = recycler->string;
+		recycler->string = NULL;
+		return str;
 	}
 
-	while (1)
-	{
-		elem = (json_element_t *)malloc(sizeof (json_element_t));
-		if (!elem)
-			return -1;
+	return (char *)__json_malloc(size, parser->allocator);
+}
 
-		ret = __parse_json_value(cursor, &cursor, depth, &elem->value);
-		if (ret < 0)
-		{
-			free(elem);
+static unsigned int __json_name_hash(const char *name, size_t len)
+{
+	unsigned int hash = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)name[i]) * 16777619U;
+
+	return hash;
+}
+
+#define JSON_INDEX_MIN		16
+
+/* A temporary hash index of an object's members, for duplicate names
+   while parsing and for patches touching many members of a large object.
+   Objects with duplicate names aren't indexed, so that lookups always
+   agree with json_object_find(). */
+struct __json_index_slot
+{
+	json_member_t *memb;
+	unsigned int hash;
+};
+
+struct __json_index
+{
+	size_t mask;
+	struct __json_index_slot *slots;
+	const json_allocator_t *allocator;
+};
+
+static char __json_index_removed;
+
+#define JSON_INDEX_REMOVED	((json_member_t *)&__json_index_removed)
+
+static struct __json_index_slot *__json_index_find(struct __json_index *index,
+												   const char *name)
+{
+	unsigned int hash = __json_name_hash(name, strlen(name));
+	struct __json_index_slot *slot;
+	size_t i = hash & index->mask;
+
+	while (slot = &index->slots[i], slot->memb)
+	{
+		if (slot->memb != JSON_INDEX_REMOVED && slot->hash == hash &&
+			strcmp(slot->memb->name, name) == 0)
+			return slot;
+
+		i = (i + 1) & index->mask;
+	}
+
+	return NULL;
+}
+
+static int __json_index_add(struct __json_index *index, json_member_t *memb)
+{
+	unsigned int hash = __json_name_hash(memb->name, strlen(memb->name));
+	struct __json_index_slot *slot;
+	size_t i = hash & index->mask;
+
+	while (slot = &index->slots[i], slot->memb &&
+		   slot->memb != JSON_INDEX_REMOVED)
+	{
+		if (slot->hash == hash && strcmp(slot->memb->name, memb->name) == 0)
+			return -1;
+
+		i = (i + 1) & index->mask;
+	}
+
+	slot->memb = memb;
+	slot->hash = hash;
+	return 0;
+}
+
+static const json_allocator_t *
+__json_user_allocator(const json_allocator_t *allocator);
+
+/* Number of slots of an open-addressing table for @count entries, so
+   that it stays at most half full. */
+static size_t __json_table_size(size_t count)
+{
+	size_t n = JSON_INDEX_MIN;
+
+	while (n < 2 * count)
+		n *= 2;
+
+	return n;
+}
+
+/* Scratch tables come from the allocator the document's allocator was
+   made from, never from a block or an arena, whose bookkeeping isn't
+   meant to be shared by readers of a frozen document. */
+static void *__json_table_alloc(size_t n, size_t slot_size,
+								const json_allocator_t *allocator)
+{
+	void *table = __json_malloc(n * slot_size,
+								__json_user_allocator(allocator));
+
+	if (table)
+		memset(table, 0, n * slot_size);
+
+	return table;
+}
+
+static void __json_table_free(void *table, const json_allocator_t *allocator)
+{
+	__json_free(table, __json_user_allocator(allocator));
+}
+
+static const json_allocator_t *
+__json_object_allocator(const json_object_t *obj)
+{
+	return list_entry(obj, json_value_t, value.object)->allocator;
+}
+
+static void __json_index_destroy(struct __json_index *index)
+{
+	if (index->slots)
+	{
+		__json_table_free(index->slots, index->allocator);
+		index->slots = NULL;
+	}
+}
+
+/* Room for @extra more members. Removed slots are never reused, so the
+   table stays at most half full. */
+static int __json_index_create(const json_object_t *obj, size_t extra,
+							   const json_allocator_t *allocator,
+							   struct __json_index *index)
+{
+	size_t n = __json_table_size(obj->size + extra);
+	struct list_head *pos;
+
+	index->slots = (struct __json_index_slot *)
+		__json_table_alloc(n, sizeof (struct __json_index_slot), allocator);
+	if (!index->slots)
+		return -1;
+
+	index->mask = n - 1;
+	index->allocator = allocator;
+	list_for_each(pos, &obj->head)
+	{
+		if (__json_index_add(index, list_entry(pos, json_member_t, list)) < 0)
+		{
+			__json_index_destroy(index);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int __parse_json_member(const char *cursor, const char **end,
+							   size_t escape, size_t len, int depth,
+							   json_parser_t *parser, json_member_t *memb)
+{
+	int ret;
+
+	JSON_STATS_ADD(copied_bytes, len);
+	if (escape != 0)
+	{
+		JSON_STATS_ADD(escaped_strings, 1);
+		ret = __parse_json_string(cursor, &cursor, escape, memb->name);
+		if (ret < 0)
+			return ret;
+
+		if (__parser_check_string(memb->name, parser) < 0)
+			return -1;
+	}
+	else
+	{
+		memcpy(memb->name, cursor, len);
+		memb->name[len] = '\0';
+		cursor += len + 1;
+	}
+
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor != ':')
+		return -2;
+
+	cursor++;
+	while (isspace(*cursor))
+		cursor++;
+
+	ret = __parse_json_value(cursor, &cursor, depth, parser, &memb->value);
+	if (ret < 0)
+		return ret;
+
+	*end = cursor;
+	return 0;
+}
+
+/* Add a parsed member to @obj under the parser's policy for duplicate
+   names. A duplicate that is dropped or replaces an earlier value does
+   not count against the parser's member limit.
+   Names are looked up linearly in small objects, and in @index once
+   there are JSON_INDEX_MIN members. The index is rebuilt twice as large
+   whenever it gets half full, so that each object costs O(n). Its slots
+   are allocated like the nodes and count against the memory limit. */
+static int __parser_add_member(json_member_t *memb, json_object_t *obj,
+							   struct __json_index *index,
+							   json_parser_t *parser)
+{
+	struct __json_index_slot *slot;
+	json_member_t *prev = NULL;
+	struct list_head *pos;
+	size_t size;
+
+	if (index->slots)
+	{
+		slot = __json_index_find(index, memb->name);
+		if (slot)
+			prev = slot->memb;
+	}
+	else
+	{
+		list_for_each(pos, &obj->head)
+		{
+			if (strcmp(list_entry(pos, json_member_t, list)->name,
+					   memb->name) == 0)
+			{
+				prev = list_entry(pos, json_member_t, list);
+				break;
+			}
+		}
+	}
+
+	if (prev)
+	{
+		if (parser->duplicates == JSON_DUPLICATE_KEEP_LAST)
+		{
+			__destroy_json_value(&prev->value);
+			__move_json_value(&memb->value, &prev->value);
+		}
+		else
+			__destroy_json_value(&memb->value);
+
+		__json_member_free(memb, parser->allocator);
+		return parser->duplicates == JSON_DUPLICATE_REJECT ? -2 : 0;
+	}
+
+	if (obj->size == parser->max_members)
+	{
+		__destroy_json_value(&memb->value);
+		__json_member_free(memb, parser->allocator);
+		return -3;
+	}
+
+	list_add_tail(&memb->list, &obj->head);
+	obj->size++;
+	if (obj->size < JSON_INDEX_MIN)
+		return 0;
+
+	if (index->slots && 2 * obj->size <= index->mask)
+		return __json_index_add(index, memb);
+
+	__json_index_destroy(index);
+	size = __json_table_size(2 * obj->size) *
+		   sizeof (struct __json_index_slot);
+	if (parser->memory_left < size)
+		return -3;
+
+	parser->memory_left -= size;
+	return __json_index_create(obj, obj->size, parser->allocator, index);
+}
+
+static int __parse_json_members(const char *cursor, const char **end,
+								int depth, json_parser_t *parser,
+								json_object_t *obj)
+{
+	struct __json_index index;
+	json_member_t *memb;
+	size_t escape;
+	size_t len;
+	int ret;
+
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor == '}')
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	index.slots = NULL;
+	while (1)
+	{
+		ret = -2;
+		if (*cursor != '\"')
+			break;
+
+		cursor++;
+		ret = __json_string_length(cursor, &escape, &len);
+		if (ret < 0)
+			break;
+
+		ret = -3;
+		if (obj->size == parser->max_members &&
+			parser->duplicates == JSON_DUPLICATE_KEEP_ALL)
+			break;
+
+		ret = -1;
+		memb = __parser_member_alloc(len, escape, parser);
+		if (!memb)
+			break;
+
+		ret = __parse_json_member(cursor, &cursor, escape, len, depth,
+								  parser, memb);
+		if (ret < 0)
+		{
+			__json_member_free(memb, parser->allocator);
+			break;
+		}
+
+		if (parser->duplicates == JSON_DUPLICATE_KEEP_ALL)
+		{
+			list_add_tail(&memb->list, &obj->head);
+			obj->size++;
+		}
+		else
+		{
+			ret = __parser_add_member(memb, obj, &index, parser);
+			if (ret < 0)
+				break;
+		}
+
+		while (isspace(*cursor))
+			cursor++;
+
+		if (*cursor == ',')
+		{
+			cursor++;
+			while (isspace(*cursor))
+				cursor++;
+		}
+		else if (*cursor == '}')
+		{
+			*end = cursor + 1;
+			ret = 0;
+			break;
+		}
+		else
+		{
+			ret = -2;
+			break;
+		}
+	}
+
+	__json_index_destroy(&index);
+
+	return ret;
+}
+
+static void __destroy_json_members(json_object_t *obj,
+								   const json_allocator_t *allocator)
+{
+	struct list_head *pos, *tmp;
+	json_member_t *memb;
+
+	list_for_each_safe(pos, tmp, &obj->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		__destroy_json_value(&memb->value);
+		__json_member_free(memb, allocator);
+	}
+}
+
+static int __parse_json_object(const char *cursor, const char **end,
+							   int depth, json_parser_t *parser,
+							   json_object_t *obj)
+{
+	int ret;
+
+	if (depth == parser->max_depth)
+		return -3;
+
+	JSON_STATS_MAX(max_depth, depth + 1);
+	INIT_LIST_HEAD(&obj->head);
+	obj->size = 0;
+	ret = __parse_json_members(cursor, end, depth + 1, parser, obj);
+	if (ret < 0)
+	{
+		__destroy_json_members(obj, parser->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __parse_json_elements(const char *cursor, const char **end,
+								 int depth, json_parser_t *parser,
+								 json_array_t *arr)
+{
+	json_element_t *elem;
+	int ret;
+
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor == ']')
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	while (1)
+	{
+		if (arr->size == parser->max_elements)
+			return -3;
+
+		elem = __parser_element_alloc(parser);
+		if (!elem)
+			return -1;
+
+		ret = __parse_json_value(cursor, &cursor, depth, parser, &elem->value);
+		if (ret < 0)
+		{
+			__json_element_free(elem, parser->allocator);
 			return ret;
 		}
 
@@ -684,767 +2136,7459 @@ static int __parse_json_elements(const char *cursor, const char **end,
 		while (isspace(*cursor))
 			cursor++;
 
-		if (*cursor == ',')
+		if (*cursor == ',')
+		{
+			cursor++;
+			while (isspace(*cursor))
+				cursor++;
+		}
+		else if (*cursor == ']')
+			break;
+		else
+			return -2;
+	}
+
+	*end = cursor + 1;
+	return 0;
+}
+
+static void __destroy_json_elements(json_array_t *arr,
+									const json_allocator_t *allocator)
+{
+	struct list_head *pos, *tmp;
+	json_element_t *elem;
+
+	list_for_each_safe(pos, tmp, &arr->head)
+	{
+		elem = list_entry(pos, json_element_t, list);
+		__destroy_json_value(&elem->value);
+		__json_element_free(elem, allocator);
+	}
+}
+
+static int __parse_json_array(const char *cursor, const char **end,
+							  int depth, json_parser_t *parser,
+							  json_array_t *arr)
+{
+	int ret;
+
+	if (depth == parser->max_depth)
+		return -3;
+
+	JSON_STATS_MAX(max_depth, depth + 1);
+	INIT_LIST_HEAD(&arr->head);
+	arr->size = 0;
+	ret = __parse_json_elements(cursor, end, depth + 1, parser, arr);
+	if (ret < 0)
+	{
+		__destroy_json_elements(arr, parser->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* Numbers of JSON_NUMBERS_RAW keep a copy of their text. Those of
+   JSON_NUMBERS_LAZY keep it in the value itself, in place of the double,
+   and the rare ones too long to fit are converted at once. */
+static int __parse_json_number_text(const char *cursor, const char **end,
+									json_parser_t *parser, json_value_t *val)
+{
+	size_t len;
+	int ret;
+
+	ret = __json_number_length(cursor, &len);
+	if (ret < 0)
+		return ret;
+
+	if (parser->numbers == JSON_NUMBERS_RAW)
+	{
+		val->value.raw = __parser_string_alloc(len + 1, 0, parser);
+		if (!val->value.raw)
+			return -1;
+
+		memcpy(val->value.raw, cursor, len);
+		val->value.raw[len] = '\0';
+		val->flags = JSON_FLAG_RAW;
+	}
+	else if (len < sizeof val->value.text)
+	{
+		memcpy(val->value.text, cursor, len);
+		val->value.text[len] = '\0';
+		val->flags = JSON_FLAG_LAZY;
+	}
+	else
+	{
+		__parse_json_number(cursor, end, &val->value.number);
+		val->flags = 0;
+	}
+
+	*end = cursor + len;
+	JSON_STATS_ADD(nodes[JSON_VALUE_NUMBER], 1);
+	val->type = JSON_VALUE_NUMBER;
+	val->allocator = parser->allocator;
+	return 0;
+}
+
+static int __parse_json_value(const char *cursor, const char **end,
+							  int depth, json_parser_t *parser,
+							  json_value_t *val)
+{
+#ifdef JSON_PARSER_STATS
+	unsigned long long ticks;
+#endif
+	size_t escape;
+	size_t len;
+	int ret;
+
+	switch (*cursor)
+	{
+	case '\"':
+		cursor++;
+		ret = __json_string_length(cursor, &escape, &len);
+		if (ret < 0)
+			return ret;
+
+		val->value.string = __parser_string_alloc(len + 1, escape, parser);
+		if (!val->value.string)
+			return -1;
+
+		JSON_STATS_ADD(copied_bytes, len);
+		if (escape != 0)
+		{
+			JSON_STATS_ADD(escaped_strings, 1);
+			ret = __parse_json_string(cursor, end, escape, val->value.string);
+			if (ret >= 0)
+				ret = __parser_check_string(val->value.string, parser);
+
+			if (ret < 0)
+			{
+				__json_free(val->value.string, parser->allocator);
+				return ret;
+			}
+		}
+		else
+		{
+			memcpy(val->value.string, cursor, len);
+			val->value.string[len] = '\0';
+			*end = cursor + len + 1;
+		}
+
+		val->type = JSON_VALUE_STRING;
+		break;
+
+	case '-':
+	case '0':
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':
+		if (parser->numbers != JSON_NUMBERS_DOUBLE)
+			return __parse_json_number_text(cursor, end, parser, val);
+
+#ifdef JSON_PARSER_STATS
+		ticks = __json_ticks();
+		ret = __parse_json_number(cursor, end, &val->value.number);
+		__parse_stats.number_ticks += __json_ticks() - ticks;
+#else
+		ret = __parse_json_number(cursor, end, &val->value.number);
+#endif
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_NUMBER;
+		break;
+
+	case '{':
+		cursor++;
+		ret = __parse_json_object(cursor, end, depth, parser,
+								  &val->value.object);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_OBJECT;
+		break;
+
+	case '[':
+		cursor++;
+		ret = __parse_json_array(cursor, end, depth, parser,
+								 &val->value.array);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_ARRAY;
+		break;
+
+	case 't':
+		if (strncmp(cursor, "true", 4) != 0)
+			return -2;
+
+		*end = cursor + 4;
+		val->type = JSON_VALUE_TRUE;
+		break;
+
+	case 'f':
+		if (strncmp(cursor, "false", 5) != 0)
+			return -2;
+
+		*end = cursor + 5;
+		val->type = JSON_VALUE_FALSE;
+		break;
+
+	case 'n':
+		if (strncmp(cursor, "null", 4) != 0)
+			return -2;
+
+		*end = cursor + 4;
+		val->type = JSON_VALUE_NULL;
+		break;
+
+	default:
+		return -2;
+	}
+
+	JSON_STATS_ADD(nodes[val->type], 1);
+	val->allocator = parser->allocator;
+	val->flags = 0;
+	return 0;
+}
+
+static void __destroy_json_value(json_value_t *val)
+{
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		__json_free(val->value.string, val->allocator);
+		break;
+
+	case JSON_VALUE_NUMBER:
+		if (val->flags & JSON_FLAG_RAW)
+			__json_free(val->value.raw, val->allocator);
+
+		break;
+
+	case JSON_VALUE_OBJECT:
+#ifdef JSON_PARSER_INDEX
+		if (val->flags & JSON_FLAG_INDEX)
+			__json_free(val->value.object.index, val->allocator);
+#endif
+		__destroy_json_members(&val->value.object, val->allocator);
+		break;
+
+	case JSON_VALUE_ARRAY:
+		__destroy_json_elements(&val->value.array, val->allocator);
+		break;
+	}
+
+	if (val->flags & JSON_FLAG_BLOCK)
+		__json_block_release(val);
+}
+
+/* The JSON5 extensions of json_value_parse_options() are parsed by a copy
+   of the structural parser, so that the strict parser does not test for
+   any of them. Scalars of standard JSON go to __parse_json_value(). */
+
+static int __parse_json5_value(const char *cursor, const char **end,
+							   int depth, json_parser_t *parser,
+							   json_value_t *val);
+
+static const char *__skip_json5_space(const char *cursor, int relaxed)
+{
+	const char *p;
+
+	while (1)
+	{
+		while (isspace(*cursor))
+			cursor++;
+
+		if (*cursor != '/' || !(relaxed & JSON_RELAXED_COMMENTS))
+			break;
+
+		if (cursor[1] == '/')
+		{
+			cursor += 2;
+			while (*cursor != '\n' && *cursor != '\0')
+				cursor++;
+		}
+		else if (cursor[1] == '*')
+		{
+			/* An unclosed comment is left for the caller to reject. */
+			p = strstr(cursor + 2, "*/");
+			if (!p)
+				break;
+
+			cursor = p + 2;
+		}
+		else
+			break;
+	}
+
+	return cursor;
+}
+
+static int __json5_string_length(const char *cursor, size_t *escape,
+								 size_t *len)
+{
+	size_t esc = 0;
+	size_t n = 0;
+
+	while (cursor[n] != '\'')
+	{
+		if ((unsigned char)cursor[n] < 0x20)
+			return -2;
+
+		if (cursor[n] == '\\')
+		{
+			cursor++;
+			if (cursor[n] == '\0')
+				return -2;
+
+			esc++;
+		}
+
+		n++;
+	}
+
+	*escape = esc;
+	*len = n;
+	return 0;
+}
+
+static int __parse_json5_string(const char *cursor, const char **end,
+								char *str)
+{
+	int ret;
+
+	while (*cursor != '\'')
+	{
+		if (*cursor != '\\')
+		{
+			*str = *cursor;
+			cursor++;
+			str++;
+			continue;
+		}
+
+		cursor++;
+		switch (*cursor)
+		{
+		case '\'':
+		case '\"':
+		case '\\':
+		case '/':
+			*str = *cursor;
+			break;
+		case 'b':
+			*str = '\b';
+			break;
+		case 'f':
+			*str = '\f';
+			break;
+		case 'n':
+			*str = '\n';
+			break;
+		case 'r':
+			*str = '\r';
+			break;
+		case 't':
+			*str = '\t';
+			break;
+		case 'u':
+			cursor++;
+			ret = __parse_json_unicode(cursor, &cursor, str);
+			if (ret < 0)
+				return ret;
+
+			str += ret;
+			continue;
+
+		default:
+			return -2;
+		}
+
+		cursor++;
+		str++;
+	}
+
+	*str = '\0';
+	*end = cursor + 1;
+	return 0;
+}
+
+static int __parse_json5_nonfinite(const char *cursor, const char **end,
+								   double *number)
+{
+	double sign = 1;
+
+	if (*cursor == '-')
+	{
+		sign = -1;
+		cursor++;
+	}
+	else if (*cursor == '+')
+		cursor++;
+
+	if (strncmp(cursor, "Infinity", 8) == 0)
+	{
+		*number = sign * INFINITY;
+		*end = cursor + 8;
+	}
+	else if (strncmp(cursor, "NaN", 3) == 0)
+	{
+		*number = NAN;
+		*end = cursor + 3;
+	}
+	else
+		return -2;
+
+	return 0;
+}
+
+static int __parse_json5_member(const char *cursor, const char **end,
+								char quote, size_t escape, size_t len,
+								int depth, json_parser_t *parser,
+								json_member_t *memb)
+{
+	int ret;
+
+	JSON_STATS_ADD(copied_bytes, len);
+	if (quote == '\'')
+	{
+		ret = __parse_json5_string(cursor, &cursor, memb->name);
+		if (ret < 0)
+			return ret;
+	}
+	else if (escape != 0)
+	{
+		ret = __parse_json_string(cursor, &cursor, escape, memb->name);
+		if (ret < 0)
+			return ret;
+	}
+	else
+	{
+		memcpy(memb->name, cursor, len);
+		memb->name[len] = '\0';
+		cursor += len + 1;
+	}
+
+	if (escape != 0 && __parser_check_string(memb->name, parser) < 0)
+		return -1;
+
+	cursor = __skip_json5_space(cursor, parser->relaxed);
+	if (*cursor != ':')
+		return -2;
+
+	cursor = __skip_json5_space(cursor + 1, parser->relaxed);
+	ret = __parse_json5_value(cursor, &cursor, depth, parser, &memb->value);
+	if (ret < 0)
+		return ret;
+
+	*end = cursor;
+	return 0;
+}
+
+static int __parse_json5_members(const char *cursor, const char **end,
+								 int depth, json_parser_t *parser,
+								 json_object_t *obj)
+{
+	struct __json_index index;
+	json_member_t *memb;
+	size_t escape;
+	size_t len;
+	char quote;
+	int ret;
+
+	cursor = __skip_json5_space(cursor, parser->relaxed);
+	if (*cursor == '}')
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	index.slots = NULL;
+	while (1)
+	{
+		ret = -2;
+		quote = *cursor;
+		if (quote == '\"')
+			ret = __json_string_length(cursor + 1, &escape, &len);
+		else if (quote == '\'' &&
+				 (parser->relaxed & JSON_RELAXED_SINGLE_QUOTES))
+			ret = __json5_string_length(cursor + 1, &escape, &len);
+
+		if (ret < 0)
+			break;
+
+		cursor++;
+		ret = -3;
+		if (obj->size == parser->max_members &&
+			parser->duplicates == JSON_DUPLICATE_KEEP_ALL)
+			break;
+
+		ret = -1;
+		memb = __parser_member_alloc(len, escape, parser);
+		if (!memb)
+			break;
+
+		ret = __parse_json5_member(cursor, &cursor, quote, escape, len,
+								   depth, parser, memb);
+		if (ret < 0)
+		{
+			__json_member_free(memb, parser->allocator);
+			break;
+		}
+
+		if (parser->duplicates == JSON_DUPLICATE_KEEP_ALL)
+		{
+			list_add_tail(&memb->list, &obj->head);
+			obj->size++;
+		}
+		else
+		{
+			ret = __parser_add_member(memb, obj, &index, parser);
+			if (ret < 0)
+				break;
+		}
+
+		cursor = __skip_json5_space(cursor, parser->relaxed);
+		if (*cursor == ',')
+		{
+			cursor = __skip_json5_space(cursor + 1, parser->relaxed);
+			if (*cursor == '}' &&
+				(parser->relaxed & JSON_RELAXED_TRAILING_COMMAS))
+			{
+				*end = cursor + 1;
+				ret = 0;
+				break;
+			}
+		}
+		else if (*cursor == '}')
+		{
+			*end = cursor + 1;
+			ret = 0;
+			break;
+		}
+		else
+		{
+			ret = -2;
+			break;
+		}
+	}
+
+	__json_index_destroy(&index);
+
+	return ret;
+}
+
+static int __parse_json5_object(const char *cursor, const char **end,
+								int depth, json_parser_t *parser,
+								json_object_t *obj)
+{
+	int ret;
+
+	if (depth == parser->max_depth)
+		return -3;
+
+	JSON_STATS_MAX(max_depth, depth + 1);
+	INIT_LIST_HEAD(&obj->head);
+	obj->size = 0;
+	ret = __parse_json5_members(cursor, end, depth + 1, parser, obj);
+	if (ret < 0)
+	{
+		__destroy_json_members(obj, parser->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __parse_json5_elements(const char *cursor, const char **end,
+								  int depth, json_parser_t *parser,
+								  json_array_t *arr)
+{
+	json_element_t *elem;
+	int ret;
+
+	cursor = __skip_json5_space(cursor, parser->relaxed);
+	if (*cursor == ']')
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	while (1)
+	{
+		if (arr->size == parser->max_elements)
+			return -3;
+
+		elem = __parser_element_alloc(parser);
+		if (!elem)
+			return -1;
+
+		ret = __parse_json5_value(cursor, &cursor, depth, parser,
+								  &elem->value);
+		if (ret < 0)
+		{
+			__json_element_free(elem, parser->allocator);
+			return ret;
+		}
+
+		list_add_tail(&elem->list, &arr->head);
+		arr->size++;
+
+		cursor = __skip_json5_space(cursor, parser->relaxed);
+		if (*cursor == ',')
+		{
+			cursor = __skip_json5_space(cursor + 1, parser->relaxed);
+			if (*cursor == ']' &&
+				(parser->relaxed & JSON_RELAXED_TRAILING_COMMAS))
+				break;
+		}
+		else if (*cursor == ']')
+			break;
+		else
+			return -2;
+	}
+
+	*end = cursor + 1;
+	return 0;
+}
+
+static int __parse_json5_array(const char *cursor, const char **end,
+							   int depth, json_parser_t *parser,
+							   json_array_t *arr)
+{
+	int ret;
+
+	if (depth == parser->max_depth)
+		return -3;
+
+	JSON_STATS_MAX(max_depth, depth + 1);
+	INIT_LIST_HEAD(&arr->head);
+	arr->size = 0;
+	ret = __parse_json5_elements(cursor, end, depth + 1, parser, arr);
+	if (ret < 0)
+	{
+		__destroy_json_elements(arr, parser->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __parse_json5_value(const char *cursor, const char **end,
+							   int depth, json_parser_t *parser,
+							   json_value_t *val)
+{
+	size_t escape;
+	size_t len;
+	int ret;
+
+	switch (*cursor)
+	{
+	case '\'':
+		if (!(parser->relaxed & JSON_RELAXED_SINGLE_QUOTES))
+			return -2;
+
+		cursor++;
+		ret = __json5_string_length(cursor, &escape, &len);
+		if (ret < 0)
+			return ret;
+
+		val->value.string = __parser_string_alloc(len + 1, escape, parser);
+		if (!val->value.string)
+			return -1;
+
+		JSON_STATS_ADD(copied_bytes, len);
+		ret = __parse_json5_string(cursor, end, val->value.string);
+		if (ret >= 0 && escape != 0)
+			ret = __parser_check_string(val->value.string, parser);
+
+		if (ret < 0)
+		{
+			__json_free(val->value.string, parser->allocator);
+			return ret;
+		}
+
+		val->type = JSON_VALUE_STRING;
+		break;
+
+	case '-':
+		if (cursor[1] != 'I' && cursor[1] != 'N')
+			return __parse_json_value(cursor, end, depth, parser, val);
+
+		/* fall through */
+	case '+':
+	case 'I':
+	case 'N':
+		if (!(parser->relaxed & JSON_RELAXED_NONFINITE))
+			return -2;
+
+		ret = __parse_json5_nonfinite(cursor, end, &val->value.number);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_NUMBER;
+		break;
+
+	case '{':
+		cursor++;
+		ret = __parse_json5_object(cursor, end, depth, parser,
+								   &val->value.object);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_OBJECT;
+		break;
+
+	case '[':
+		cursor++;
+		ret = __parse_json5_array(cursor, end, depth, parser,
+								  &val->value.array);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_ARRAY;
+		break;
+
+	default:
+		return __parse_json_value(cursor, end, depth, parser, val);
+	}
+
+	JSON_STATS_ADD(nodes[val->type], 1);
+	val->allocator = parser->allocator;
+	val->flags = 0;
+	return 0;
+}
+
+static int __parse_json_document(const char *cursor, json_parser_t *parser,
+								 json_value_t *val)
+{
+#ifdef JSON_PARSER_STATS
+	unsigned long long ticks = __json_ticks();
+	const char *text = cursor;
+#endif
+	int ret;
+
+	cursor = __skip_json5_space(cursor, parser->relaxed);
+	if (parser->relaxed)
+		ret = __parse_json5_value(cursor, &cursor, 0, parser, val);
+	else
+		ret = __parse_json_value(cursor, &cursor, 0, parser, val);
+
+	if (ret < 0)
+		return ret;
+
+	cursor = __skip_json5_space(cursor, parser->relaxed);
+	if (*cursor != '\0')
+	{
+		__destroy_json_value(val);
+		return -2;
+	}
+
+#ifdef JSON_PARSER_STATS
+	__parse_stats.documents++;
+	__parse_stats.bytes += cursor - text;
+	__parse_stats.parse_ticks += __json_ticks() - ticks;
+#endif
+	return 0;
+}
+
+/* No limits but the nesting depth, for parsing without options. */
+static void __parser_init(const json_allocator_t *allocator,
+						  struct __json_recycler *recycler,
+						  json_parser_t *parser)
+{
+	parser->allocator = allocator;
+	parser->recycler = recycler;
+	parser->duplicates = JSON_DUPLICATE_KEEP_ALL;
+	parser->relaxed = 0;
+	parser->numbers = JSON_NUMBERS_DOUBLE;
+	parser->max_depth = JSON_DEPTH_LIMIT;
+	parser->max_string = (size_t)-1;
+	parser->max_members = (size_t)-1;
+	parser->max_elements = (size_t)-1;
+	parser->nodes_left = (size_t)-1;
+	parser->memory_left = (size_t)-1;
+}
+
+static int __parser_set_options(const json_parse_options_t *options,
+								json_parser_t *parser)
+{
+	if (options->duplicates < JSON_DUPLICATE_KEEP_ALL ||
+		options->duplicates > JSON_DUPLICATE_REJECT ||
+		(options->relaxed & ~JSON_RELAXED_ALL) ||
+		options->numbers < JSON_NUMBERS_DOUBLE ||
+		options->numbers > JSON_NUMBERS_LAZY || options->max_depth < 0)
+		return -1;
+
+	__parser_init(options->allocator, NULL, parser);
+	parser->duplicates = options->duplicates;
+	parser->relaxed = options->relaxed;
+	parser->numbers = options->numbers;
+	if (options->max_depth != 0 && options->max_depth < JSON_DEPTH_LIMIT)
+		parser->max_depth = options->max_depth;
+
+	if (options->max_string != 0)
+		parser->max_string = options->max_string;
+
+	if (options->max_members != 0)
+		parser->max_members = options->max_members;
+
+	if (options->max_elements != 0)
+		parser->max_elements = options->max_elements;
+
+	if (options->max_nodes != 0)
+		parser->nodes_left = options->max_nodes;
+
+	if (options->max_memory != 0)
+		parser->memory_left = options->max_memory;
+
+	return 0;
+}
+
+json_value_t *json_value_parse_options(const char *cursor,
+									   const json_parse_options_t *options)
+{
+	const json_allocator_t *allocator = options->allocator;
+	json_parser_t parser;
+	json_value_t *val;
+
+	if (__parser_set_options(options, &parser) < 0)
+		return NULL;
+
+	/* The root value is a node too. */
+	if (__parser_charge(sizeof (json_value_t), &parser) < 0)
+		return NULL;
+
+	val = __json_value_alloc(allocator);
+	if (!val)
+		return NULL;
+
+	if (__parse_json_document(cursor, &parser, val) >= 0)
+		return val;
+
+	__json_value_free(val, allocator);
+	return NULL;
+}
+
+json_value_t *json_value_parse_alloc(const char *cursor,
+									 const json_allocator_t *allocator)
+{
+	json_parse_options_t options = { NULL };
+
+	options.allocator = allocator;
+	return json_value_parse_options(cursor, &options);
+}
+
+json_value_t *json_value_parse(const char *cursor)
+{
+	return json_value_parse_alloc(cursor, NULL);
+}
+
+/* Move the nodes of @val into the recycler in document order, so that a
+   document of the same shape takes them back one by one while parsing.
+   Containers are left as null values. */
+static void __recycle_json_value(json_value_t *val,
+								 struct __json_recycler *recycler)
+{
+	struct list_head *pos, *tmp;
+	json_member_t *memb;
+	json_element_t *elem;
+	size_t len;
+
+	if (val->allocator != recycler->allocator)
+	{
+		__destroy_json_value(val);
+		val->type = JSON_VALUE_NULL;
+		return;
+	}
+
+	if (val->flags & JSON_FLAG_BLOCK)
+		__json_block_release(val);
+
+	switch (val->type)
+	{
+	case JSON_VALUE_OBJECT:
+		list_for_each_safe(pos, tmp, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			len = strlen(memb->name);
+			if (len < JSON_RECYCLE_NAME_MAX)
+			{
+				list_add_tail(&memb->list, &recycler->members[len]);
+				__recycle_json_value(&memb->value, recycler);
+			}
+			else
+			{
+				__destroy_json_value(&memb->value);
+				__json_member_free(memb, val->allocator);
+			}
+		}
+
+		val->type = JSON_VALUE_NULL;
+		break;
+
+	case JSON_VALUE_ARRAY:
+		list_for_each_safe(pos, tmp, &val->value.array.head)
+		{
+			elem = list_entry(pos, json_element_t, list);
+			list_add_tail(&elem->list, &recycler->elements);
+			__recycle_json_value(&elem->value, recycler);
+		}
+
+		val->type = JSON_VALUE_NULL;
+		break;
+	}
+}
+
+static void __recycler_drain(struct __json_recycler *recycler)
+{
+	struct list_head *pos, *tmp;
+	json_member_t *memb;
+	json_element_t *elem;
+	int i;
+
+	list_for_each_safe(pos, tmp, &recycler->elements)
+	{
+		elem = list_entry(pos, json_element_t, list);
+		__destroy_json_value(&elem->value);
+		__json_element_free(elem, recycler->allocator);
+	}
+
+	for (i = 0; i < JSON_RECYCLE_NAME_MAX; i++)
+	{
+		list_for_each_safe(pos, tmp, &recycler->members[i])
+		{
+			memb = list_entry(pos, json_member_t, list);
+			__destroy_json_value(&memb->value);
+			__json_member_free(memb, recycler->allocator);
+		}
+	}
+
+	if (recycler->string)
+		__json_free(recycler->string, recycler->allocator);
+}
+
+json_value_t *json_value_parse_into(json_value_t *val, const char *cursor)
+{
+	struct __json_recycler recycler;
+	json_parser_t parser;
+	int ret;
+	int i;
+
+	if (val->flags & JSON_FLAG_FROZEN)
+		return NULL;
+
+	INIT_LIST_HEAD(&recycler.elements);
+	for (i = 0; i < JSON_RECYCLE_NAME_MAX; i++)
+		INIT_LIST_HEAD(&recycler.members[i]);
+
+	recycler.allocator = val->allocator;
+	recycler.string = NULL;
+	__recycle_json_value(val, &recycler);
+	__recycler_take_string(&recycler, val);
+
+	__parser_init(val->allocator, &recycler, &parser);
+	ret = __parse_json_document(cursor, &parser, val);
+	if (ret < 0)
+	{
+		val->allocator = recycler.allocator;
+		val->type = JSON_VALUE_NULL;
+	}
+
+	__recycler_drain(&recycler);
+	return ret >= 0 ? val : NULL;
+}
+
+struct __json_binding
+{
+	const json_field_t *field;
+	json_schema_t *schema;
+	const json_allocator_t *allocator;
+	unsigned int hash;
+	size_t len;
+};
+
+struct __json_schema
+{
+	const json_allocator_t *allocator;
+	size_t mask;
+	size_t max_len;
+	struct __json_binding table[1];
+};
+
+static const struct __json_binding *
+__json_schema_find(const json_schema_t *schema, const char *name, size_t len)
+{
+	const struct __json_binding *bind;
+	unsigned int hash;
+	size_t i;
+
+	if (len > schema->max_len)
+		return NULL;
+
+	hash = __json_name_hash(name, len);
+	i = hash & schema->mask;
+	while (bind = &schema->table[i], bind->field)
+	{
+		if (bind->hash == hash && bind->len == len &&
+			memcmp(bind->field->name, name, len) == 0)
+			return bind;
+
+		i = (i + 1) & schema->mask;
+	}
+
+	return NULL;
+}
+
+static size_t __json_field_size(const json_field_t *field)
+{
+	switch (field->type)
+	{
+	case JSON_FIELD_BOOL:
+	case JSON_FIELD_INT:
+		return sizeof (int);
+	case JSON_FIELD_INT64:
+		return sizeof (long long);
+	case JSON_FIELD_DOUBLE:
+		return sizeof (double);
+	case JSON_FIELD_STRING:
+		return sizeof (char *);
+	default:
+		return field->size;
+	}
+}
+
+static int __json_bind_field(const json_field_t *field,
+							 const json_allocator_t *allocator,
+							 struct __json_binding *bind)
+{
+	struct __json_binding elem;
+
+	bind->field = field;
+	bind->schema = NULL;
+	bind->allocator = allocator;
+	switch (field->type)
+	{
+	case JSON_FIELD_BOOL:
+	case JSON_FIELD_INT:
+	case JSON_FIELD_INT64:
+	case JSON_FIELD_DOUBLE:
+	case JSON_FIELD_STRING:
+		return 0;
+
+	case JSON_FIELD_CHARS:
+		return field->size != 0 ? 0 : -1;
+
+	case JSON_FIELD_OBJECT:
+		bind->schema = json_schema_create_alloc(field->fields, field->nfields,
+												allocator);
+		return bind->schema ? 0 : -1;
+
+	case JSON_FIELD_ARRAY:
+		if (!field->fields || field->fields->type == JSON_FIELD_ARRAY ||
+			__json_field_size(field->fields) == 0)
+			return -1;
+
+		if (__json_bind_field(field->fields, allocator, &elem) < 0)
+			return -1;
+
+		bind->schema = elem.schema;
+		return 0;
+
+	default:
+		return -1;
+	}
+}
+
+json_schema_t *json_schema_create_alloc(const json_field_t *fields, size_t n,
+										const json_allocator_t *allocator)
+{
+	struct __json_binding bind;
+	json_schema_t *schema;
+	size_t size = 1;
+	size_t i, j;
+
+	while (size < 2 * n)
+		size *= 2;
+
+	schema = (json_schema_t *)
+		__json_malloc(offsetof(json_schema_t, table) +
+					  size * sizeof (struct __json_binding), allocator);
+	if (!schema)
+		return NULL;
+
+	schema->allocator = allocator;
+	schema->mask = size - 1;
+	schema->max_len = 0;
+	for (j = 0; j < size; j++)
+		schema->table[j].field = NULL;
+
+	for (i = 0; i < n; i++)
+	{
+		bind.len = strlen(fields[i].name);
+		if (__json_schema_find(schema, fields[i].name, bind.len) ||
+			__json_bind_field(&fields[i], allocator, &bind) < 0)
+		{
+			json_schema_destroy(schema);
+			return NULL;
+		}
+
+		bind.hash = __json_name_hash(fields[i].name, bind.len);
+		j = bind.hash & schema->mask;
+		while (schema->table[j].field)
+			j = (j + 1) & schema->mask;
+
+		schema->table[j] = bind;
+		if (bind.len > schema->max_len)
+			schema->max_len = bind.len;
+	}
+
+	return schema;
+}
+
+json_schema_t *json_schema_create(const json_field_t *fields, size_t n)
+{
+	return json_schema_create_alloc(fields, n, NULL);
+}
+
+void json_schema_destroy(json_schema_t *schema)
+{
+	size_t i;
+
+	for (i = 0; i <= schema->mask; i++)
+	{
+		if (schema->table[i].field && schema->table[i].schema)
+			json_schema_destroy(schema->table[i].schema);
+	}
+
+	__json_free(schema, schema->allocator);
+}
+
+static void __json_struct_free(const json_schema_t *schema, char *base);
+
+static void __json_field_free(const struct __json_binding *bind, char *base)
+{
+	const json_field_t *field = bind->field;
+	char *ptr = base + field->offset;
+	struct __json_binding elem;
+	size_t *count;
+	size_t size;
+	size_t i;
+
+	switch (field->type)
+	{
+	case JSON_FIELD_STRING:
+		__json_free(*(char **)ptr, bind->allocator);
+		*(char **)ptr = NULL;
+		break;
+
+	case JSON_FIELD_OBJECT:
+		__json_struct_free(bind->schema, ptr);
+		break;
+
+	case JSON_FIELD_ARRAY:
+		count = (size_t *)(base + field->count_offset);
+		elem.field = field->fields;
+		elem.schema = bind->schema;
+		elem.allocator = bind->allocator;
+		if (elem.field->type == JSON_FIELD_STRING ||
+			elem.field->type == JSON_FIELD_OBJECT)
+		{
+			size = __json_field_size(elem.field);
+			for (i = 0; i < *count; i++)
+				__json_field_free(&elem, ptr + i * size);
+		}
+
+		*count = 0;
+		break;
+	}
+}
+
+static void __json_struct_free(const json_schema_t *schema, char *base)
+{
+	size_t i;
+
+	for (i = 0; i <= schema->mask; i++)
+	{
+		if (schema->table[i].field)
+			__json_field_free(&schema->table[i], base);
+	}
+}
+
+static int __skip_json_string(const char *cursor, const char **end)
+{
+	char utf8[4];
+	int ret;
+
+	while (1)
+	{
+		while (__character_map[(unsigned char)*cursor] == 0)
+			cursor++;
+
+		if (*cursor == '\"')
+			break;
+
+		if (*cursor != '\\')
+			return -2;
+
+		cursor++;
+		switch (*cursor)
+		{
+		case '\"':
+		case '\\':
+		case '/':
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+			cursor++;
+			break;
+
+		case 'u':
+			cursor++;
+			ret = __parse_json_unicode(cursor, &cursor, utf8);
+			if (ret < 0)
+				return ret;
+
+			break;
+
+		default:
+			return -2;
+		}
+	}
+
+	*end = cursor + 1;
+	return 0;
+}
+
+static int __skip_json_value(const char *cursor, const char **end, int depth);
+
+static int __skip_json_container(const char *cursor, const char **end,
+								 int depth)
+{
+	char close = *cursor == '{' ? '}' : ']';
+	int ret;
+
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	cursor++;
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor == close)
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	while (1)
+	{
+		if (close == '}')
+		{
+			if (*cursor != '\"')
+				return -2;
+
+			ret = __skip_json_string(cursor + 1, &cursor);
+			if (ret < 0)
+				return ret;
+
+			while (isspace(*cursor))
+				cursor++;
+
+			if (*cursor != ':')
+				return -2;
+
+			cursor++;
+			while (isspace(*cursor))
+				cursor++;
+		}
+
+		ret = __skip_json_value(cursor, &cursor, depth + 1);
+		if (ret < 0)
+			return ret;
+
+		while (isspace(*cursor))
+			cursor++;
+
+		if (*cursor == ',')
+		{
+			cursor++;
+			while (isspace(*cursor))
+				cursor++;
+		}
+		else if (*cursor == close)
+			break;
+		else
+			return -2;
+	}
+
+	*end = cursor + 1;
+	return 0;
+}
+
+static int __skip_json_value(const char *cursor, const char **end, int depth)
+{
+	double number;
+
+	switch (*cursor)
+	{
+	case '\"':
+		return __skip_json_string(cursor + 1, end);
+
+	case '-':
+	case '0':
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':
+		return __parse_json_number(cursor, end, &number);
+
+	case '{':
+	case '[':
+		return __skip_json_container(cursor, end, depth);
+
+	case 't':
+		if (strncmp(cursor, "true", 4) != 0)
+			return -2;
+
+		*end = cursor + 4;
+		return 0;
+
+	case 'f':
+		if (strncmp(cursor, "false", 5) != 0)
+			return -2;
+
+		*end = cursor + 5;
+		return 0;
+
+	case 'n':
+		if (strncmp(cursor, "null", 4) != 0)
+			return -2;
+
+		*end = cursor + 4;
+		return 0;
+
+	default:
+		return -2;
+	}
+}
+
+/* Integers are read exactly up to 64 bits. Numbers with a fraction or an
+   exponent are accepted as long as their value is integral. */
+static int __bind_json_integer(const char *cursor, const char **end,
+							   long long min, long long max, long long *num)
+{
+	const char *p = cursor;
+	unsigned long long n = 0;
+	double number;
+	int ret;
+
+	if (*p == '-')
+		p++;
+
+	if (*p == '0')
+		p++;
+	else if (isdigit(*p))
+	{
+		do
+		{
+			if (n > 922337203685477580ULL)
+				return -2;
+
+			n = n * 10 + (*p - '0');
+			p++;
+		} while (isdigit(*p));
+	}
+	else
+		return -2;
+
+	if (*p != '.' && *p != 'e' && *p != 'E')
+	{
+		if (*cursor == '-')
+		{
+			if (n > (unsigned long long)-(min + 1) + 1)
+				return -2;
+
+			*num = n == 0 ? 0 : -(long long)(n - 1) - 1;
+		}
+		else
+		{
+			if (n > (unsigned long long)max)
+				return -2;
+
+			*num = (long long)n;
+		}
+
+		*end = p;
+		return 0;
+	}
+
+	ret = __parse_json_number(cursor, end, &number);
+	if (ret < 0)
+		return ret;
+
+	if (!(number >= (double)min && number < (double)max + 1.0) ||
+		(double)(long long)number != number)
+		return -2;
+
+	*num = (long long)number;
+	return 0;
+}
+
+static int __bind_json_string(const char *cursor, const char **end,
+							  const struct __json_binding *bind, char *ptr)
+{
+	const json_field_t *field = bind->field;
+	size_t escape;
+	size_t len;
+	char *str;
+	int ret;
+
+	ret = __json_string_length(cursor, &escape, &len);
+	if (ret < 0)
+		return ret;
+
+	if (field->type == JSON_FIELD_CHARS && len < field->size)
+		str = ptr;
+	else if (field->type == JSON_FIELD_CHARS && escape == 0)
+		return -2;
+	else
+	{
+		str = (char *)__json_malloc(len + 1, bind->allocator);
+		if (!str)
+			return -1;
+	}
+
+	if (escape != 0)
+	{
+		ret = __parse_json_string(cursor, end, escape, str);
+		if (ret < 0)
+		{
+			if (str != ptr)
+				__json_free(str, bind->allocator);
+
+			return ret;
+		}
+	}
+	else
+	{
+		memcpy(str, cursor, len);
+		str[len] = '\0';
+		*end = cursor + len + 1;
+	}
+
+	if (field->type == JSON_FIELD_STRING)
+	{
+		__json_free(*(char **)ptr, bind->allocator);
+		*(char **)ptr = str;
+	}
+	else if (str != ptr)
+	{
+		/* A string with \u escapes is shorter than its upper bound. */
+		len = strlen(str);
+		if (len < field->size)
+			memcpy(ptr, str, len + 1);
+
+		__json_free(str, bind->allocator);
+		if (len >= field->size)
+			return -2;
+	}
+
+	return 0;
+}
+
+static int __bind_json_members(const char *cursor, const char **end,
+							   int depth, const json_schema_t *schema,
+							   char *base);
+
+static int __bind_json_object(const char *cursor, const char **end,
+							  int depth, const json_schema_t *schema,
+							  char *base)
+{
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	return __bind_json_members(cursor, end, depth + 1, schema, base);
+}
+
+static int __bind_json_value(const char *cursor, const char **end,
+							 int depth, const struct __json_binding *bind,
+							 char *base);
+
+static int __bind_json_array(const char *cursor, const char **end,
+							 int depth, const struct __json_binding *bind,
+							 char *base)
+{
+	const json_field_t *field = bind->field;
+	size_t *count = (size_t *)(base + field->count_offset);
+	char *ptr = base + field->offset;
+	struct __json_binding elem;
+	size_t size;
+	size_t max;
+	int ret;
+
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	__json_field_free(bind, base);
+	elem.field = field->fields;
+	elem.schema = bind->schema;
+	elem.allocator = bind->allocator;
+	size = __json_field_size(elem.field);
+	max = field->size / size;
+
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor == ']')
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	while (1)
+	{
+		if (*count == max)
+			return -2;
+
+		memset(ptr, 0, size);
+		(*count)++;
+		ret = __bind_json_value(cursor, &cursor, depth + 1, &elem, ptr);
+		if (ret < 0)
+			return ret;
+
+		ptr += size;
+		while (isspace(*cursor))
+			cursor++;
+
+		if (*cursor == ',')
+		{
+			cursor++;
+			while (isspace(*cursor))
+				cursor++;
+		}
+		else if (*cursor == ']')
+			break;
+		else
+			return -2;
+	}
+
+	*end = cursor + 1;
+	return 0;
+}
+
+static int __bind_json_value(const char *cursor, const char **end,
+							 int depth, const struct __json_binding *bind,
+							 char *base)
+{
+	const json_field_t *field = bind->field;
+	char *ptr = base + field->offset;
+	long long num;
+	int ret;
+
+	if (*cursor == 'n')
+	{
+		if (strncmp(cursor, "null", 4) != 0)
+			return -2;
+
+		__json_field_free(bind, base);
+		*end = cursor + 4;
+		return 0;
+	}
+
+	switch (field->type)
+	{
+	case JSON_FIELD_BOOL:
+		if (strncmp(cursor, "true", 4) == 0)
+		{
+			*(int *)ptr = 1;
+			*end = cursor + 4;
+		}
+		else if (strncmp(cursor, "false", 5) == 0)
+		{
+			*(int *)ptr = 0;
+			*end = cursor + 5;
+		}
+		else
+			return -2;
+
+		return 0;
+
+	case JSON_FIELD_INT:
+		ret = __bind_json_integer(cursor, end, INT_MIN, INT_MAX, &num);
+		if (ret < 0)
+			return ret;
+
+		*(int *)ptr = (int)num;
+		return 0;
+
+	case JSON_FIELD_INT64:
+		return __bind_json_integer(cursor, end, LLONG_MIN, LLONG_MAX,
+								   (long long *)ptr);
+
+	case JSON_FIELD_DOUBLE:
+		if (*cursor != '-' && !isdigit(*cursor))
+			return -2;
+
+		return __parse_json_number(cursor, end, (double *)ptr);
+
+	case JSON_FIELD_CHARS:
+	case JSON_FIELD_STRING:
+		if (*cursor != '\"')
+			return -2;
+
+		return __bind_json_string(cursor + 1, end, bind, ptr);
+
+	case JSON_FIELD_OBJECT:
+		if (*cursor != '{')
+			return -2;
+
+		return __bind_json_object(cursor + 1, end, depth, bind->schema, ptr);
+
+	case JSON_FIELD_ARRAY:
+		if (*cursor != '[')
+			return -2;
+
+		return __bind_json_array(cursor + 1, end, depth, bind, base);
+
+	default:
+		return -2;
+	}
+}
+
+static int __find_escaped_name(const char *cursor, const char **end,
+							   size_t escape, size_t len,
+							   const json_schema_t *schema,
+							   const struct __json_binding **bind)
+{
+	char buf[128];
+	char *name = buf;
+	int ret;
+
+	*bind = NULL;
+	if (len >= sizeof buf)
+	{
+		name = (char *)__json_malloc(len + 1, schema->allocator);
+		if (!name)
+			return -1;
+	}
+
+	ret = __parse_json_string(cursor, end, escape, name);
+	if (ret >= 0)
+		*bind = __json_schema_find(schema, name, strlen(name));
+
+	if (name != buf)
+		__json_free(name, schema->allocator);
+
+	return ret;
+}
+
+static int __bind_json_members(const char *cursor, const char **end,
+							   int depth, const json_schema_t *schema,
+							   char *base)
+{
+	const struct __json_binding *bind;
+	size_t escape;
+	size_t len;
+	int ret;
+
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor == '}')
+	{
+		*end = cursor + 1;
+		return 0;
+	}
+
+	while (1)
+	{
+		if (*cursor != '\"')
+			return -2;
+
+		cursor++;
+		ret = __json_string_length(cursor, &escape, &len);
+		if (ret < 0)
+			return ret;
+
+		if (escape == 0)
+		{
+			bind = __json_schema_find(schema, cursor, len);
+			cursor += len + 1;
+		}
+		else
+		{
+			ret = __find_escaped_name(cursor, &cursor, escape, len, schema,
+									  &bind);
+			if (ret < 0)
+				return ret;
+		}
+
+		while (isspace(*cursor))
+			cursor++;
+
+		if (*cursor != ':')
+			return -2;
+
+		cursor++;
+		while (isspace(*cursor))
+			cursor++;
+
+		if (bind)
+			ret = __bind_json_value(cursor, &cursor, depth, bind, base);
+		else
+			ret = __skip_json_value(cursor, &cursor, depth);
+
+		if (ret < 0)
+			return ret;
+
+		while (isspace(*cursor))
+			cursor++;
+
+		if (*cursor == ',')
+		{
+			cursor++;
+			while (isspace(*cursor))
+				cursor++;
+		}
+		else if (*cursor == '}')
+			break;
+		else
+			return -2;
+	}
+
+	*end = cursor + 1;
+	return 0;
+}
+
+int json_struct_parse(const char *cursor, const json_schema_t *schema,
+					  void *st)
+{
+	int ret;
+
+	while (isspace(*cursor))
+		cursor++;
+
+	if (*cursor != '{')
+		return -2;
+
+	ret = __bind_json_object(cursor + 1, &cursor, 0, schema, (char *)st);
+	if (ret < 0)
+		return ret;
+
+	while (isspace(*cursor))
+		cursor++;
+
+	return *cursor == '\0' ? 0 : -2;
+}
+
+void json_struct_free(const json_schema_t *schema, void *st)
+{
+	__json_struct_free(schema, (char *)st);
+}
+
+static void __move_json_value(json_value_t *src, json_value_t *dest)
+{
+	switch (src->type)
+	{
+	case JSON_VALUE_STRING:
+		dest->value.string = src->value.string;
+		break;
+
+	case JSON_VALUE_NUMBER:
+		dest->value = src->value;
+		break;
+
+	case JSON_VALUE_OBJECT:
+		INIT_LIST_HEAD(&dest->value.object.head);
+		list_splice(&src->value.object.head, &dest->value.object.head);
+		dest->value.object.size = src->value.object.size;
+#ifdef JSON_PARSER_INDEX
+		dest->value.object.index = src->value.object.index;
+#endif
+		break;
+
+	case JSON_VALUE_ARRAY:
+		INIT_LIST_HEAD(&dest->value.array.head);
+		list_splice(&src->value.array.head, &dest->value.array.head);
+		dest->value.array.size = src->value.array.size;
+		break;
+	}
+
+	dest->allocator = src->allocator;
+	dest->type = src->type;
+	dest->flags = src->flags;
+#ifdef JSON_PARSER_DIGEST
+	dest->digest = src->digest;
+#endif
+	src->flags &= ~JSON_FLAG_BLOCK;
+	if (!(dest->flags & JSON_FLAG_BLOCK) &&
+		(dest->type == JSON_VALUE_OBJECT || dest->type == JSON_VALUE_ARRAY))
+		__json_block_retain(dest);
+}
+
+/* Whether a value of allocator @from has to be copied rather than moved
+   into a document of allocator @to, because either belongs to a batch. */
+static int __json_arena_crossing(const json_allocator_t *from,
+								 const json_allocator_t *to)
+{
+	if (from == to)
+		return 0;
+
+	return (from && from->alloc == __json_arena_alloc) ||
+		   (to && to->alloc == __json_arena_alloc);
+}
+
+static int __set_json_value(int type, va_list ap,
+							const json_allocator_t *allocator,
+							json_value_t *val)
+{
+	json_value_t *src;
+	const char *str;
+	size_t len;
+
+	switch (type)
+	{
+	case 0:
+		src = va_arg(ap, json_value_t *);
+		if (src->refs != 1)
+			return -1;
+
+		/* A batch is freed without walking its documents, so values
+		   moved into or out of them have to be copied. */
+		if (__json_arena_crossing(src->allocator, allocator))
+		{
+			if (__clone_json_value(src, allocator, val) < 0)
+				return -1;
+
+			json_value_destroy(src);
+			return 0;
+		}
+
+		__move_json_value(src, val);
+		__json_value_free(src, src->allocator);
+		return 0;
+
+	case JSON_VALUE_STRING:
+		str = va_arg(ap, const char *);
+		len = strlen(str);
+		val->value.string = (char *)__json_malloc(len + 1, allocator);
+		if (!val->value.string)
+			return -1;
+
+		memcpy(val->value.string, str, len + 1);
+		break;
+
+	case JSON_VALUE_NUMBER:
+		val->value.number = va_arg(ap, double);
+		break;
+
+	case JSON_VALUE_OBJECT:
+		INIT_LIST_HEAD(&val->value.object.head);
+		val->value.object.size = 0;
+		break;
+
+	case JSON_VALUE_ARRAY:
+		INIT_LIST_HEAD(&val->value.array.head);
+		val->value.array.size = 0;
+		break;
+	}
+
+	val->allocator = allocator;
+	val->type = type;
+	val->flags = 0;
+	return 0;
+}
+
+static json_value_t *__json_value_create(const json_allocator_t *allocator,
+										 int type, va_list ap)
+{
+	json_value_t *val;
+
+	val = __json_value_alloc(allocator);
+	if (!val)
+		return NULL;
+
+	if (__set_json_value(type, ap, allocator, val) >= 0)
+		return val;
+
+	__json_value_free(val, allocator);
+	return NULL;
+}
+
+json_value_t *json_value_create(int type, ...)
+{
+	json_value_t *val;
+	va_list ap;
+
+	va_start(ap, type);
+	val = __json_value_create(NULL, type, ap);
+	va_end(ap);
+	return val;
+}
+
+json_value_t *json_value_create_alloc(const json_allocator_t *allocator,
+									  int type, ...)
+{
+	json_value_t *val;
+	va_list ap;
+
+	va_start(ap, type);
+	val = __json_value_create(allocator, type, ap);
+	va_end(ap);
+	return val;
+}
+
+#define JSON_ALIGN(size)	(((size) + 7) & ~(size_t)7)
+
+#define JSON_ARENA_CHUNK	(64 * 1024)
+
+/* A batch parses documents into an arena: chunks that allocations are cut
+   from in order and never given back one by one. Freeing does nothing,
+   and the batch is released by freeing its chunks. */
+struct __json_arena_chunk
+{
+	struct __json_arena_chunk *next;
+	char *end;
+};
+
+struct __json_batch
+{
+	json_allocator_t allocator;
+	const json_allocator_t *parent;
+	struct __json_arena_chunk *chunks;
+	char *cursor;
+	char *end;
+};
+
+static void *__json_arena_chunk_alloc(size_t size, struct __json_batch *batch)
+{
+	struct __json_arena_chunk *chunk;
+	size_t header = JSON_ALIGN(sizeof (struct __json_arena_chunk));
+
+	chunk = (struct __json_arena_chunk *)__json_malloc(header + size,
+													   batch->parent);
+	if (!chunk)
+		return NULL;
+
+	chunk->next = batch->chunks;
+	chunk->end = (char *)chunk + header + size;
+	batch->chunks = chunk;
+	return (char *)chunk + header;
+}
+
+static void *__json_arena_alloc(size_t size, void *context)
+{
+	struct __json_batch *batch = (struct __json_batch *)context;
+	void *ptr;
+
+	size = JSON_ALIGN(size);
+	if (size > (size_t)(batch->end - batch->cursor))
+	{
+		/* Large requests get a chunk of their own, so that the rest of
+		   the current chunk is not wasted. */
+		if (size > JSON_ARENA_CHUNK / 4)
+			return __json_arena_chunk_alloc(size, batch);
+
+		ptr = __json_arena_chunk_alloc(JSON_ARENA_CHUNK, batch);
+		if (!ptr)
+			return NULL;
+
+		batch->cursor = (char *)ptr;
+		batch->end = batch->chunks->end;
+	}
+
+	ptr = batch->cursor;
+	batch->cursor += size;
+	return ptr;
+}
+
+static void __json_arena_free(void *ptr, void *context)
+{
+}
+
+static void *__json_arena_realloc(void *ptr, size_t size, void *context)
+{
+	struct __json_batch *batch = (struct __json_batch *)context;
+	struct __json_arena_chunk *chunk;
+	size_t n = size;
+	void *p;
+
+	p = __json_arena_alloc(size, batch);
+	if (p && ptr)
+	{
+		for (chunk = batch->chunks; chunk; chunk = chunk->next)
+		{
+			if ((char *)ptr > (char *)chunk && (char *)ptr < chunk->end)
+			{
+				if (n > (size_t)(chunk->end - (char *)ptr))
+					n = chunk->end - (char *)ptr;
+
+				break;
+			}
+		}
+
+		memcpy(p, ptr, n);
+	}
+
+	return p;
+}
+
+/* A copied document lives in one block: the block header, the root value,
+   all the nodes, then all the strings. Values of the copy use the block's
+   allocator, which serves later allocations from the allocator the block
+   came from, and releases the block when everything carved from it or
+   allocated through it has been freed. Values removed from the copy may
+   be destroyed on different threads, so the count is atomic, like refs. */
+struct __json_block
+{
+	json_allocator_t allocator;
+	const json_allocator_t *parent;
+	char *end;
+	int live;
+};
+
+struct __json_block_cursor
+{
+	char *node;
+	char *string;
+};
+
+static int __json_block_contains(const struct __json_block *block,
+								 const void *ptr)
+{
+	return (const char *)ptr >= (const char *)block &&
+		   (const char *)ptr < block->end;
+}
+
+static void *__json_block_alloc(size_t size, void *context)
+{
+	struct __json_block *block = (struct __json_block *)context;
+	void *ptr;
+
+	ptr = __json_malloc(size, block->parent);
+	if (ptr)
+		__json_atomic_inc(&block->live);
+
+	return ptr;
+}
+
+static void __json_block_free(void *ptr, void *context)
+{
+	struct __json_block *block = (struct __json_block *)context;
+
+	if (!__json_block_contains(block, ptr))
+		__json_free(ptr, block->parent);
+
+	if (__json_atomic_dec(&block->live) == 0)
+		__json_free(block, block->parent);
+}
+
+static void *__json_block_realloc(void *ptr, size_t size, void *context)
+{
+	struct __json_block *block = (struct __json_block *)context;
+	const json_allocator_t *parent = block->parent;
+	size_t n;
+	void *p;
+
+	if (!ptr)
+		return __json_block_alloc(size, block);
+
+	if (__json_block_contains(block, ptr))
+	{
+		p = __json_block_alloc(size, block);
+		if (p)
+		{
+			n = block->end - (char *)ptr;
+			memcpy(p, ptr, n < size ? n : size);
+			__json_block_free(ptr, block);
+		}
+
+		return p;
+	}
+
+	if (!parent)
+		return realloc(ptr, size);
+
+	return parent->realloc(ptr, size, parent->context);
+}
+
+/* An object or array moved out of its node may keep allocating from its
+   block after everything else carved from it has been freed, so it holds
+   a reference of its own. */
+static void __json_block_retain(json_value_t *val)
+{
+	const json_allocator_t *allocator = val->allocator;
+
+	if (allocator && allocator->alloc == __json_block_alloc)
+	{
+		__json_atomic_inc(&((struct __json_block *)allocator->context)->live);
+		val->flags |= JSON_FLAG_BLOCK;
+	}
+}
+
+static void __json_block_release(json_value_t *val)
+{
+	void *block = val->allocator->context;
+
+	val->flags &= ~JSON_FLAG_BLOCK;
+	__json_block_free(block, block);
+}
+
+static void __measure_json_value(const json_value_t *val,
+								 size_t *nodes, size_t *strings)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+	json_element_t *elem;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		*strings += strlen(val->value.string) + 1;
+		break;
+
+	case JSON_VALUE_NUMBER:
+		if (val->flags & JSON_FLAG_RAW)
+			*strings += strlen(val->value.raw) + 1;
+
+		break;
+
+	case JSON_VALUE_OBJECT:
+		list_for_each(pos, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			*nodes += JSON_ALIGN(offsetof(json_member_t, name) +
+								 strlen(memb->name) + 1);
+			__measure_json_value(&memb->value, nodes, strings);
+		}
+
+		break;
+
+	case JSON_VALUE_ARRAY:
+		list_for_each(pos, &val->value.array.head)
+		{
+			elem = list_entry(pos, json_element_t, list);
+			*nodes += JSON_ALIGN(sizeof (json_element_t));
+			__measure_json_value(&elem->value, nodes, strings);
+		}
+
+		break;
+	}
+}
+
+static void __copy_json_value(const json_value_t *src,
+							  struct __json_block *block,
+							  struct __json_block_cursor *cursor,
+							  json_value_t *dest)
+{
+	struct list_head *pos;
+	json_member_t *entry;
+	json_member_t *memb;
+	json_element_t *elem;
+	size_t len;
+
+	switch (src->type)
+	{
+	case JSON_VALUE_STRING:
+		len = strlen(src->value.string);
+		dest->value.string = cursor->string;
+		memcpy(cursor->string, src->value.string, len + 1);
+		cursor->string += len + 1;
+		block->live++;
+		break;
+
+	case JSON_VALUE_NUMBER:
+		if (src->flags & JSON_FLAG_RAW)
+		{
+			len = strlen(src->value.raw);
+			dest->value.raw = cursor->string;
+			memcpy(cursor->string, src->value.raw, len + 1);
+			cursor->string += len + 1;
+			block->live++;
+		}
+		else
+			dest->value = src->value;
+
+		break;
+
+	case JSON_VALUE_OBJECT:
+		INIT_LIST_HEAD(&dest->value.object.head);
+		list_for_each(pos, &src->value.object.head)
+		{
+			entry = list_entry(pos, json_member_t, list);
+			len = strlen(entry->name);
+			memb = (json_member_t *)cursor->node;
+			cursor->node += JSON_ALIGN(offsetof(json_member_t, name) + len + 1);
+			block->live++;
+			memcpy(memb->name, entry->name, len + 1);
+			__copy_json_value(&entry->value, block, cursor, &memb->value);
+			list_add_tail(&memb->list, &dest->value.object.head);
+		}
+
+		dest->value.object.size = src->value.object.size;
+		break;
+
+	case JSON_VALUE_ARRAY:
+		INIT_LIST_HEAD(&dest->value.array.head);
+		list_for_each(pos, &src->value.array.head)
+		{
+			elem = (json_element_t *)cursor->node;
+			cursor->node += JSON_ALIGN(sizeof (json_element_t));
+			block->live++;
+			__copy_json_value(&list_entry(pos, json_element_t, list)->value,
+							  block, cursor, &elem->value);
+			list_add_tail(&elem->list, &dest->value.array.head);
+		}
+
+		dest->value.array.size = src->value.array.size;
+		break;
+	}
+
+	dest->allocator = &block->allocator;
+	dest->type = src->type;
+	dest->flags = src->flags & (JSON_FLAG_SORTED | JSON_FLAG_RAW |
+								JSON_FLAG_LAZY);
+}
+
+/* The allocator a block or an arena allocator was made from. */
+static const json_allocator_t *
+__json_user_allocator(const json_allocator_t *allocator)
+{
+	if (allocator && allocator->alloc == __json_block_alloc)
+		return ((struct __json_block *)allocator->context)->parent;
+
+	if (allocator && allocator->alloc == __json_arena_alloc)
+		return ((struct __json_batch *)allocator->context)->parent;
+
+	return allocator;
+}
+
+static struct __json_block *
+__json_block_create(size_t nodes, size_t strings,
+					const json_allocator_t *allocator,
+					struct __json_block_cursor *cursor)
+{
+	struct __json_block *block;
+	size_t size;
+
+	allocator = __json_user_allocator(allocator);
+	size = JSON_ALIGN(sizeof (struct __json_block)) +
+		   JSON_ALIGN(sizeof (json_value_t)) + nodes + strings;
+	block = (struct __json_block *)__json_malloc(size, allocator);
+	if (!block)
+		return NULL;
+
+	block->allocator.alloc = __json_block_alloc;
+	block->allocator.realloc = __json_block_realloc;
+	block->allocator.free = __json_block_free;
+	block->allocator.context = block;
+	block->parent = allocator;
+	block->end = (char *)block + size;
+	block->live = 1;
+
+	cursor->node = (char *)block + JSON_ALIGN(sizeof (struct __json_block)) +
+				   JSON_ALIGN(sizeof (json_value_t));
+	cursor->string = cursor->node + nodes;
+	return block;
+}
+
+static json_value_t *__json_block_root(struct __json_block *block)
+{
+	return (json_value_t *)((char *)block +
+							JSON_ALIGN(sizeof (struct __json_block)));
+}
+
+json_value_t *json_value_copy_alloc(const json_value_t *val,
+									const json_allocator_t *allocator)
+{
+	struct __json_block_cursor cursor;
+	struct __json_block *block;
+	json_value_t *copy;
+	size_t nodes = 0;
+	size_t strings = 0;
+
+	__measure_json_value(val, &nodes, &strings);
+	block = __json_block_create(nodes, strings, allocator, &cursor);
+	if (!block)
+		return NULL;
+
+	copy = __json_block_root(block);
+	__copy_json_value(val, block, &cursor, copy);
+	copy->refs = 1;
+	return copy;
+}
+
+json_value_t *json_value_copy(const json_value_t *val)
+{
+	return json_value_copy_alloc(val, val->allocator);
+}
+
+/* Each text is copied to a scratch buffer to be terminated, which costs
+   little next to parsing a document. */
+json_batch_t *json_batch_parse(const json_text_t *texts, size_t n,
+							   const json_parse_options_t *options,
+							   json_value_t *vals[])
+{
+	json_parse_options_t opts = { NULL };
+	struct __json_batch *batch;
+	json_parser_t parser;
+	size_t capacity = 0;
+	char *buf = NULL;
+	size_t i;
+
+	if (options)
+		opts = *options;
+
+	if (__parser_set_options(&opts, &parser) < 0)
+		return NULL;
+
+	batch = (struct __json_batch *)__json_malloc(sizeof (struct __json_batch),
+												 opts.allocator);
+	if (!batch)
+		return NULL;
+
+	batch->allocator.alloc = __json_arena_alloc;
+	batch->allocator.realloc = __json_arena_realloc;
+	batch->allocator.free = __json_arena_free;
+	batch->allocator.context = batch;
+	batch->parent = opts.allocator;
+	batch->chunks = NULL;
+	batch->cursor = NULL;
+	batch->end = NULL;
+
+	for (i = 0; i < n; i++)
+	{
+		if (texts[i].size >= capacity)
+		{
+			if (buf)
+				__json_free(buf, batch->parent);
+
+			capacity = texts[i].size + 1 > 1024 ? texts[i].size + 1 : 1024;
+			buf = (char *)__json_malloc(capacity, batch->parent);
+			if (!buf)
+			{
+				json_batch_destroy(batch);
+				return NULL;
+			}
+		}
+
+		memcpy(buf, texts[i].text, texts[i].size);
+		buf[texts[i].size] = '\0';
+		opts.allocator = &batch->allocator;
+		vals[i] = json_value_parse_options(buf, &opts);
+	}
+
+	if (buf)
+		__json_free(buf, batch->parent);
+
+	return batch;
+}
+
+/* Copy a patch into or out of a batch's arena, when either the patch or
+   the document it will be applied to belongs to a batch, for the same
+   reason as values moved across. Returns the patch to apply. If copying
+   fails, @patch is destroyed all the same and NULL is returned. */
+static json_value_t *__json_batch_adopt(json_value_t *patch,
+										const json_allocator_t *allocator)
+{
+	json_value_t *copy;
+
+	if (!__json_arena_crossing(patch->allocator, allocator))
+		return patch;
+
+	copy = __json_value_alloc(allocator);
+	if (copy && __clone_json_value(patch, allocator, copy) < 0)
+	{
+		__json_value_free(copy, allocator);
+		copy = NULL;
+	}
+
+	json_value_destroy(patch);
+	return copy;
+}
+
+void json_batch_destroy(json_batch_t *batch)
+{
+	struct __json_arena_chunk *chunk;
+
+	while (batch->chunks)
+	{
+		chunk = batch->chunks;
+		batch->chunks = chunk->next;
+		__json_free(chunk, batch->parent);
+	}
+
+	__json_free(batch, batch->parent);
+}
+
+#ifdef JSON_PARSER_ASYNC
+#ifdef __linux__
+# define JSON_SERVICE_AFFINITY
+# define JSON_MAX_NODES		64
+#endif
+
+struct __json_request
+{
+	const char *text;
+	void (*callback)(json_value_t *val, void *context);
+	void *context;
+};
+
+struct __json_queue
+{
+	pthread_cond_t get_cond;
+	pthread_cond_t put_cond;
+	json_parse_options_t options;
+	struct __json_request *requests;
+	size_t head;
+	size_t count;
+};
+
+struct __json_worker
+{
+	pthread_t tid;
+	struct __json_service *service;
+	struct __json_queue *queue;
+#ifdef JSON_SERVICE_AFFINITY
+	int pinned;
+	cpu_set_t cpus;
+#endif
+};
+
+struct __json_service
+{
+	pthread_mutex_t mutex;
+	int stopping;
+	const json_allocator_t *allocator;
+	size_t queue_size;
+	struct __json_queue *queues;
+	int nqueues;
+#ifdef JSON_SERVICE_AFFINITY
+	short queue_of[CPU_SETSIZE];
+#endif
+	int nworkers;
+	struct __json_worker workers[1];
+};
+
+/* Workers leave only when stopping with their queue empty, so requests
+   submitted before json_service_destroy() are all completed. */
+static void *__json_service_routine(void *arg)
+{
+	struct __json_worker *worker = (struct __json_worker *)arg;
+	struct __json_service *service = worker->service;
+	struct __json_queue *queue = worker->queue;
+	struct __json_request req;
+	json_value_t *val;
+
+#ifdef JSON_SERVICE_AFFINITY
+	/* Failing to pin is not fatal: the worker just runs anywhere. */
+	if (worker->pinned)
+		sched_setaffinity(0, sizeof (cpu_set_t), &worker->cpus);
+#endif
+
+	pthread_mutex_lock(&service->mutex);
+	while (1)
+	{
+		while (queue->count == 0 && !service->stopping)
+			pthread_cond_wait(&queue->get_cond, &service->mutex);
+
+		if (queue->count == 0)
+			break;
+
+		req = queue->requests[queue->head];
+		queue->head = (queue->head + 1) % service->queue_size;
+		queue->count--;
+		pthread_cond_signal(&queue->put_cond);
+		pthread_mutex_unlock(&service->mutex);
+
+		val = json_value_parse_options(req.text, &queue->options);
+		req.callback(val, req.context);
+		pthread_mutex_lock(&service->mutex);
+	}
+
+	pthread_mutex_unlock(&service->mutex);
+	return NULL;
+}
+
+#ifdef JSON_SERVICE_AFFINITY
+/* Read the CPUs of each NUMA node from sysfs, and the node numbers into
+   @ids. Node numbers may have gaps, and nodes without CPUs are skipped.
+   Returns the number of nodes found, 0 if the topology is not available. */
+static int __json_numa_nodes(cpu_set_t nodes[], int ids[], int max)
+{
+	char path[64];
+	int first, last;
+	int n = 0;
+	FILE *fp;
+	int i, c;
+
+	for (i = 0; i < JSON_MAX_NODES && n < max; i++)
+	{
+		sprintf(path, "/sys/devices/system/node/node%d/cpulist", i);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+
+		CPU_ZERO(&nodes[n]);
+		while (fscanf(fp, "%d", &first) == 1)
+		{
+			last = first;
+			c = fgetc(fp);
+			if (c == '-')
+			{
+				if (fscanf(fp, "%d", &last) != 1)
+					break;
+
+				c = fgetc(fp);
+			}
+
+			for (; first <= last && first < CPU_SETSIZE; first++)
+				CPU_SET(first, &nodes[n]);
+
+			if (c != ',')
+				break;
+		}
+
+		fclose(fp);
+		if (CPU_COUNT(&nodes[n]) > 0)
+			ids[n++] = i;
+	}
+
+	return n;
+}
+
+static int __json_nth_cpu(int k, const cpu_set_t *set)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if (CPU_ISSET(cpu, set) && k-- == 0)
+			break;
+	}
+
+	return cpu;
+}
+
+/* Worker i goes to node i % nqueues, so workers are spread evenly, and
+   nodes left without workers send their requests to the others. The node
+   number of each queue's workers is stored in @queue_node. */
+static void __json_service_place(int affinity, int nworkers,
+								 int queue_node[],
+								 struct __json_service *service)
+{
+	cpu_set_t nodes[JSON_MAX_NODES];
+	int ids[JSON_MAX_NODES];
+	struct __json_worker *worker;
+	int nnodes;
+	int i, j, k;
+
+	memset(service->queue_of, 0, sizeof service->queue_of);
+	nnodes = 0;
+	if (affinity != JSON_AFFINITY_NONE)
+		nnodes = __json_numa_nodes(nodes, ids, JSON_MAX_NODES);
+
+	if (nnodes == 0)
+	{
+		for (i = 0; i < nworkers; i++)
+			service->workers[i].pinned = 0;
+
+		return;
+	}
+
+	service->nqueues = nworkers < nnodes ? nworkers : nnodes;
+	for (j = 0; j < service->nqueues; j++)
+		queue_node[j] = ids[j];
+
+	for (j = 0; j < nnodes; j++)
+	{
+		for (k = 0; k < CPU_SETSIZE; k++)
+		{
+			if (CPU_ISSET(k, &nodes[j]))
+				service->queue_of[k] = j % service->nqueues;
+		}
+	}
+
+	for (i = 0; i < nworkers; i++)
+	{
+		worker = &service->workers[i];
+		j = i % service->nqueues;
+		worker->pinned = 1;
+		if (affinity == JSON_AFFINITY_NODE)
+			worker->cpus = nodes[j];
+		else
+		{
+			k = i / service->nqueues % CPU_COUNT(&nodes[j]);
+			CPU_ZERO(&worker->cpus);
+			CPU_SET(__json_nth_cpu(k, &nodes[j]), &worker->cpus);
+		}
+	}
+}
+#endif
+
+static struct __json_queue *__json_service_queue(struct __json_service *service)
+{
+#ifdef JSON_SERVICE_AFFINITY
+	int cpu;
+
+	if (service->nqueues > 1)
+	{
+		cpu = sched_getcpu();
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+			return &service->queues[service->queue_of[cpu]];
+	}
+#endif
+
+	return &service->queues[0];
+}
+
+static int __json_service_put(const char *text,
+							  void (*callback)(json_value_t *, void *),
+							  void *context, int wait,
+							  struct __json_service *service)
+{
+	struct __json_queue *queue = __json_service_queue(service);
+	struct __json_request *req;
+	int ret = -1;
+
+	pthread_mutex_lock(&service->mutex);
+	while (wait && queue->count == service->queue_size &&
+		   !service->stopping)
+		pthread_cond_wait(&queue->put_cond, &service->mutex);
+
+	if (queue->count < service->queue_size && !service->stopping)
+	{
+		req = &queue->requests[(queue->head + queue->count) %
+							   service->queue_size];
+		req->text = text;
+		req->callback = callback;
+		req->context = context;
+		queue->count++;
+		pthread_cond_signal(&queue->get_cond);
+		ret = 0;
+	}
+
+	pthread_mutex_unlock(&service->mutex);
+	return ret;
+}
+
+json_service_t *json_service_create(const json_service_options_t *options)
+{
+	json_service_options_t opts = { 0 };
+	json_parse_options_t parse = { NULL };
+	struct __json_service *service;
+	struct __json_queue *queue;
+	json_parser_t parser;
+#ifdef JSON_SERVICE_AFFINITY
+	int queue_node[JSON_MAX_NODES];
+	int j;
+#endif
+	long n;
+	int i;
+
+	if (options)
+		opts = *options;
+
+	if (opts.options)
+		parse = *opts.options;
+
+	if (opts.workers < 0 || opts.affinity < JSON_AFFINITY_NONE ||
+		opts.affinity > JSON_AFFINITY_CPU || opts.nodes < 0 ||
+		(opts.nodes > 0 && !opts.node_allocators) ||
+		__parser_set_options(&parse, &parser) < 0)
+		return NULL;
+
+	if (opts.workers == 0)
+	{
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		opts.workers = n > 0 && n < 1024 ? (int)n : 1;
+	}
+
+	service = (struct __json_service *)
+		__json_malloc(offsetof(struct __json_service, workers) +
+					  opts.workers * sizeof (struct __json_worker),
+					  parse.allocator);
+	if (!service)
+		return NULL;
+
+	pthread_mutex_init(&service->mutex, NULL);
+	service->stopping = 0;
+	service->allocator = parse.allocator;
+	service->nworkers = 0;
+	service->nqueues = 1;
+#ifdef JSON_SERVICE_AFFINITY
+	queue_node[0] = -1;
+	__json_service_place(opts.affinity, opts.workers, queue_node, service);
+#endif
+	if (opts.queue_size == 0)
+	{
+		opts.queue_size = 4 * (size_t)((opts.workers + service->nqueues - 1) /
+									   service->nqueues);
+	}
+
+	service->queues = (struct __json_queue *)
+		__json_malloc(service->nqueues * sizeof (struct __json_queue),
+					  service->allocator);
+	if (!service->queues)
+	{
+		pthread_mutex_destroy(&service->mutex);
+		__json_free(service, service->allocator);
+		return NULL;
+	}
+
+	for (i = 0; i < service->nqueues; i++)
+	{
+		queue = &service->queues[i];
+		queue->requests = (struct __json_request *)
+			__json_malloc(opts.queue_size * sizeof (struct __json_request),
+						  service->allocator);
+		if (!queue->requests)
+			break;
+
+		pthread_cond_init(&queue->get_cond, NULL);
+		pthread_cond_init(&queue->put_cond, NULL);
+		queue->options = parse;
+#ifdef JSON_SERVICE_AFFINITY
+		/* Documents parsed by the workers of a node come from its
+		   allocator, if the user gave one. */
+		j = queue_node[i];
+		if (j >= 0 && j < opts.nodes && opts.node_allocators[j])
+			queue->options.allocator = opts.node_allocators[j];
+#endif
+		queue->head = 0;
+		queue->count = 0;
+	}
+
+	if (i < service->nqueues)
+	{
+		service->nqueues = i;
+		json_service_destroy(service);
+		return NULL;
+	}
+
+	service->queue_size = opts.queue_size;
+	for (i = 0; i < opts.workers; i++)
+	{
+		service->workers[i].service = service;
+		service->workers[i].queue = &service->queues[i % service->nqueues];
+		if (pthread_create(&service->workers[i].tid, NULL,
+						   __json_service_routine,
+						   &service->workers[i]) != 0)
+			break;
+
+		service->nworkers++;
+	}
+
+	if (i < opts.workers)
+	{
+		json_service_destroy(service);
+		return NULL;
+	}
+
+	return service;
+}
+
+/* Blocks while the queue is full, which is what throttles producers. */
+int json_service_submit(json_service_t *service, const char *text,
+						void (*callback)(json_value_t *val, void *context),
+						void *context)
+{
+	return __json_service_put(text, callback, context, 1, service);
+}
+
+int json_service_try_submit(json_service_t *service, const char *text,
+							void (*callback)(json_value_t *val,
+											 void *context),
+							void *context)
+{
+	return __json_service_put(text, callback, context, 0, service);
+}
+
+void json_service_destroy(json_service_t *service)
+{
+	struct __json_queue *queue;
+	int i;
+
+	pthread_mutex_lock(&service->mutex);
+	service->stopping = 1;
+	for (i = 0; i < service->nqueues; i++)
+	{
+		pthread_cond_broadcast(&service->queues[i].get_cond);
+		pthread_cond_broadcast(&service->queues[i].put_cond);
+	}
+
+	pthread_mutex_unlock(&service->mutex);
+	for (i = 0; i < service->nworkers; i++)
+		pthread_join(service->workers[i].tid, NULL);
+
+	for (i = 0; i < service->nqueues; i++)
+	{
+		queue = &service->queues[i];
+		pthread_cond_destroy(&queue->put_cond);
+		pthread_cond_destroy(&queue->get_cond);
+		__json_free(queue->requests, service->allocator);
+	}
+
+	pthread_mutex_destroy(&service->mutex);
+	__json_free(service->queues, service->allocator);
+	__json_free(service, service->allocator);
+}
+#else
+json_service_t *json_service_create(const json_service_options_t *options)
+{
+	return NULL;
+}
+
+int json_service_submit(json_service_t *service, const char *text,
+						void (*callback)(json_value_t *val, void *context),
+						void *context)
+{
+	return -1;
+}
+
+int json_service_try_submit(json_service_t *service, const char *text,
+							void (*callback)(json_value_t *val,
+											 void *context),
+							void *context)
+{
+	return -1;
+}
+
+void json_service_destroy(json_service_t *service)
+{
+}
+#endif
+
+/* The binary form is a 4-byte magic and the 32-bit length of the root
+   value, followed by the root value. A value is a type byte and:
+     strings      32-bit length, bytes, '\0'
+     numbers      64-bit double, or 32-bit integer with JSON_BINARY_INT
+     objects      32-bit count, offsets of the members from the type byte,
+                  then the members: name as a string without type byte, and
+                  the value
+     arrays       32-bit count, offsets of the elements, then the elements
+   All integers are little-endian. Values are laid out back to back, so
+   a buffer can be validated in one pass and then read in place. */
+#define JSON_BINARY_INT		8
+
+static const unsigned char __binary_magic[4] = { 'J', 'S', 'B', '1' };
+
+static void __json_put32(unsigned char *p, unsigned long n)
+{
+	p[0] = n & 0xff;
+	p[1] = (n >> 8) & 0xff;
+	p[2] = (n >> 16) & 0xff;
+	p[3] = (n >> 24) & 0xff;
+}
+
+static unsigned long __json_get32(const unsigned char *p)
+{
+	return (unsigned long)p[0] | (unsigned long)p[1] << 8 |
+		   (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static int __json_number_is_int32(double number)
+{
+	return number >= -2147483648.0 && number <= 2147483647.0 &&
+		   number == (double)(long)number &&
+		   (number != 0 || !signbit(number));
+}
+
+static size_t __json_encoded_size(const json_value_t *val)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+	size_t size;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		return 6 + strlen(val->value.string);
+
+	case JSON_VALUE_NUMBER:
+		return __json_number_is_int32(__json_number_value(val)) ? 5 : 9;
+
+	case JSON_VALUE_OBJECT:
+		size = 5 + 4 * val->value.object.size;
+		list_for_each(pos, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			size += 5 + strlen(memb->name) + __json_encoded_size(&memb->value);
+		}
+
+		return size;
+
+	case JSON_VALUE_ARRAY:
+		size = 5 + 4 * val->value.array.size;
+		list_for_each(pos, &val->value.array.head)
+		{
+			size += __json_encoded_size(&list_entry(pos, json_element_t,
+													list)->value);
+		}
+
+		return size;
+
+	default:
+		return 1;
+	}
+}
+
+static unsigned char *__json_encode_value(const json_value_t *val,
+										  unsigned char *p)
+{
+	unsigned char *start = p;
+	unsigned long long bits;
+	struct list_head *pos;
+	double number;
+	json_member_t *memb;
+	size_t len;
+	int i;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		len = strlen(val->value.string);
+		*p = JSON_VALUE_STRING;
+		__json_put32(p + 1, len);
+		memcpy(p + 5, val->value.string, len + 1);
+		return p + 6 + len;
+
+	case JSON_VALUE_NUMBER:
+		number = __json_number_value(val);
+		if (__json_number_is_int32(number))
+		{
+			*p = JSON_BINARY_INT;
+			__json_put32(p + 1, (unsigned long)(long)number);
+			return p + 5;
+		}
+
+		memcpy(&bits, &number, 8);
+		*p = JSON_VALUE_NUMBER;
+		__json_put32(p + 1, bits & 0xffffffff);
+		__json_put32(p + 5, bits >> 32);
+		return p + 9;
+
+	case JSON_VALUE_OBJECT:
+		*p = JSON_VALUE_OBJECT;
+		__json_put32(p + 1, val->value.object.size);
+		p += 5 + 4 * val->value.object.size;
+		i = 0;
+		list_for_each(pos, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			__json_put32(start + 5 + 4 * i++, p - start);
+			len = strlen(memb->name);
+			__json_put32(p, len);
+			memcpy(p + 4, memb->name, len + 1);
+			p = __json_encode_value(&memb->value, p + 5 + len);
+		}
+
+		return p;
+
+	case JSON_VALUE_ARRAY:
+		*p = JSON_VALUE_ARRAY;
+		__json_put32(p + 1, val->value.array.size);
+		p += 5 + 4 * val->value.array.size;
+		i = 0;
+		list_for_each(pos, &val->value.array.head)
+		{
+			__json_put32(start + 5 + 4 * i++, p - start);
+			p = __json_encode_value(&list_entry(pos, json_element_t,
+												list)->value, p);
+		}
+
+		return p;
+
+	default:
+		*p = val->type;
+		return p + 1;
+	}
+}
+
+size_t json_value_encode(const json_value_t *val, void *buf, size_t size)
+{
+	unsigned char *p = (unsigned char *)buf;
+	size_t n = __json_encoded_size(val);
+
+	if (n > 0xffffffff - 8)
+		return 0;
+
+	if (size >= n + 8)
+	{
+		memcpy(p, __binary_magic, 4);
+		__json_put32(p + 4, n);
+		__json_encode_value(val, p + 8);
+	}
+
+	return n + 8;
+}
+
+static const unsigned char *__json_check_string(const unsigned char *p,
+												const unsigned char *end)
+{
+	size_t len;
+
+	if (end - p < 5)
+		return NULL;
+
+	len = __json_get32(p);
+	if (len > (size_t)(end - p) - 5 || p[4 + len] != '\0' ||
+		memchr(p + 4, '\0', len))
+		return NULL;
+
+	return p + 5 + len;
+}
+
+/* Check the value at @p and return its end, adding up the memory that
+   decoding it takes like __measure_json_value() does. */
+static const unsigned char *__json_check_value(const unsigned char *p,
+											   const unsigned char *end,
+											   int depth, size_t *nodes,
+											   size_t *strings)
+{
+	const unsigned char *start = p;
+	size_t len;
+	size_t n;
+	size_t i;
+
+	if (p == end)
+		return NULL;
+
+	switch (*p)
+	{
+	case JSON_VALUE_STRING:
+		p = __json_check_string(p + 1, end);
+		if (p)
+			*strings += p - start - 5;
+
+		return p;
+
+	case JSON_VALUE_NUMBER:
+		return end - p >= 9 ? p + 9 : NULL;
+
+	case JSON_BINARY_INT:
+		return end - p >= 5 ? p + 5 : NULL;
+
+	case JSON_VALUE_OBJECT:
+	case JSON_VALUE_ARRAY:
+		if (depth == JSON_DEPTH_LIMIT || end - p < 5)
+			return NULL;
+
+		n = __json_get32(p + 1);
+		if (n > (size_t)(end - p - 5) / 4)
+			return NULL;
+
+		p += 5 + 4 * n;
+		for (i = 0; i < n; i++)
+		{
+			if (__json_get32(start + 5 + 4 * i) != (size_t)(p - start))
+				return NULL;
+
+			if (*start == JSON_VALUE_OBJECT)
+			{
+				len = __json_get32(p);
+				p = __json_check_string(p, end);
+				if (!p)
+					return NULL;
+
+				*nodes += JSON_ALIGN(offsetof(json_member_t, name) + len + 1);
+			}
+			else
+				*nodes += JSON_ALIGN(sizeof (json_element_t));
+
+			p = __json_check_value(p, end, depth + 1, nodes, strings);
+			if (!p)
+				return NULL;
+		}
+
+		return p;
+
+	case JSON_VALUE_TRUE:
+	case JSON_VALUE_FALSE:
+	case JSON_VALUE_NULL:
+		return p + 1;
+
+	default:
+		return NULL;
+	}
+}
+
+static const unsigned char *__json_check_binary(const void *buf, size_t size,
+												size_t *nodes, size_t *strings)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	size_t n;
+
+	if (size < 8 || memcmp(p, __binary_magic, 4) != 0)
+		return NULL;
+
+	n = __json_get32(p + 4);
+	if (n > size - 8 ||
+		__json_check_value(p + 8, p + 8 + n, 0, nodes, strings) != p + 8 + n)
+		return NULL;
+
+	return p + 8;
+}
+
+static const unsigned char *__decode_json_value(const unsigned char *p,
+												struct __json_block *block,
+												struct __json_block_cursor *cursor,
+												json_value_t *dest)
+{
+	unsigned long long bits;
+	json_member_t *memb;
+	json_element_t *elem;
+	size_t len;
+	size_t n;
+
+	dest->type = *p;
+	switch (*p)
+	{
+	case JSON_VALUE_STRING:
+		len = __json_get32(p + 1);
+		dest->value.string = cursor->string;
+		memcpy(cursor->string, p + 5, len + 1);
+		cursor->string += len + 1;
+		block->live++;
+		p += 6 + len;
+		break;
+
+	case JSON_VALUE_NUMBER:
+		bits = __json_get32(p + 1) | (unsigned long long)__json_get32(p + 5) << 32;
+		memcpy(&dest->value.number, &bits, 8);
+		p += 9;
+		break;
+
+	case JSON_BINARY_INT:
+		n = __json_get32(p + 1);
+		dest->value.number = n < 0x80000000 ? (double)n :
+							 (double)n - 4294967296.0;
+		dest->type = JSON_VALUE_NUMBER;
+		p += 5;
+		break;
+
+	case JSON_VALUE_OBJECT:
+		n = __json_get32(p + 1);
+		INIT_LIST_HEAD(&dest->value.object.head);
+		dest->value.object.size = n;
+		p += 5 + 4 * n;
+		while (n-- != 0)
+		{
+			len = __json_get32(p);
+			memb = (json_member_t *)cursor->node;
+			cursor->node += JSON_ALIGN(offsetof(json_member_t, name) + len + 1);
+			block->live++;
+			memcpy(memb->name, p + 4, len + 1);
+			p = __decode_json_value(p + 5 + len, block, cursor, &memb->value);
+			list_add_tail(&memb->list, &dest->value.object.head);
+		}
+
+		break;
+
+	case JSON_VALUE_ARRAY:
+		n = __json_get32(p + 1);
+		INIT_LIST_HEAD(&dest->value.array.head);
+		dest->value.array.size = n;
+		p += 5 + 4 * n;
+		while (n-- != 0)
+		{
+			elem = (json_element_t *)cursor->node;
+			cursor->node += JSON_ALIGN(sizeof (json_element_t));
+			block->live++;
+			p = __decode_json_value(p, block, cursor, &elem->value);
+			list_add_tail(&elem->list, &dest->value.array.head);
+		}
+
+		break;
+
+	default:
+		p++;
+		break;
+	}
+
+	dest->allocator = &block->allocator;
+	dest->flags = 0;
+	return p;
+}
+
+json_value_t *json_value_decode_alloc(const void *buf, size_t size,
+									  const json_allocator_t *allocator)
+{
+	struct __json_block_cursor cursor;
+	struct __json_block *block;
+	const unsigned char *p;
+	json_value_t *val;
+	size_t nodes = 0;
+	size_t strings = 0;
+
+	p = __json_check_binary(buf, size, &nodes, &strings);
+	if (!p)
+		return NULL;
+
+	block = __json_block_create(nodes, strings, allocator, &cursor);
+	if (!block)
+		return NULL;
+
+	val = __json_block_root(block);
+	__decode_json_value(p, block, &cursor, val);
+	val->refs = 1;
+	return val;
+}
+
+json_value_t *json_value_decode(const void *buf, size_t size)
+{
+	return json_value_decode_alloc(buf, size, NULL);
+}
+
+const json_view_t *json_view_root(const void *buf, size_t size)
+{
+	size_t nodes = 0;
+	size_t strings = 0;
+
+	return (const json_view_t *)__json_check_binary(buf, size, &nodes,
+													&strings);
+}
+
+int json_view_type(const json_view_t *view)
+{
+	int type = *(const unsigned char *)view;
+
+	return type == JSON_BINARY_INT ? JSON_VALUE_NUMBER : type;
+}
+
+const char *json_view_string(const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+
+	if (*p != JSON_VALUE_STRING)
+		return NULL;
+
+	return (const char *)p + 5;
+}
+
+size_t json_view_string_length(const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+
+	if (*p != JSON_VALUE_STRING)
+		return 0;
+
+	return __json_get32(p + 1);
+}
+
+double json_view_number(const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+	unsigned long long bits;
+	unsigned long n;
+	double number;
+
+	switch (*p)
+	{
+	case JSON_BINARY_INT:
+		n = __json_get32(p + 1);
+		return n < 0x80000000 ? (double)n : (double)n - 4294967296.0;
+
+	case JSON_VALUE_NUMBER:
+		bits = __json_get32(p + 1) | (unsigned long long)__json_get32(p + 5) << 32;
+		memcpy(&number, &bits, 8);
+		return number;
+
+	default:
+		return NAN;
+	}
+}
+
+size_t json_view_size(const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+
+	if (*p != JSON_VALUE_OBJECT && *p != JSON_VALUE_ARRAY)
+		return 0;
+
+	return __json_get32(p + 1);
+}
+
+const json_view_t *json_view_array_at(size_t index, const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+
+	if (*p != JSON_VALUE_ARRAY || index >= __json_get32(p + 1))
+		return NULL;
+
+	return (const json_view_t *)(p + __json_get32(p + 5 + 4 * index));
+}
+
+const char *json_view_object_name_at(size_t index, const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+
+	if (*p != JSON_VALUE_OBJECT || index >= __json_get32(p + 1))
+		return NULL;
+
+	return (const char *)p + __json_get32(p + 5 + 4 * index) + 4;
+}
+
+const json_view_t *json_view_object_value_at(size_t index,
+											 const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+
+	if (*p != JSON_VALUE_OBJECT || index >= __json_get32(p + 1))
+		return NULL;
+
+	p += __json_get32(p + 5 + 4 * index);
+	return (const json_view_t *)(p + 5 + __json_get32(p));
+}
+
+const json_view_t *json_view_object_find(const char *name,
+										 const json_view_t *view)
+{
+	const unsigned char *p = (const unsigned char *)view;
+	const unsigned char *memb;
+	size_t len = strlen(name);
+	size_t n;
+	size_t i;
+
+	if (*p != JSON_VALUE_OBJECT)
+		return NULL;
+
+	n = __json_get32(p + 1);
+	for (i = 0; i < n; i++)
+	{
+		memb = p + __json_get32(p + 5 + 4 * i);
+		if (__json_get32(memb) == len && memcmp(memb + 4, name, len) == 0)
+			return (const json_view_t *)(memb + 5 + len);
+	}
+
+	return NULL;
+}
+
+void json_value_destroy(json_value_t *val)
+{
+	if (__json_atomic_dec(&val->refs) != 0)
+		return;
+
+	__destroy_json_value(val);
+	__json_value_free(val, val->allocator);
+}
+
+json_value_t *json_value_retain(json_value_t *val)
+{
+	__json_atomic_inc(&val->refs);
+	return val;
+}
+
+void json_value_release(json_value_t *val)
+{
+	json_value_destroy(val);
+}
+
+/* The order of names in sorted objects: by UTF-16 code units, as RFC 8785
+   asks. That is the byte order of UTF-8, except that characters from
+   U+10000 up, surrogate pairs in UTF-16, go before U+E000 ... U+FFFF. */
+static int __json_name_cmp(const char *name1, const char *name2)
+{
+	const unsigned char *p = (const unsigned char *)name1;
+	const unsigned char *q = (const unsigned char *)name2;
+
+	while (*p == *q && *p != '\0')
+	{
+		p++;
+		q++;
+	}
+
+	if (*p >= 0xee && *q >= 0xee && (*p >= 0xf0) != (*q >= 0xf0))
+		return *p >= 0xf0 ? -1 : 1;
+
+	return (int)*p - (int)*q;
+}
+
+/* Where a member named @name goes in @obj: after the last member, or in a
+   sorted object, after the last member whose name isn't greater. Scanning
+   from the end keeps appends of growing names cheap. */
+static struct list_head *__json_object_tail(const char *name,
+											json_object_t *obj)
+{
+	const json_value_t *owner = list_entry(obj, json_value_t, value.object);
+	struct list_head *pos = obj->head.prev;
+
+	if (owner->flags & JSON_FLAG_SORTED)
+	{
+		while (pos != &obj->head &&
+			   __json_name_cmp(list_entry(pos, json_member_t, list)->name,
+							   name) > 0)
+			pos = pos->prev;
+	}
+
+	return pos;
+}
+
+/* Merge two chains of members sorted by name, linked by 'next' only and
+   ended by NULL. Ties are taken from @a first, which keeps sorting stable. */
+static struct list_head *__json_members_merge(struct list_head *a,
+											  struct list_head *b)
+{
+	struct list_head head;
+	struct list_head *tail = &head;
+
+	while (a && b)
+	{
+		if (__json_name_cmp(list_entry(b, json_member_t, list)->name,
+							list_entry(a, json_member_t, list)->name) < 0)
+		{
+			tail->next = b;
+			b = b->next;
+		}
+		else
+		{
+			tail->next = a;
+			a = a->next;
+		}
+
+		tail = tail->next;
+	}
+
+	tail->next = a ? a : b;
+	return head.next;
+}
+
+/* Merge sort the first @n (at least 1) members of the chain @list. The
+   rest of the chain is returned in @rest. */
+static struct list_head *__json_members_sort(struct list_head *list, size_t n,
+											 struct list_head **rest)
+{
+	struct list_head *a, *b;
+
+	if (n == 1)
+	{
+		*rest = list->next;
+		list->next = NULL;
+		return list;
+	}
+
+	a = __json_members_sort(list, n / 2, &list);
+	b = __json_members_sort(list, n - n / 2, rest);
+	return __json_members_merge(a, b);
+}
+
+static void __json_object_sort(json_object_t *obj)
+{
+	struct list_head *pos, *prev;
+
+	/* Canonical input comes sorted already. */
+	for (pos = obj->head.next; pos->next != &obj->head; pos = pos->next)
+	{
+		if (__json_name_cmp(list_entry(pos, json_member_t, list)->name,
+							list_entry(pos->next, json_member_t, list)->name) > 0)
+			break;
+	}
+
+	if (pos->next == &obj->head)
+		return;
+
+	pos = __json_members_sort(obj->head.next, obj->size, &prev);
+	prev = &obj->head;
+	while (pos)
+	{
+		prev->next = pos;
+		pos->prev = prev;
+		prev = pos;
+		pos = pos->next;
+	}
+
+	prev->next = &obj->head;
+	obj->head.prev = prev;
+}
+
+/* Frozen subtrees may be shared, and are left as they are. */
+static void __sort_json_value(json_value_t *val)
+{
+	struct list_head *pos;
+
+	if (val->flags & JSON_FLAG_FROZEN)
+		return;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_OBJECT:
+		list_for_each(pos, &val->value.object.head)
+			__sort_json_value(&list_entry(pos, json_member_t, list)->value);
+
+		if (val->value.object.size > 1)
+			__json_object_sort(&val->value.object);
+
+		val->flags |= JSON_FLAG_SORTED;
+		break;
+
+	case JSON_VALUE_ARRAY:
+		list_for_each(pos, &val->value.array.head)
+			__sort_json_value(&list_entry(pos, json_element_t, list)->value);
+
+		break;
+	}
+}
+
+int json_value_sort(json_value_t *val)
+{
+	if (val->flags & JSON_FLAG_FROZEN)
+		return -1;
+
+	__sort_json_value(val);
+	return 0;
+}
+
+#ifdef JSON_PARSER_INDEX
+/* A frozen sorted object can't change any more, so an array of its
+   members can be binary searched. Without memory for one, lookups stay
+   linear. */
+static void __json_object_index(json_value_t *val)
+{
+	json_object_t *obj = &val->value.object;
+	struct list_head *pos;
+	size_t i = 0;
+
+	obj->index = (json_member_t **)__json_malloc(obj->size *
+												 sizeof (json_member_t *),
+												 val->allocator);
+	if (!obj->index)
+		return;
+
+	list_for_each(pos, &obj->head)
+		obj->index[i++] = list_entry(pos, json_member_t, list);
+
+	val->flags |= JSON_FLAG_INDEX;
+}
+#endif
+
+struct __json_differ;
+
+static unsigned long long __json_digest(const json_value_t *val,
+										struct __json_differ *differ);
+
+/* A frozen subtree, such as one moved into the document after it was
+   frozen, is left as it is: other threads may be reading its index and
+   digests without locks. */
+static void __freeze_json_value(json_value_t *val)
+{
+	struct list_head *pos;
+
+	if (val->flags & JSON_FLAG_FROZEN)
+		return;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_NUMBER:
+		if (val->flags & JSON_FLAG_LAZY)
+			__json_number_value(val);
+
+		break;
+
+	case JSON_VALUE_OBJECT:
+		list_for_each(pos, &val->value.object.head)
+			__freeze_json_value(&list_entry(pos, json_member_t, list)->value);
+
+		break;
+
+	case JSON_VALUE_ARRAY:
+		list_for_each(pos, &val->value.array.head)
+			__freeze_json_value(&list_entry(pos, json_element_t, list)->value);
+
+		break;
+	}
+
+	val->flags |= JSON_FLAG_FROZEN;
+#ifdef JSON_PARSER_INDEX
+	if ((val->flags & JSON_FLAG_SORTED) &&
+		val->value.object.size >= JSON_SORTED_INDEX_MIN)
+		__json_object_index(val);
+#endif
+#ifdef JSON_PARSER_DIGEST
+	/* Children are frozen first, so their digests are already cached. */
+	if (val->type == JSON_VALUE_OBJECT || val->type == JSON_VALUE_ARRAY)
+	{
+		val->digest = __json_digest(val, NULL);
+		val->flags |= JSON_FLAG_DIGEST;
+	}
+#endif
+}
+
+void json_value_freeze(json_value_t *val)
+{
+	__freeze_json_value(val);
+}
+
+int json_value_frozen(const json_value_t *val)
+{
+	return !!(val->flags & JSON_FLAG_FROZEN);
+}
+
+void json_node_pool_enable(size_t max_nodes)
+{
+	__node_pool.max_nodes = max_nodes;
+}
+
+void json_node_pool_disable(void)
+{
+	struct __json_node_pool *pool = &__node_pool;
+	void *node;
+	int i;
+
+	for (i = 0; i < JSON_NODE_CLASSES; i++)
+	{
+		while (pool->free_list[i])
+		{
+			node = pool->free_list[i];
+			pool->free_list[i] = *(void **)node;
+			free(node);
+		}
+	}
+
+	pool->nodes = 0;
+	pool->max_nodes = 0;
+}
+
+void json_node_pool_stats(json_node_pool_stats_t *stats)
+{
+	*stats = __node_pool.stats;
+	stats->cached = __node_pool.nodes;
+}
+
+int json_parse_stats(json_parse_stats_t *stats)
+{
+#ifdef JSON_PARSER_STATS
+	*stats = __parse_stats;
+	return 0;
+#else
+	memset(stats, 0, sizeof (json_parse_stats_t));
+	return -1;
+#endif
+}
+
+void json_parse_stats_reset(void)
+{
+#ifdef JSON_PARSER_STATS
+	memset(&__parse_stats, 0, sizeof (json_parse_stats_t));
+#endif
+}
+
+int json_value_type(const json_value_t *val)
+{
+	return val->type;
+}
+
+const char *json_value_string(const json_value_t *val)
+{
+	if (val->type != JSON_VALUE_STRING)
+		return NULL;
+
+	return val->value.string;
+}
+
+double json_value_number(const json_value_t *val)
+{
+	if (val->type != JSON_VALUE_NUMBER)
+		return NAN;
+
+	return __json_number_value(val);
+}
+
+const char *json_value_number_text(const json_value_t *val)
+{
+	if (val->type != JSON_VALUE_NUMBER || !(val->flags & JSON_FLAG_RAW))
+		return NULL;
+
+	return val->value.raw;
+}
+
+json_object_t *json_value_object(const json_value_t *val)
+{
+	if (val->type != JSON_VALUE_OBJECT)
+		return NULL;
+
+	return (json_object_t *)&val->value.object;
+}
+
+json_array_t *json_value_array(const json_value_t *val)
+{
+	if (val->type != JSON_VALUE_ARRAY)
+		return NULL;
+
+	return (json_array_t *)&val->value.array;
+}
+
+/* The first member named @name in a sorted object, as in an unsorted one
+   since sorting is stable. */
+static const json_value_t *__json_sorted_find(const char *name,
+											  const json_object_t *obj)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+	int n;
+
+#ifdef JSON_PARSER_INDEX
+	const json_value_t *owner = list_entry(obj, json_value_t, value.object);
+	size_t lo = 0;
+	size_t hi = obj->size;
+	size_t mid;
+
+	if (owner->flags & JSON_FLAG_INDEX)
+	{
+		while (lo < hi)
+		{
+			mid = lo + (hi - lo) / 2;
+			if (__json_name_cmp(obj->index[mid]->name, name) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo < obj->size && strcmp(obj->index[lo]->name, name) == 0)
+			return &obj->index[lo]->value;
+
+		return NULL;
+	}
+#endif
+
+	list_for_each(pos, &obj->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		n = strcmp(memb->name, name);
+		if (n == 0)
+			return &memb->value;
+
+		if (n > 0 && __json_name_cmp(memb->name, name) > 0)
+			break;
+	}
+
+	return NULL;
+}
+
+const json_value_t *json_object_find(const char *name,
+									 const json_object_t *obj)
+{
+	const json_value_t *owner = list_entry(obj, json_value_t, value.object);
+	struct list_head *pos;
+	json_member_t *memb;
+
+	if (owner->flags & JSON_FLAG_SORTED)
+		return __json_sorted_find(name, obj);
+
+	list_for_each(pos, &obj->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		if (strcmp(name, memb->name) == 0)
+			return &memb->value;
+	}
+
+	return NULL;
+}
+
+size_t json_object_size(const json_object_t *obj)
+{
+	return obj->size;
+}
+
+const char *json_object_next_name(const char *name,
+								  const json_object_t *obj)
+{
+	const struct list_head *pos;
+
+	if (name)
+		pos = &list_entry(name, json_member_t, name)->list;
+	else
+		pos = &obj->head;
+
+	if (pos->next == &obj->head)
+		return NULL;
+
+	return list_entry(pos->next, json_member_t, list)->name;
+}
+
+const json_value_t *json_object_next_value(const json_value_t *val,
+										   const json_object_t *obj)
+{
+	const struct list_head *pos;
+
+	if (val)
+		pos = &list_entry(val, json_member_t, value)->list;
+	else
+		pos = &obj->head;
+
+	if (pos->next == &obj->head)
+		return NULL;
+
+	return &list_entry(pos->next, json_member_t, list)->value;
+}
+
+const char *json_object_prev_name(const char *name,
+								  const json_object_t *obj)
+{
+	const struct list_head *pos;
+
+	if (name)
+		pos = &list_entry(name, json_member_t, name)->list;
+	else
+		pos = &obj->head;
+
+	if (pos->prev == &obj->head)
+		return NULL;
+
+	return list_entry(pos->prev, json_member_t, list)->name;
+}
+
+const json_value_t *json_object_prev_value(const json_value_t *val,
+										   const json_object_t *obj)
+{
+	const struct list_head *pos;
+
+	if (val)
+		pos = &list_entry(val, json_member_t, value)->list;
+	else
+		pos = &obj->head;
+
+	if (pos->prev == &obj->head)
+		return NULL;
+
+	return &list_entry(pos->prev, json_member_t, list)->value;
+}
+
+const char *json_object_value_name(const json_value_t *val,
+								   const json_object_t *obj)
+{
+	return list_entry(val, json_member_t, value)->name;
+}
+
+static const json_value_t *__json_object_insert(const char *name,
+												int type, va_list ap,
+												struct list_head *pos,
+												json_object_t *obj)
+{
+	const json_value_t *owner = list_entry(obj, json_value_t, value.object);
+	const json_allocator_t *allocator = owner->allocator;
+	json_member_t *memb;
+	size_t len;
+
+	if (owner->flags & JSON_FLAG_FROZEN)
+		return NULL;
+
+	len = strlen(name);
+	memb = __json_member_alloc(len, allocator);
+	if (!memb)
+		return NULL;
+
+	memcpy(memb->name, name, len + 1);
+	if (__set_json_value(type, ap, allocator, &memb->value) < 0)
+	{
+		__json_member_free(memb, allocator);
+		return NULL;
+	}
+
+	if (owner->flags & JSON_FLAG_SORTED)
+		pos = __json_object_tail(name, obj);
+
+	list_add(&memb->list, pos);
+	obj->size++;
+	return &memb->value;
+}
+
+const json_value_t *json_object_append(json_object_t *obj,
+									   const char *name,
+									   int type, ...)
+{
+	const json_value_t *val;
+	va_list ap;
+
+	va_start(ap, type);
+	val = __json_object_insert(name, type, ap, obj->head.prev, obj);
+	va_end(ap);
+	return val;
+}
+
+const json_value_t *json_object_insert_after(const json_value_t *val,
+											 json_object_t *obj,
+											 const char *name,
+											 int type, ...)
+{
+	struct list_head *pos;
+	va_list ap;
+
+	if (val)
+		pos = &list_entry(val, json_member_t, value)->list;
+	else
+		pos = &obj->head;
+
+	va_start(ap, type);
+	val = __json_object_insert(name, type, ap, pos, obj);
+	va_end(ap);
+	return val;
+}
+
+const json_value_t *json_object_insert_before(const json_value_t *val,
+											  json_object_t *obj,
+											  const char *name,
+											  int type, ...)
+{
+	struct list_head *pos;
+	va_list ap;
+
+	if (val)
+		pos = &list_entry(val, json_member_t, value)->list;
+	else
+		pos = &obj->head;
+
+	va_start(ap, type);
+	val = __json_object_insert(name, type, ap, pos->prev, obj);
+	va_end(ap);
+	return val;
+}
+
+json_value_t *json_object_remove(const json_value_t *val,
+								 json_object_t *obj)
+{
+	json_member_t *memb = list_entry(val, json_member_t, value);
+
+	if (list_entry(obj, json_value_t, value.object)->flags & JSON_FLAG_FROZEN)
+		return NULL;
+
+	val = __json_value_alloc(val->allocator);
+	if (!val)
+		return NULL;
+
+	list_del(&memb->list);
+	obj->size--;
+
+	__move_json_value(&memb->value, (json_value_t *)val);
+	__json_member_free(memb,
+				list_entry(obj, json_value_t, value.object)->allocator);
+	return (json_value_t *)val;
+}
+
+size_t json_array_size(const json_array_t *arr)
+{
+	return arr->size;
+}
+
+const json_value_t *json_array_next_value(const json_value_t *val,
+										  const json_array_t *arr)
+{
+	const struct list_head *pos;
+
+	if (val)
+		pos = &list_entry(val, json_element_t, value)->list;
+	else
+		pos = &arr->head;
+
+	if (pos->next == &arr->head)
+		return NULL;
+
+	return &list_entry(pos->next, json_element_t, list)->value;
+}
+
+const json_value_t *json_array_prev_value(const json_value_t *val,
+										  const json_array_t *arr)
+{
+	const struct list_head *pos;
+
+	if (val)
+		pos = &list_entry(val, json_element_t, value)->list;
+	else
+		pos = &arr->head;
+
+	if (pos->prev == &arr->head)
+		return NULL;
+
+	return &list_entry(pos->prev, json_element_t, list)->value;
+}
+
+static const json_value_t *__json_array_insert(int type, va_list ap,
+											   struct list_head *pos,
+											   json_array_t *arr)
+{
+	const json_value_t *owner = list_entry(arr, json_value_t, value.array);
+	const json_allocator_t *allocator = owner->allocator;
+	json_element_t *elem;
+
+	if (owner->flags & JSON_FLAG_FROZEN)
+		return NULL;
+
+	elem = __json_element_alloc(allocator);
+	if (!elem)
+		return NULL;
+
+	if (__set_json_value(type, ap, allocator, &elem->value) < 0)
+	{
+		__json_element_free(elem, allocator);
+		return NULL;
+	}
+
+	list_add(&elem->list, pos);
+	arr->size++;
+	return &elem->value;
+}
+
+const json_value_t *json_array_append(json_array_t *arr,
+									  int type, ...)
+{
+	const json_value_t *val;
+	va_list ap;
+
+	va_start(ap, type);
+	val = __json_array_insert(type, ap, arr->head.prev, arr);
+	va_end(ap);
+	return val;
+}
+
+const json_value_t *json_array_insert_after(const json_value_t *val,
+											json_array_t *arr,
+											int type, ...)
+{
+	struct list_head *pos;
+	va_list ap;
+
+	if (val)
+		pos = &list_entry(val, json_element_t, value)->list;
+	else
+		pos = &arr->head;
+
+	va_start(ap, type);
+	val = __json_array_insert(type, ap, pos, arr);
+	va_end(ap);
+	return val;
+}
+
+const json_value_t *json_array_insert_before(const json_value_t *val,
+											 json_array_t *arr,
+											 int type, ...)
+{
+	struct list_head *pos;
+	va_list ap;
+
+	if (val)
+		pos = &list_entry(val, json_element_t, value)->list;
+	else
+		pos = &arr->head;
+
+	va_start(ap, type);
+	val = __json_array_insert(type, ap, pos->prev, arr);
+	va_end(ap);
+	return val;
+}
+
+json_value_t *json_array_remove(const json_value_t *val,
+								json_array_t *arr)
+{
+	json_element_t *elem = list_entry(val, json_element_t, value);
+
+	if (list_entry(arr, json_value_t, value.array)->flags & JSON_FLAG_FROZEN)
+		return NULL;
+
+	val = __json_value_alloc(val->allocator);
+	if (!val)
+		return NULL;
+
+	list_del(&elem->list);
+	arr->size--;
+
+	__move_json_value(&elem->value, (json_value_t *)val);
+	__json_element_free(elem,
+				list_entry(arr, json_value_t, value.array)->allocator);
+	return (json_value_t *)val;
+}
+
+#define JSON_WRITER_BUFSIZE	4096
+
+#define JSON_WRITER_ITEMS	0x10
+
+struct __json_writer
+{
+	int (*write)(const char *buf, size_t size, void *context);
+	void *context;
+	const json_allocator_t *allocator;
+	size_t size;
+	int depth;
+	int error;
+	int flags;
+	char state[JSON_DEPTH_LIMIT + 1];
+	char buf[JSON_WRITER_BUFSIZE];
+};
+
+static int __writer_flush(json_writer_t *writer)
+{
+	if (writer->size != 0)
+	{
+		if (writer->write(writer->buf, writer->size, writer->context) < 0)
+			return -1;
+
+		writer->size = 0;
+	}
+
+	return 0;
+}
+
+static int __writer_put(json_writer_t *writer, const char *data, size_t size)
+{
+	if (size > JSON_WRITER_BUFSIZE - writer->size)
+	{
+		if (__writer_flush(writer) < 0)
+			return -1;
+
+		if (size >= JSON_WRITER_BUFSIZE)
+			return writer->write(data, size, writer->context) < 0 ? -1 : 0;
+	}
+
+	memcpy(writer->buf + writer->size, data, size);
+	writer->size += size;
+	return 0;
+}
+
+static int __writer_putc(json_writer_t *writer, char c)
+{
+	if (writer->size == JSON_WRITER_BUFSIZE)
+	{
+		if (__writer_flush(writer) < 0)
+			return -1;
+	}
+
+	writer->buf[writer->size++] = c;
+	return 0;
+}
+
+/* __character_map plus all non-ASCII bytes. */
+static const int __ascii_map[256] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+#define JSON_SWAR_ONES		0x0101010101010101ULL
+#define JSON_SWAR_HIGHS		0x8080808080808080ULL
+
+#if defined(__AVX2__) || defined(JSON_SSE2)
+static int __json_ctz32(unsigned int x)
+{
+# if defined(__GNUC__)
+	return __builtin_ctz(x);
+# else
+	int n = 0;
+
+	while (!(x & 1))
+	{
+		x >>= 1;
+		n++;
+	}
+
+	return n;
+# endif
+}
+#endif
+
+/* Length of the prefix of @str[0, @len) that needs no escaping. That's
+   no '"', '\\' or control character, and no byte >= 0x80 if @ascii. */
+static size_t __json_clean_span(const char *str, size_t len, int ascii)
+{
+	const int *map;
+	size_t n = 0;
+
+#if defined(__AVX2__)
+	const __m256i quote = _mm256_set1_epi8('\"');
+	const __m256i slash = _mm256_set1_epi8('\\');
+	const __m256i ctrl = _mm256_set1_epi8(0x1f);
+	unsigned int mask;
+
+	while (n + 32 <= len)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(str + n));
+		__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+									_mm256_cmpeq_epi8(v, slash));
+
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v));
+		mask = (unsigned int)_mm256_movemask_epi8(m);
+		if (ascii)
+			mask |= (unsigned int)_mm256_movemask_epi8(v);
+
+		if (mask != 0)
+			return n + __json_ctz32(mask);
+
+		n += 32;
+	}
+#elif defined(JSON_SSE2)
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i slash = _mm_set1_epi8('\\');
+	const __m128i ctrl = _mm_set1_epi8(0x1f);
+	unsigned int mask;
+
+	while (n + 16 <= len)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(str + n));
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+								 _mm_cmpeq_epi8(v, slash));
+
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+		mask = (unsigned int)_mm_movemask_epi8(m);
+		if (ascii)
+			mask |= (unsigned int)_mm_movemask_epi8(v);
+
+		if (mask != 0)
+			return n + __json_ctz32(mask);
+
+		n += 16;
+	}
+#else
+	/* Skip 8 clean bytes at a time. A word with any byte to escape is
+	   left to the byte loop below. */
+	unsigned long long x, q, s;
+
+	while (n + 8 <= len)
+	{
+		memcpy(&x, str + n, 8);
+		q = x ^ ('\"' * JSON_SWAR_ONES);
+		s = x ^ ('\\' * JSON_SWAR_ONES);
+		q = (q - JSON_SWAR_ONES) & ~q;
+		s = (s - JSON_SWAR_ONES) & ~s;
+		q |= s | ((x - 0x20 * JSON_SWAR_ONES) & ~x);
+		if (ascii)
+			q |= x;
+
+		if (q & JSON_SWAR_HIGHS)
+			break;
+
+		n += 8;
+	}
+#endif
+
+	map = ascii ? __ascii_map : __character_map;
+	while (n < len && map[(unsigned char)str[n]] == 0)
+		n++;
+
+	return n;
+}
+
+/* Decode the UTF-8 sequence at @str. Returns its length, or 1 with
+   *@code set to U+FFFD if the sequence is invalid. Never reads past
+   the terminating '\0', which isn't a continuation byte. */
+static size_t __json_utf8_decode(const char *str, unsigned int *code)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	unsigned int min;
+	size_t n;
+	size_t i;
+
+	if (s[0] >= 0xc2 && s[0] <= 0xdf)
+	{
+		*code = s[0] & 0x1f;
+		min = 0x80;
+		n = 2;
+	}
+	else if (s[0] >= 0xe0 && s[0] <= 0xef)
+	{
+		*code = s[0] & 0x0f;
+		min = 0x800;
+		n = 3;
+	}
+	else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+	{
+		*code = s[0] & 0x07;
+		min = 0x10000;
+		n = 4;
+	}
+	else
+		n = 0;
+
+	if (n != 0)
+	{
+		for (i = 1; i < n; i++)
+		{
+			if ((s[i] & 0xc0) != 0x80)
+				break;
+
+			*code = (*code << 6) | (s[i] & 0x3f);
+		}
+
+		if (i == n && *code >= min && *code <= 0x10ffff &&
+			(*code < 0xd800 || *code > 0xdfff))
+		{
+			return n;
+		}
+	}
+
+	*code = 0xfffd;
+	return 1;
+}
+
+static int __write_json_string(const char *str, json_writer_t *writer)
+{
+	static const char hex[] = "0123456789abcdef";
+	int ascii = writer->flags & JSON_WRITER_ASCII;
+	char esc[12] = { '\\', 'u', '0', '0' };
+	const int *map = ascii ? __ascii_map : __character_map;
+	const char *end = NULL;
+	unsigned int code;
+	size_t n;
+
+	if (__writer_putc(writer, '\"') < 0)
+		return -1;
+
+	while (1)
+	{
+		/* Most runs are short. Scan them byte by byte and only find the
+		   end of the string for a long run, that is scanned in blocks. */
+		n = 0;
+		while (n < 16 && map[(unsigned char)str[n]] == 0)
+			n++;
+
+		if (n == 16)
+		{
+			if (!end)
+				end = str + strlen(str);
+
+			n += __json_clean_span(str + 16, end - str - 16, ascii);
+		}
+
+		if (n != 0 && __writer_put(writer, str, n) < 0)
+			return -1;
+
+		str += n;
+		if (*str == '\0')
+			break;
+
+		if ((unsigned char)*str >= 0x80)
+		{
+			n = __json_utf8_decode(str, &code);
+			str += n;
+			if (code >= 0x10000)
+			{
+				code -= 0x10000;
+				esc[2] = 'd';
+				esc[3] = hex[0x8 | code >> 18];
+				esc[4] = hex[code >> 14 & 0xf];
+				esc[5] = hex[code >> 10 & 0xf];
+				esc[6] = '\\';
+				esc[7] = 'u';
+				code = 0xdc00 | (code & 0x3ff);
+				n = 12;
+			}
+			else
+				n = 6;
+
+			esc[n - 4] = hex[code >> 12];
+			esc[n - 3] = hex[code >> 8 & 0xf];
+			esc[n - 2] = hex[code >> 4 & 0xf];
+			esc[n - 1] = hex[code & 0xf];
+			esc[1] = 'u';
+			if (__writer_put(writer, esc, n) < 0)
+				return -1;
+
+			continue;
+		}
+
+		switch (*str)
+		{
+		case '\"':
+		case '\\':
+			esc[1] = *str;
+			n = 2;
+			break;
+		case '\b':
+			esc[1] = 'b';
+			n = 2;
+			break;
+		case '\f':
+			esc[1] = 'f';
+			n = 2;
+			break;
+		case '\n':
+			esc[1] = 'n';
+			n = 2;
+			break;
+		case '\r':
+			esc[1] = 'r';
+			n = 2;
+			break;
+		case '\t':
+			esc[1] = 't';
+			n = 2;
+			break;
+		default:
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hex[(unsigned char)*str >> 4];
+			esc[5] = hex[*str & 0xf];
+			n = 6;
+			break;
+		}
+
+		if (__writer_put(writer, esc, n) < 0)
+			return -1;
+
+		str++;
+	}
+
+	return __writer_putc(writer, '\"');
+}
+
+/* 10^k for k = -348 + 8 * i, normalized to 64-bit significands. */
+static const unsigned long long __cached_power_f[87] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short __cached_power_e[87] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034,
+	-1007, -980, -954, -927, -901, -874, -847, -821,
+	-794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396,
+	-369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242,
+	269, 295, 322, 348, 375, 402, 428, 455,
+	481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const unsigned long long __power_of_10_int[20] = {
+	1ULL,					10ULL,
+	100ULL,					1000ULL,
+	10000ULL,				100000ULL,
+	1000000ULL,				10000000ULL,
+	100000000ULL,			1000000000ULL,
+	10000000000ULL,			100000000000ULL,
+	1000000000000ULL,		10000000000000ULL,
+	100000000000000ULL,		1000000000000000ULL,
+	10000000000000000ULL,	100000000000000000ULL,
+	1000000000000000000ULL,	10000000000000000000ULL
+};
+
+struct __json_diy_fp
+{
+	unsigned long long f;
+	int e;
+};
+
+static struct __json_diy_fp __diy_fp_mul(struct __json_diy_fp x,
+										 struct __json_diy_fp y)
+{
+	struct __json_diy_fp r;
+	unsigned long long lo;
+
+	__json_mul64(x.f, y.f, &r.f, &lo);
+	r.f += lo >> 63;
+	r.e = x.e + y.e + 64;
+	return r;
+}
+
+static void __grisu_round(char *digits, int len, unsigned long long delta,
+						  unsigned long long rest, unsigned long long ten_kappa,
+						  unsigned long long wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+		   (rest + ten_kappa < wp_w ||
+			wp_w - rest > rest + ten_kappa - wp_w))
+	{
+		digits[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+/* Grisu2 by Florian Loitsch: the shortest digits of a positive finite
+   @number in most cases, and always digits that read back as @number.
+   The value is digits * 10^(*k). Returns the number of digits. */
+static int __grisu2(double number, char *digits, int *k)
+{
+	struct __json_diy_fp w, plus, minus, c, wp;
+	unsigned long long bits, delta, wp_w, one, p2, rest;
+	unsigned int p1;
+	int kappa;
+	int len = 0;
+	int shift;
+	int idx;
+	double dk;
+
+	memcpy(&bits, &number, sizeof (double));
+	w.f = bits & ((1ULL << 52) - 1);
+	w.e = (int)(bits >> 52 & 0x7ff);
+	if (w.e != 0)
+	{
+		w.f += 1ULL << 52;
+		w.e -= 1075;
+	}
+	else
+		w.e = -1074;
+
+	/* The boundaries halfway to the neighbouring doubles. */
+	plus.f = (w.f << 1) + 1;
+	plus.e = w.e - 1;
+	shift = __json_clz64(plus.f);
+	plus.f <<= shift;
+	plus.e -= shift;
+	if (w.f == 1ULL << 52)
+	{
+		minus.f = (w.f << 2) - 1;
+		minus.e = w.e - 2;
+	}
+	else
+	{
+		minus.f = (w.f << 1) - 1;
+		minus.e = w.e - 1;
+	}
+
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+	shift = __json_clz64(w.f);
+	w.f <<= shift;
+	w.e -= shift;
+
+	/* Scale into [2^-60, 2^-32] by a cached power of 10. */
+	dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+	idx = (int)dk;
+	if (dk - idx > 0.0)
+		idx++;
+
+	idx = (idx >> 3) + 1;
+	*k = 348 - 8 * idx;
+	c.f = __cached_power_f[idx];
+	c.e = __cached_power_e[idx];
+	w = __diy_fp_mul(w, c);
+	wp = __diy_fp_mul(plus, c);
+	minus = __diy_fp_mul(minus, c);
+	wp.f--;
+	minus.f++;
+	delta = wp.f - minus.f;
+	wp_w = wp.f - w.f;
+
+	one = 1ULL << -wp.e;
+	p1 = (unsigned int)(wp.f >> -wp.e);
+	p2 = wp.f & (one - 1);
+	kappa = 1;
+	while (kappa < 10 && p1 >= __power_of_10_int[kappa])
+		kappa++;
+
+	while (kappa > 0)
+	{
+		unsigned int d = p1 / (unsigned int)__power_of_10_int[kappa - 1];
+
+		p1 %= (unsigned int)__power_of_10_int[kappa - 1];
+		if (d || len)
+			digits[len++] = '0' + d;
+
+		kappa--;
+		rest = ((unsigned long long)p1 << -wp.e) + p2;
+		if (rest <= delta)
+		{
+			*k += kappa;
+			__grisu_round(digits, len, delta, rest,
+						  __power_of_10_int[kappa] << -wp.e, wp_w);
+			return len;
+		}
+	}
+
+	while (1)
+	{
+		char d;
+
+		p2 *= 10;
+		delta *= 10;
+		d = (char)(p2 >> -wp.e);
+		if (d || len)
+			digits[len++] = '0' + d;
+
+		p2 &= one - 1;
+		kappa--;
+		if (p2 < delta)
+		{
+			*k += kappa;
+			__grisu_round(digits, len, delta, p2, one,
+						  -kappa < 20 ? wp_w * __power_of_10_int[-kappa] : 0);
+			return len;
+		}
+	}
+}
+
+/* Format a finite number into @buf (at least 32 bytes) as the shortest
+   text that __parse_json_number() reads back as the same double. Integral
+   values below 10^21 are written as plain integers. Returns the length. */
+static int __format_json_number(double number, char *buf)
+{
+	char *p = buf;
+	int len;
+	int k;
+	int n;
+
+	if (number < 0)
+	{
+		*p++ = '-';
+		number = -number;
+	}
+	else if (number == 0 && signbit(number))
+		*p++ = '-';
+
+	if (number < 9007199254740992.0 &&
+		number == (double)(unsigned long long)number)
+	{
+		unsigned long long u = (unsigned long long)number;
+		char tmp[20];
+
+		len = 0;
+		do
+		{
+			tmp[len++] = '0' + (char)(u % 10);
+			u /= 10;
+		} while (u);
+
+		while (len > 0)
+			*p++ = tmp[--len];
+
+		return (int)(p - buf);
+	}
+
+	len = __grisu2(number, p, &k);
+	n = len + k;
+	if (k >= 0 && n <= 21)
+	{
+		/* 1234e7 -> 12340000000 */
+		memset(p + len, '0', k);
+		p += n;
+	}
+	else if (n > 0 && n <= 21)
+	{
+		/* 1234e-2 -> 12.34 */
+		memmove(p + n + 1, p + n, len - n);
+		p[n] = '.';
+		p += len + 1;
+	}
+	else if (n > -6 && n <= 0)
+	{
+		/* 1234e-6 -> 0.001234 */
+		memmove(p + 2 - n, p, len);
+		p[0] = '0';
+		p[1] = '.';
+		memset(p + 2, '0', -n);
+		p += len + 2 - n;
+	}
+	else
+	{
+		/* 1234e30 -> 1.234e33 */
+		if (len > 1)
+		{
+			memmove(p + 2, p + 1, len - 1);
+			p[1] = '.';
+			p += len + 1;
+		}
+		else
+			p++;
+
+		*p++ = 'e';
+		n--;
+		if (n < 0)
+		{
+			*p++ = '-';
+			n = -n;
+		}
+
+		if (n >= 100)
+		{
+			*p++ = '0' + n / 100;
+			n %= 100;
+			*p++ = '0' + n / 10;
+		}
+		else if (n >= 10)
+			*p++ = '0' + n / 10;
+
+		*p++ = '0' + n % 10;
+	}
+
+	return (int)(p - buf);
+}
+
+static int __write_json_number(double number, json_writer_t *writer)
+{
+	char buf[32];
+
+	if (!isfinite(number))
+		return __writer_put(writer, "null", 4);
+
+	return __writer_put(writer, buf, __format_json_number(number, buf));
+}
+
+/* Write the separator and the name before a new item, and check that the
+   item is allowed here: named inside objects and unnamed elsewhere. */
+static int __writer_begin_item(const char *name, json_writer_t *writer)
+{
+	char *state = &writer->state[writer->depth];
+
+	if (writer->error)
+		return -1;
+
+	if (writer->depth == 0)
+	{
+		if (*state != 0 || name)
+			return -1;
+	}
+	else
+	{
+		if ((*state & ~JSON_WRITER_ITEMS) == JSON_VALUE_OBJECT)
+		{
+			if (!name)
+				return -1;
+		}
+		else if (name)
+			return -1;
+
+		if ((*state & JSON_WRITER_ITEMS) && __writer_putc(writer, ',') < 0)
+			return -1;
+	}
+
+	*state |= JSON_WRITER_ITEMS;
+	if (name)
+	{
+		if (__write_json_string(name, writer) < 0 ||
+			__writer_putc(writer, ':') < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int __writer_open(int type, json_writer_t *writer)
+{
+	if (writer->depth == JSON_DEPTH_LIMIT)
+		return -1;
+
+	writer->depth++;
+	writer->state[writer->depth] = type;
+	return __writer_putc(writer, type == JSON_VALUE_OBJECT ? '{' : '[');
+}
+
+static int __writer_close(json_writer_t *writer)
+{
+	int type;
+
+	if (writer->error || writer->depth == 0)
+		return -1;
+
+	type = writer->state[writer->depth] & ~JSON_WRITER_ITEMS;
+	writer->depth--;
+	return __writer_putc(writer, type == JSON_VALUE_OBJECT ? '}' : ']');
+}
+
+static int __write_json_value(const json_value_t *val, json_writer_t *writer);
+
+static int __write_json_members(const json_object_t *obj,
+								json_writer_t *writer)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+
+	list_for_each(pos, &obj->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		if (__writer_begin_item(memb->name, writer) < 0 ||
+			__write_json_value(&memb->value, writer) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int __write_json_elements(const json_array_t *arr,
+								 json_writer_t *writer)
+{
+	struct list_head *pos;
+	json_element_t *elem;
+
+	list_for_each(pos, &arr->head)
+	{
+		elem = list_entry(pos, json_element_t, list);
+		if (__writer_begin_item(NULL, writer) < 0 ||
+			__write_json_value(&elem->value, writer) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int __write_json_value(const json_value_t *val, json_writer_t *writer)
+{
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		return __write_json_string(val->value.string, writer);
+
+	case JSON_VALUE_NUMBER:
+		if (val->flags & JSON_FLAG_RAW)
+			return __writer_put(writer, val->value.raw, strlen(val->value.raw));
+
+		return __write_json_number(__json_number_value(val), writer);
+
+	case JSON_VALUE_OBJECT:
+		if (__writer_open(JSON_VALUE_OBJECT, writer) < 0 ||
+			__write_json_members(&val->value.object, writer) < 0)
+			return -1;
+
+		return __writer_close(writer);
+
+	case JSON_VALUE_ARRAY:
+		if (__writer_open(JSON_VALUE_ARRAY, writer) < 0 ||
+			__write_json_elements(&val->value.array, writer) < 0)
+			return -1;
+
+		return __writer_close(writer);
+
+	case JSON_VALUE_TRUE:
+		return __writer_put(writer, "true", 4);
+
+	case JSON_VALUE_FALSE:
+		return __writer_put(writer, "false", 5);
+
+	case JSON_VALUE_NULL:
+		return __writer_put(writer, "null", 4);
+	}
+
+	return -1;
+}
+
+static void __writer_init(int (*write)(const char *, size_t, void *),
+						  void *context, json_writer_t *writer)
+{
+	writer->write = write;
+	writer->context = context;
+	writer->size = 0;
+	writer->depth = 0;
+	writer->error = 0;
+	writer->flags = 0;
+	writer->state[0] = 0;
+}
+
+json_writer_t *json_writer_create_alloc(int (*write)(const char *, size_t,
+													 void *),
+										void *context,
+										const json_allocator_t *allocator)
+{
+	json_writer_t *writer;
+
+	writer = (json_writer_t *)__json_malloc(sizeof (json_writer_t),
+											allocator);
+	if (writer)
+	{
+		__writer_init(write, context, writer);
+		writer->allocator = allocator;
+	}
+
+	return writer;
+}
+
+json_writer_t *json_writer_create(int (*write)(const char *, size_t, void *),
+								  void *context)
+{
+	return json_writer_create_alloc(write, context, NULL);
+}
+
+void json_writer_set_flags(json_writer_t *writer, int flags)
+{
+	writer->flags = flags;
+}
+
+int json_writer_append(json_writer_t *writer, const char *name,
+					   int type, ...)
+{
+	va_list ap;
+	int ret;
+
+	ret = __writer_begin_item(name, writer);
+	if (ret >= 0)
+	{
+		va_start(ap, type);
+		switch (type)
+		{
+		case 0:
+			ret = __write_json_value(va_arg(ap, const json_value_t *), writer);
+			break;
+		case JSON_VALUE_STRING:
+			ret = __write_json_string(va_arg(ap, const char *), writer);
+			break;
+		case JSON_VALUE_NUMBER:
+			ret = __write_json_number(va_arg(ap, double), writer);
+			break;
+		case JSON_VALUE_OBJECT:
+		case JSON_VALUE_ARRAY:
+			ret = __writer_open(type, writer);
+			break;
+		case JSON_VALUE_TRUE:
+			ret = __writer_put(writer, "true", 4);
+			break;
+		case JSON_VALUE_FALSE:
+			ret = __writer_put(writer, "false", 5);
+			break;
+		case JSON_VALUE_NULL:
+			ret = __writer_put(writer, "null", 4);
+			break;
+		default:
+			ret = -1;
+			break;
+		}
+
+		va_end(ap);
+	}
+
+	if (ret < 0)
+		writer->error = 1;
+
+	return ret;
+}
+
+int json_writer_end(json_writer_t *writer)
+{
+	if (__writer_close(writer) < 0)
+	{
+		writer->error = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
+int json_writer_flush(json_writer_t *writer)
+{
+	if (__writer_flush(writer) < 0)
+		writer->error = 1;
+
+	return writer->error ? -1 : 0;
+}
+
+void json_writer_destroy(json_writer_t *writer)
+{
+	__json_free(writer, writer->allocator);
+}
+
+int json_value_write(const json_value_t *val,
+					 int (*write)(const char *, size_t, void *),
+					 void *context)
+{
+	json_writer_t writer;
+
+	__writer_init(write, context, &writer);
+	if (__write_json_value(val, &writer) < 0)
+		return -1;
+
+	return __writer_flush(&writer);
+}
+
+/* Numbers as ECMAScript prints them: no -0, and a sign on every exponent. */
+static int __write_canonical_number(double number, json_writer_t *writer)
+{
+	char buf[32];
+	char *p;
+	int n;
+
+	if (!isfinite(number))
+		return -1;
+
+	if (number == 0)
+		return __writer_putc(writer, '0');
+
+	n = __format_json_number(number, buf);
+	p = (char *)memchr(buf, 'e', n);
+	if (p && p[1] != '-')
+	{
+		memmove(p + 2, p + 1, buf + n - p - 1);
+		p[1] = '+';
+		n++;
+	}
+
+	return __writer_put(writer, buf, n);
+}
+
+/* Stable merge sort of @n members by name, @tmp being as large. */
+static void __json_member_array_sort(json_member_t **memb, json_member_t **tmp,
+									 size_t n)
+{
+	size_t half = n / 2;
+	size_t i = 0;
+	size_t j = half;
+	size_t k = 0;
+
+	if (n < 2)
+		return;
+
+	__json_member_array_sort(memb, tmp, half);
+	__json_member_array_sort(memb + half, tmp, n - half);
+	while (i < half && j < n)
+	{
+		if (__json_name_cmp(memb[j]->name, memb[i]->name) < 0)
+			tmp[k++] = memb[j++];
+		else
+			tmp[k++] = memb[i++];
+	}
+
+	while (i < half)
+		tmp[k++] = memb[i++];
+
+	memcpy(memb, tmp, k * sizeof (json_member_t *));
+}
+
+static int __write_canonical_value(const json_value_t *val,
+								   json_writer_t *writer);
+
+/* Members of an object that isn't kept sorted are sorted on the side. */
+static int __write_canonical_members(const json_value_t *val,
+									 json_writer_t *writer)
+{
+	const json_object_t *obj = &val->value.object;
+	json_member_t *local[16];
+	json_member_t **memb = local;
+	struct list_head *pos;
+	size_t i = 0;
+	int ret = 0;
+
+	if ((val->flags & JSON_FLAG_SORTED) || obj->size < 2)
+	{
+		list_for_each(pos, &obj->head)
+		{
+			if (__writer_begin_item(list_entry(pos, json_member_t, list)->name,
+									writer) < 0 ||
+				__write_canonical_value(&list_entry(pos, json_member_t,
+													list)->value, writer) < 0)
+				return -1;
+		}
+
+		return 0;
+	}
+
+	if (obj->size > 8)
+	{
+		memb = (json_member_t **)
+			__json_malloc(2 * obj->size * sizeof (json_member_t *),
+						  __json_user_allocator(val->allocator));
+		if (!memb)
+			return -1;
+	}
+
+	list_for_each(pos, &obj->head)
+		memb[i++] = list_entry(pos, json_member_t, list);
+
+	__json_member_array_sort(memb, memb + i, i);
+	for (i = 0; i < obj->size; i++)
+	{
+		if (__writer_begin_item(memb[i]->name, writer) < 0 ||
+			__write_canonical_value(&memb[i]->value, writer) < 0)
+		{
+			ret = -1;
+			break;
+		}
+	}
+
+	if (memb != local)
+		__json_free(memb, __json_user_allocator(val->allocator));
+
+	return ret;
+}
+
+static int __write_canonical_value(const json_value_t *val,
+								   json_writer_t *writer)
+{
+	struct list_head *pos;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_NUMBER:
+		return __write_canonical_number(__json_number_value(val), writer);
+
+	case JSON_VALUE_OBJECT:
+		if (__writer_open(JSON_VALUE_OBJECT, writer) < 0 ||
+			__write_canonical_members(val, writer) < 0)
+			return -1;
+
+		return __writer_close(writer);
+
+	case JSON_VALUE_ARRAY:
+		if (__writer_open(JSON_VALUE_ARRAY, writer) < 0)
+			return -1;
+
+		list_for_each(pos, &val->value.array.head)
+		{
+			if (__writer_begin_item(NULL, writer) < 0 ||
+				__write_canonical_value(&list_entry(pos, json_element_t,
+													list)->value, writer) < 0)
+				return -1;
+		}
+
+		return __writer_close(writer);
+
+	default:
+		return __write_json_value(val, writer);
+	}
+}
+
+int json_value_write_canonical(const json_value_t *val,
+							   int (*write)(const char *, size_t, void *),
+							   void *context)
+{
+	json_writer_t writer;
+
+	__writer_init(write, context, &writer);
+	if (__write_canonical_value(val, &writer) < 0)
+		return -1;
+
+	return __writer_flush(&writer);
+}
+
+/* Whether @number is an integer of at most 64 bits (-0 is not), and its
+   magnitude. */
+static int __json_number_integer(double number, unsigned long long *mag)
+{
+	double a = fabs(number);
+
+	if (!(a < 18446744073709551616.0) || (number == 0 && signbit(number)))
+		return 0;
+
+	*mag = (unsigned long long)a;
+	return (double)*mag == a;
+}
+
+/* @tag followed by the low @bytes bytes of @n, big-endian. */
+static int __writer_put_be(json_writer_t *writer, int tag,
+						   unsigned long long n, int bytes)
+{
+	char data[9];
+	int i;
+
+	data[0] = tag;
+	for (i = bytes; i > 0; i--)
+	{
+		data[i] = n & 0xff;
+		n >>= 8;
+	}
+
+	return __writer_put(writer, data, bytes + 1);
+}
+
+static int __writer_put_float(json_writer_t *writer, int tag32, int tag64,
+							  double number)
+{
+	unsigned long long bits;
+	unsigned int bits32;
+	float f = (float)number;
+
+	if ((double)f == number)
+	{
+		memcpy(&bits32, &f, 4);
+		return __writer_put_be(writer, tag32, bits32, 4);
+	}
+
+	memcpy(&bits, &number, 8);
+	return __writer_put_be(writer, tag64, bits, 8);
+}
+
+/* The shortest MessagePack head with @tag8 ... @tag32 for a length @n. */
+static int __msgpack_put_length(json_writer_t *writer, int fix, size_t max,
+								int tag8, int tag16, int tag32, size_t n)
+{
+	if (n <= max)
+		return __writer_putc(writer, fix | n);
+	else if (n <= 0xff && tag8 != 0)
+		return __writer_put_be(writer, tag8, n, 1);
+	else if (n <= 0xffff)
+		return __writer_put_be(writer, tag16, n, 2);
+	else if (n <= 0xffffffff)
+		return __writer_put_be(writer, tag32, n, 4);
+	else
+		return -1;
+}
+
+static int __msgpack_put_number(json_writer_t *writer, double number)
+{
+	unsigned long long n;
+
+	if (!__json_number_integer(number, &n))
+		return __writer_put_float(writer, 0xca, 0xcb, number);
+
+	if (number >= 0)
+	{
+		if (n <= 0x7f)
+			return __writer_putc(writer, (char)n);
+		else if (n <= 0xff)
+			return __writer_put_be(writer, 0xcc, n, 1);
+		else if (n <= 0xffff)
+			return __writer_put_be(writer, 0xcd, n, 2);
+		else if (n <= 0xffffffff)
+			return __writer_put_be(writer, 0xce, n, 4);
+		else
+			return __writer_put_be(writer, 0xcf, n, 8);
+	}
+
+	if (n > 0x8000000000000000ULL)
+		return __writer_put_float(writer, 0xca, 0xcb, number);
+
+	/* Two's complement of the magnitude. */
+	if (n <= 0x20)
+		return __writer_putc(writer, (char)(0 - n));
+	else if (n <= 0x80)
+		return __writer_put_be(writer, 0xd0, 0 - n, 1);
+	else if (n <= 0x8000)
+		return __writer_put_be(writer, 0xd1, 0 - n, 2);
+	else if (n <= 0x80000000)
+		return __writer_put_be(writer, 0xd2, 0 - n, 4);
+	else
+		return __writer_put_be(writer, 0xd3, 0 - n, 8);
+}
+
+static int __msgpack_put_string(json_writer_t *writer, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (__msgpack_put_length(writer, 0xa0, 31, 0xd9, 0xda, 0xdb, len) < 0)
+		return -1;
+
+	return __writer_put(writer, str, len);
+}
+
+static int __write_msgpack_value(const json_value_t *val,
+								 json_writer_t *writer)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		return __msgpack_put_string(writer, val->value.string);
+
+	case JSON_VALUE_NUMBER:
+		return __msgpack_put_number(writer, __json_number_value(val));
+
+	case JSON_VALUE_OBJECT:
+		if (__msgpack_put_length(writer, 0x80, 15, 0, 0xde, 0xdf,
+								 val->value.object.size) < 0)
+			return -1;
+
+		list_for_each(pos, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			if (__msgpack_put_string(writer, memb->name) < 0 ||
+				__write_msgpack_value(&memb->value, writer) < 0)
+				return -1;
+		}
+
+		return 0;
+
+	case JSON_VALUE_ARRAY:
+		if (__msgpack_put_length(writer, 0x90, 15, 0, 0xdc, 0xdd,
+								 val->value.array.size) < 0)
+			return -1;
+
+		list_for_each(pos, &val->value.array.head)
+		{
+			if (__write_msgpack_value(&list_entry(pos, json_element_t,
+												  list)->value, writer) < 0)
+				return -1;
+		}
+
+		return 0;
+
+	case JSON_VALUE_TRUE:
+		return __writer_putc(writer, (char)0xc3);
+
+	case JSON_VALUE_FALSE:
+		return __writer_putc(writer, (char)0xc2);
+
+	case JSON_VALUE_NULL:
+		return __writer_putc(writer, (char)0xc0);
+	}
+
+	return -1;
+}
+
+int json_value_write_msgpack(const json_value_t *val,
+							 int (*write)(const char *, size_t, void *),
+							 void *context)
+{
+	json_writer_t writer;
+
+	__writer_init(write, context, &writer);
+	if (__write_msgpack_value(val, &writer) < 0)
+		return -1;
+
+	return __writer_flush(&writer);
+}
+
+/* A CBOR head: @major type and argument @n, in the shortest form. */
+static int __cbor_put_head(json_writer_t *writer, int major,
+						   unsigned long long n)
+{
+	major <<= 5;
+	if (n < 24)
+		return __writer_putc(writer, (char)(major | n));
+	else if (n <= 0xff)
+		return __writer_put_be(writer, major | 24, n, 1);
+	else if (n <= 0xffff)
+		return __writer_put_be(writer, major | 25, n, 2);
+	else if (n <= 0xffffffff)
+		return __writer_put_be(writer, major | 26, n, 4);
+	else
+		return __writer_put_be(writer, major | 27, n, 8);
+}
+
+static int __cbor_put_string(json_writer_t *writer, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (__cbor_put_head(writer, 3, len) < 0)
+		return -1;
+
+	return __writer_put(writer, str, len);
+}
+
+static int __write_cbor_value(const json_value_t *val, json_writer_t *writer)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+	unsigned long long n;
+	double number;
+
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		return __cbor_put_string(writer, val->value.string);
+
+	case JSON_VALUE_NUMBER:
+		number = __json_number_value(val);
+		if (!__json_number_integer(number, &n))
+			return __writer_put_float(writer, 0xfa, 0xfb, number);
+
+		if (number >= 0)
+			return __cbor_put_head(writer, 0, n);
+
+		return __cbor_put_head(writer, 1, n - 1);
+
+	case JSON_VALUE_OBJECT:
+		if (__cbor_put_head(writer, 5, val->value.object.size) < 0)
+			return -1;
+
+		list_for_each(pos, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			if (__cbor_put_string(writer, memb->name) < 0 ||
+				__write_cbor_value(&memb->value, writer) < 0)
+				return -1;
+		}
+
+		return 0;
+
+	case JSON_VALUE_ARRAY:
+		if (__cbor_put_head(writer, 4, val->value.array.size) < 0)
+			return -1;
+
+		list_for_each(pos, &val->value.array.head)
+		{
+			if (__write_cbor_value(&list_entry(pos, json_element_t,
+											   list)->value, writer) < 0)
+				return -1;
+		}
+
+		return 0;
+
+	case JSON_VALUE_TRUE:
+		return __writer_putc(writer, (char)0xf5);
+
+	case JSON_VALUE_FALSE:
+		return __writer_putc(writer, (char)0xf4);
+
+	case JSON_VALUE_NULL:
+		return __writer_putc(writer, (char)0xf6);
+	}
+
+	return -1;
+}
+
+int json_value_write_cbor(const json_value_t *val,
+						  int (*write)(const char *, size_t, void *),
+						  void *context)
+{
+	json_writer_t writer;
+
+	__writer_init(write, context, &writer);
+	if (__write_cbor_value(val, &writer) < 0)
+		return -1;
+
+	return __writer_flush(&writer);
+}
+
+struct __json_decoder
+{
+	const unsigned char *cursor;
+	const unsigned char *end;
+	const json_allocator_t *allocator;
+};
+
+static int __decoder_get_be(struct __json_decoder *dec, int bytes,
+							unsigned long long *n)
+{
+	int i;
+
+	if (dec->end - dec->cursor < bytes)
+		return -2;
+
+	*n = 0;
+	for (i = 0; i < bytes; i++)
+		*n = (*n << 8) | *dec->cursor++;
+
+	return 0;
+}
+
+static double __json_float_bits(unsigned long long bits, int bytes)
+{
+	unsigned int bits32 = (unsigned int)bits;
+	double number;
+	float f;
+
+	if (bytes == 8)
+	{
+		memcpy(&number, &bits, 8);
+		return number;
+	}
+
+	memcpy(&f, &bits32, 4);
+	return f;
+}
+
+static double __json_half_float(unsigned int half)
+{
+	int exp = (half >> 10) & 0x1f;
+	int mant = half & 0x3ff;
+	double number;
+
+	if (exp == 0)
+		number = ldexp(mant, -24);
+	else if (exp != 31)
+		number = ldexp(mant + 1024, exp - 25);
+	else
+		number = mant == 0 ? INFINITY : NAN;
+
+	return half & 0x8000 ? -number : number;
+}
+
+/* Check a string of @len bytes at the cursor, which must not contain
+   '\0' to fit in a C string. */
+static int __decoder_check_string(struct __json_decoder *dec, size_t len)
+{
+	if ((size_t)(dec->end - dec->cursor) < len ||
+		memchr(dec->cursor, '\0', len))
+		return -2;
+
+	return 0;
+}
+
+static int __decoder_string(struct __json_decoder *dec, size_t len,
+							json_value_t *val)
+{
+	if (__decoder_check_string(dec, len) < 0)
+		return -2;
+
+	val->value.string = (char *)__json_malloc(len + 1, dec->allocator);
+	if (!val->value.string)
+		return -1;
+
+	memcpy(val->value.string, dec->cursor, len);
+	val->value.string[len] = '\0';
+	dec->cursor += len;
+	val->type = JSON_VALUE_STRING;
+	return 0;
+}
+
+static int __msgpack_decode_value(struct __json_decoder *dec, int depth,
+								  json_value_t *val);
+
+/* Containers hold at least one byte per item, which bounds @n. */
+static int __msgpack_decode_members(struct __json_decoder *dec, int depth,
+									size_t n, json_object_t *obj)
+{
+	unsigned long long len;
+	json_member_t *memb;
+	int tag;
+	int ret = 0;
+
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	INIT_LIST_HEAD(&obj->head);
+	obj->size = 0;
+	if (n > (size_t)(dec->end - dec->cursor))
+		return -2;
+
+	while (n-- != 0)
+	{
+		if (dec->cursor == dec->end)
+			ret = -2;
+		else
+		{
+			tag = *dec->cursor++;
+			if (tag >= 0xa0 && tag <= 0xbf)
+			{
+				len = tag & 0x1f;
+				ret = 0;
+			}
+			else if (tag >= 0xd9 && tag <= 0xdb)
+				ret = __decoder_get_be(dec, 1 << (tag - 0xd9), &len);
+			else
+				ret = -2;
+
+			if (ret >= 0)
+				ret = __decoder_check_string(dec, len);
+		}
+
+		if (ret < 0)
+			break;
+
+		memb = __json_member_alloc(len, dec->allocator);
+		if (!memb)
+		{
+			ret = -1;
+			break;
+		}
+
+		memcpy(memb->name, dec->cursor, len);
+		memb->name[len] = '\0';
+		dec->cursor += len;
+		ret = __msgpack_decode_value(dec, depth + 1, &memb->value);
+		if (ret < 0)
+		{
+			__json_member_free(memb, dec->allocator);
+			break;
+		}
+
+		list_add_tail(&memb->list, &obj->head);
+		obj->size++;
+	}
+
+	if (ret < 0)
+	{
+		__destroy_json_members(obj, dec->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __msgpack_decode_elements(struct __json_decoder *dec, int depth,
+									 size_t n, json_array_t *arr)
+{
+	json_element_t *elem;
+	int ret = 0;
+
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	INIT_LIST_HEAD(&arr->head);
+	arr->size = 0;
+	if (n > (size_t)(dec->end - dec->cursor))
+		return -2;
+
+	while (n-- != 0)
+	{
+		elem = __json_element_alloc(dec->allocator);
+		if (!elem)
+		{
+			ret = -1;
+			break;
+		}
+
+		ret = __msgpack_decode_value(dec, depth + 1, &elem->value);
+		if (ret < 0)
+		{
+			__json_element_free(elem, dec->allocator);
+			break;
+		}
+
+		list_add_tail(&elem->list, &arr->head);
+		arr->size++;
+	}
+
+	if (ret < 0)
+	{
+		__destroy_json_elements(arr, dec->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __msgpack_decode_value(struct __json_decoder *dec, int depth,
+								  json_value_t *val)
+{
+	unsigned long long n;
+	int tag;
+	int ret;
+
+	if (dec->cursor == dec->end)
+		return -2;
+
+	tag = *dec->cursor++;
+	val->allocator = dec->allocator;
+	val->flags = 0;
+	val->type = JSON_VALUE_NUMBER;
+	if (tag <= 0x7f)
+	{
+		val->value.number = tag;
+		return 0;
+	}
+
+	if (tag >= 0xe0)
+	{
+		val->value.number = tag - 0x100;
+		return 0;
+	}
+
+	if (tag >= 0x80 && tag <= 0x8f)
+	{
+		val->type = JSON_VALUE_OBJECT;
+		return __msgpack_decode_members(dec, depth, tag & 0x0f,
+										&val->value.object);
+	}
+
+	if (tag >= 0x90 && tag <= 0x9f)
+	{
+		val->type = JSON_VALUE_ARRAY;
+		return __msgpack_decode_elements(dec, depth, tag & 0x0f,
+										 &val->value.array);
+	}
+
+	if (tag >= 0xa0 && tag <= 0xbf)
+		return __decoder_string(dec, tag & 0x1f, val);
+
+	switch (tag)
+	{
+	case 0xc0:
+		val->type = JSON_VALUE_NULL;
+		return 0;
+
+	case 0xc2:
+		val->type = JSON_VALUE_FALSE;
+		return 0;
+
+	case 0xc3:
+		val->type = JSON_VALUE_TRUE;
+		return 0;
+
+	case 0xca:
+	case 0xcb:
+		ret = __decoder_get_be(dec, tag == 0xca ? 4 : 8, &n);
+		if (ret < 0)
+			return ret;
+
+		val->value.number = __json_float_bits(n, tag == 0xca ? 4 : 8);
+		return 0;
+
+	case 0xcc:
+	case 0xcd:
+	case 0xce:
+	case 0xcf:
+		ret = __decoder_get_be(dec, 1 << (tag - 0xcc), &n);
+		if (ret < 0)
+			return ret;
+
+		val->value.number = (double)n;
+		return 0;
+
+	case 0xd0:
+	case 0xd1:
+	case 0xd2:
+	case 0xd3:
+		ret = __decoder_get_be(dec, 1 << (tag - 0xd0), &n);
+		if (ret < 0)
+			return ret;
+
+		/* Sign extension. */
+		if (tag != 0xd3)
+			n |= 0 - (n & 1ULL << ((8 << (tag - 0xd0)) - 1));
+
+		val->value.number = n >> 63 ? -(double)(0 - n) : (double)n;
+		return 0;
+
+	case 0xd9:
+	case 0xda:
+	case 0xdb:
+		ret = __decoder_get_be(dec, 1 << (tag - 0xd9), &n);
+		if (ret < 0)
+			return ret;
+
+		return __decoder_string(dec, n, val);
+
+	case 0xdc:
+	case 0xdd:
+		ret = __decoder_get_be(dec, tag == 0xdc ? 2 : 4, &n);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_ARRAY;
+		return __msgpack_decode_elements(dec, depth, n, &val->value.array);
+
+	case 0xde:
+	case 0xdf:
+		ret = __decoder_get_be(dec, tag == 0xde ? 2 : 4, &n);
+		if (ret < 0)
+			return ret;
+
+		val->type = JSON_VALUE_OBJECT;
+		return __msgpack_decode_members(dec, depth, n, &val->value.object);
+
+	default:
+		/* Binaries, extensions and the unused 0xc1. */
+		return -2;
+	}
+}
+
+json_value_t *json_value_parse_msgpack(const void *buf, size_t size)
+{
+	struct __json_decoder dec;
+	json_value_t *val;
+
+	val = __json_value_alloc(NULL);
+	if (!val)
+		return NULL;
+
+	dec.cursor = (const unsigned char *)buf;
+	dec.end = dec.cursor + size;
+	dec.allocator = NULL;
+	if (__msgpack_decode_value(&dec, 0, val) >= 0)
+	{
+		if (dec.cursor == dec.end)
+			return val;
+
+		__destroy_json_value(val);
+	}
+
+	__json_value_free(val, NULL);
+	return NULL;
+}
+
+/* A CBOR head: the major type, and the argument in @n. Indefinite lengths
+   are returned as -1 with @n unset. */
+static int __cbor_get_head(struct __json_decoder *dec, int *major,
+						   unsigned long long *n)
+{
+	int info;
+
+	if (dec->cursor == dec->end)
+		return -2;
+
+	*major = *dec->cursor >> 5;
+	info = *dec->cursor++ & 0x1f;
+	if (info < 24)
+	{
+		*n = info;
+		return 0;
+	}
+
+	if (info <= 27)
+		return __decoder_get_be(dec, 1 << (info - 24), n);
+
+	if (info == 31 && *major >= 2 && *major <= 5)
+		return -1;
+
+	return -2;
+}
+
+/* Measure the text string after a head of @n or, when @n is NULL, an
+   indefinite one made of definite chunks. */
+static int __cbor_text_length(struct __json_decoder *dec,
+							  const unsigned long long *n, size_t *len)
+{
+	struct __json_decoder chunk = *dec;
+	unsigned long long size;
+	int major;
+
+	if (n)
+	{
+		*len = *n;
+		return __decoder_check_string(dec, *len);
+	}
+
+	*len = 0;
+	while (chunk.cursor != chunk.end && *chunk.cursor != 0xff)
+	{
+		if (__cbor_get_head(&chunk, &major, &size) != 0 || major != 3 ||
+			__decoder_check_string(&chunk, size) < 0)
+			return -2;
+
+		chunk.cursor += size;
+		*len += size;
+	}
+
+	return chunk.cursor != chunk.end ? 0 : -2;
+}
+
+/* Copy the text string measured by __cbor_text_length(). */
+static void __cbor_text_copy(struct __json_decoder *dec,
+							 const unsigned long long *n, char *str)
+{
+	unsigned long long size;
+	int major;
+
+	if (n)
+	{
+		memcpy(str, dec->cursor, *n);
+		str[*n] = '\0';
+		dec->cursor += *n;
+		return;
+	}
+
+	while (*dec->cursor != 0xff && __cbor_get_head(dec, &major, &size) == 0)
+	{
+		memcpy(str, dec->cursor, size);
+		str += size;
+		dec->cursor += size;
+	}
+
+	*str = '\0';
+	dec->cursor++;
+}
+
+/* The end of an indefinite container, or of @n items. */
+static int __cbor_more_items(struct __json_decoder *dec,
+							 const unsigned long long *n, size_t count)
+{
+	if (n)
+		return count < *n;
+
+	if (dec->cursor != dec->end && *dec->cursor == 0xff)
+	{
+		dec->cursor++;
+		return 0;
+	}
+
+	return 1;
+}
+
+static int __cbor_decode_value(struct __json_decoder *dec, int depth,
+							   json_value_t *val);
+
+static int __cbor_decode_members(struct __json_decoder *dec, int depth,
+								 const unsigned long long *n,
+								 json_object_t *obj)
+{
+	unsigned long long size;
+	json_member_t *memb;
+	size_t len;
+	int major;
+	int head;
+	int ret = 0;
+
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	INIT_LIST_HEAD(&obj->head);
+	obj->size = 0;
+	if (n && *n > (size_t)(dec->end - dec->cursor))
+		return -2;
+
+	while (__cbor_more_items(dec, n, obj->size))
+	{
+		head = __cbor_get_head(dec, &major, &size);
+		if (head < -1 || major != 3)
+		{
+			ret = -2;
+			break;
+		}
+
+		ret = __cbor_text_length(dec, head == 0 ? &size : NULL, &len);
+		if (ret < 0)
+			break;
+
+		memb = __json_member_alloc(len, dec->allocator);
+		if (!memb)
+		{
+			ret = -1;
+			break;
+		}
+
+		__cbor_text_copy(dec, head == 0 ? &size : NULL, memb->name);
+		ret = __cbor_decode_value(dec, depth + 1, &memb->value);
+		if (ret < 0)
+		{
+			__json_member_free(memb, dec->allocator);
+			break;
+		}
+
+		list_add_tail(&memb->list, &obj->head);
+		obj->size++;
+	}
+
+	if (ret < 0)
+	{
+		__destroy_json_members(obj, dec->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __cbor_decode_elements(struct __json_decoder *dec, int depth,
+								  const unsigned long long *n,
+								  json_array_t *arr)
+{
+	json_element_t *elem;
+	int ret = 0;
+
+	if (depth == JSON_DEPTH_LIMIT)
+		return -3;
+
+	INIT_LIST_HEAD(&arr->head);
+	arr->size = 0;
+	if (n && *n > (size_t)(dec->end - dec->cursor))
+		return -2;
+
+	while (__cbor_more_items(dec, n, arr->size))
+	{
+		elem = __json_element_alloc(dec->allocator);
+		if (!elem)
+		{
+			ret = -1;
+			break;
+		}
+
+		ret = __cbor_decode_value(dec, depth + 1, &elem->value);
+		if (ret < 0)
+		{
+			__json_element_free(elem, dec->allocator);
+			break;
+		}
+
+		list_add_tail(&elem->list, &arr->head);
+		arr->size++;
+	}
+
+	if (ret < 0)
+	{
+		__destroy_json_elements(arr, dec->allocator);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int __cbor_decode_value(struct __json_decoder *dec, int depth,
+							   json_value_t *val)
+{
+	const unsigned long long *len;
+	unsigned long long n;
+	size_t size;
+	int major;
+	int info;
+	int head;
+	int ret;
+
+	if (dec->cursor == dec->end)
+		return -2;
+
+	info = *dec->cursor & 0x1f;
+	head = __cbor_get_head(dec, &major, &n);
+	if (head < -1)
+		return head;
+
+	len = head == 0 ? &n : NULL;
+	val->allocator = dec->allocator;
+	val->flags = 0;
+	switch (major)
+	{
+	case 0:
+		val->type = JSON_VALUE_NUMBER;
+		val->value.number = (double)n;
+		return 0;
+
+	case 1:
+		val->type = JSON_VALUE_NUMBER;
+		val->value.number = -1.0 - (double)n;
+		return 0;
+
+	case 3:
+		ret = __cbor_text_length(dec, len, &size);
+		if (ret < 0)
+			return ret;
+
+		val->value.string = (char *)__json_malloc(size + 1, dec->allocator);
+		if (!val->value.string)
+			return -1;
+
+		__cbor_text_copy(dec, len, val->value.string);
+		val->type = JSON_VALUE_STRING;
+		return 0;
+
+	case 4:
+		val->type = JSON_VALUE_ARRAY;
+		return __cbor_decode_elements(dec, depth, len, &val->value.array);
+
+	case 5:
+		val->type = JSON_VALUE_OBJECT;
+		return __cbor_decode_members(dec, depth, len, &val->value.object);
+
+	case 6:
+		/* Tags only annotate the item that follows. */
+		if (depth == JSON_DEPTH_LIMIT)
+			return -3;
+
+		return __cbor_decode_value(dec, depth + 1, val);
+
+	case 7:
+		break;
+
+	default:
+		/* Byte strings. */
+		return -2;
+	}
+
+	switch (info)
+	{
+	case 20:
+		val->type = JSON_VALUE_FALSE;
+		return 0;
+
+	case 21:
+		val->type = JSON_VALUE_TRUE;
+		return 0;
+
+	case 22:
+	case 23:
+		/* Null and undefined. */
+		val->type = JSON_VALUE_NULL;
+		return 0;
+
+	case 25:
+		val->value.number = __json_half_float((unsigned int)n);
+		break;
+
+	case 26:
+		val->value.number = __json_float_bits(n, 4);
+		break;
+
+	case 27:
+		val->value.number = __json_float_bits(n, 8);
+		break;
+
+	default:
+		return -2;
+	}
+
+	val->type = JSON_VALUE_NUMBER;
+	return 0;
+}
+
+json_value_t *json_value_parse_cbor(const void *buf, size_t size)
+{
+	struct __json_decoder dec;
+	json_value_t *val;
+
+	val = __json_value_alloc(NULL);
+	if (!val)
+		return NULL;
+
+	dec.cursor = (const unsigned char *)buf;
+	dec.end = dec.cursor + size;
+	dec.allocator = NULL;
+	if (__cbor_decode_value(&dec, 0, val) >= 0)
+	{
+		if (dec.cursor == dec.end)
+			return val;
+
+		__destroy_json_value(val);
+	}
+
+	__json_value_free(val, NULL);
+	return NULL;
+}
+
+static json_member_t *__json_member_find(const char *name,
+										 const json_object_t *obj,
+										 struct __json_index *index)
+{
+	struct __json_index_slot *slot;
+	const json_value_t *val;
+
+	if (index)
+	{
+		slot = __json_index_find(index, name);
+		return slot ? slot->memb : NULL;
+	}
+
+	val = json_object_find(name, obj);
+	return val ? list_entry(val, json_member_t, value) : NULL;
+}
+
+static int __json_value_equal(const json_value_t *a, const json_value_t *b,
+							  int ordered);
+
+/* The @n-th member named @name in @obj, counting from 0. */
+static const json_member_t *__json_member_nth(const char *name, size_t n,
+											  const json_object_t *obj)
+{
+	struct list_head *pos;
+	json_member_t *memb;
+
+	list_for_each(pos, &obj->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		if (strcmp(memb->name, name) == 0 && n-- == 0)
+			return memb;
+	}
+
+	return NULL;
+}
+
+/* Members are compared pairwise as long as the names come in the same
+   order, and looked up by name from there on. Each member of @b matches
+   once, so duplicate names pair up in their order. */
+static int __json_object_equal(const json_object_t *a, const json_object_t *b)
+{
+	struct list_head *pos, *pos2;
+	struct __json_index_slot *slot;
+	struct __json_index index;
+	const json_member_t *memb;
+	const json_member_t *memb2;
+	int indexed = 0;
+	int ret = 1;
+	size_t n;
+
+	if (a->size != b->size)
+		return 0;
+
+	pos2 = b->head.next;
+	list_for_each(pos, &a->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		memb2 = list_entry(pos2, json_member_t, list);
+		if (strcmp(memb->name, memb2->name) != 0)
+			break;
+
+		if (!__json_value_equal(&memb->value, &memb2->value, 0))
+			return 0;
+
+		pos2 = pos2->next;
+	}
+
+	if (pos == &a->head)
+		return 1;
+
+	/* An index refuses duplicate names, leaving them to the linear way. */
+	if (b->size >= JSON_INDEX_MIN)
+		indexed = __json_index_create(b, 0, __json_object_allocator(b),
+									  &index) >= 0;
+
+	for (; pos != &a->head; pos = pos->next)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		if (indexed)
+		{
+			slot = __json_index_find(&index, memb->name);
+			memb2 = slot ? slot->memb : NULL;
+			if (slot)
+				slot->memb = JSON_INDEX_REMOVED;
+		}
+		else
+		{
+			n = 0;
+			for (pos2 = a->head.next; pos2 != pos; pos2 = pos2->next)
+			{
+				if (strcmp(list_entry(pos2, json_member_t, list)->name,
+						   memb->name) == 0)
+					n++;
+			}
+
+			memb2 = __json_member_nth(memb->name, n, b);
+		}
+
+		if (!memb2 || !__json_value_equal(&memb->value, &memb2->value, 0))
+		{
+			ret = 0;
+			break;
+		}
+	}
+
+	if (indexed)
+		__json_index_destroy(&index);
+
+	return ret;
+}
+
+static int __json_object_equal_ordered(const json_object_t *a,
+									   const json_object_t *b)
+{
+	struct list_head *pos, *pos2;
+	const json_member_t *memb;
+	const json_member_t *memb2;
+
+	if (a->size != b->size)
+		return 0;
+
+	pos2 = b->head.next;
+	list_for_each(pos, &a->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		memb2 = list_entry(pos2, json_member_t, list);
+		if (strcmp(memb->name, memb2->name) != 0 ||
+			!__json_value_equal(&memb->value, &memb2->value, 1))
+			return 0;
+
+		pos2 = pos2->next;
+	}
+
+	return 1;
+}
+
+static int __json_value_equal(const json_value_t *a, const json_value_t *b,
+							  int ordered)
+{
+	struct list_head *pos, *pos2;
+
+	if (a->type != b->type)
+		return 0;
+
+	if (a == b)
+		return 1;
+
+#ifdef JSON_PARSER_DIGEST
+	if ((a->flags & b->flags & JSON_FLAG_DIGEST) && a->digest != b->digest)
+		return 0;
+#endif
+
+	switch (a->type)
+	{
+	case JSON_VALUE_STRING:
+		return strcmp(a->value.string, b->value.string) == 0;
+
+	case JSON_VALUE_NUMBER:
+		return __json_number_value(a) == __json_number_value(b);
+
+	case JSON_VALUE_OBJECT:
+		if (ordered)
+			return __json_object_equal_ordered(&a->value.object,
+											   &b->value.object);
+
+		return __json_object_equal(&a->value.object, &b->value.object);
+
+	case JSON_VALUE_ARRAY:
+		if (a->value.array.size != b->value.array.size)
+			return 0;
+
+		pos2 = b->value.array.head.next;
+		list_for_each(pos, &a->value.array.head)
 		{
-			cursor++;
-			while (isspace(*cursor))
-				cursor++;
+			if (!__json_value_equal(&list_entry(pos, json_element_t, list)->value,
+									&list_entry(pos2, json_element_t, list)->value,
+									ordered))
+				return 0;
+
+			pos2 = pos2->next;
 		}
-		else if (*cursor == ']')
-			break;
-		else
-			return -2;
+
+		return 1;
 	}
 
-	*end = cursor + 1;
-	return 0;
+	return 1;
 }
 
-static void __destroy_json_elements(json_array_t *arr)
+int json_value_equal(const json_value_t *a, const json_value_t *b)
 {
-	struct list_head *pos, *tmp;
-	json_element_t *elem;
-
-	list_for_each_safe(pos, tmp, &arr->head)
-	{
-		elem = list_entry(pos, json_element_t, list);
-		__destroy_json_value(&elem->value);
-		free(elem);
-	}
+	return __json_value_equal(a, b, 0);
 }
 
-static int __parse_json_array(const char *cursor, const char **end,
-							  int depth, json_array_t *arr)
+int json_value_equal_ordered(const json_value_t *a, const json_value_t *b)
 {
-	int ret;
+	return __json_value_equal(a, b, 1);
+}
 
-	if (depth == JSON_DEPTH_LIMIT)
-		return -3;
+/* A merge patch object that isn't merged into another object is a value
+   of its own, less its null members. */
+static void __strip_json_nulls(json_value_t *val)
+{
+	struct list_head *pos, *tmp;
+	json_member_t *memb;
 
-	INIT_LIST_HEAD(&arr->head);
-	arr->size = 0;
-	ret = __parse_json_elements(cursor, end, depth + 1, arr);
-	if (ret < 0)
+	list_for_each_safe(pos, tmp, &val->value.object.head)
 	{
-		__destroy_json_elements(arr);
-		return ret;
+		memb = list_entry(pos, json_member_t, list);
+		if (memb->value.type == JSON_VALUE_NULL)
+		{
+			list_del(&memb->list);
+			val->value.object.size--;
+			__json_member_free(memb, val->allocator);
+		}
+		else if (memb->value.type == JSON_VALUE_OBJECT)
+			__strip_json_nulls(&memb->value);
 	}
-
-	return 0;
 }
 
-static int __parse_json_value(const char *cursor, const char **end,
-							  int depth, json_value_t *val)
+/* Merge the members of object @patch into object @val. Members that
+   aren't merged further are moved, not copied: a member node of the patch
+   is relinked into @val when both use the same allocator. */
+static int __merge_json_patch(json_value_t *val, json_value_t *patch)
 {
-	size_t escape;
-	size_t len;
-	int ret;
+	json_object_t *obj = &val->value.object;
+	struct __json_index_slot *slot = NULL;
+	struct list_head *pos, *tmp;
+	struct __json_index index;
+	const json_value_t *found;
+	json_member_t *pmemb;
+	json_member_t *memb;
+	int indexed = 0;
+	int ret = 0;
 
-	switch (*cursor)
+	if (val->flags & JSON_FLAG_FROZEN)
+		return -1;
+
+	if (obj->size >= JSON_INDEX_MIN && patch->value.object.size > 1)
+		indexed = __json_index_create(obj, patch->value.object.size,
+									  val->allocator, &index) >= 0;
+
+	list_for_each_safe(pos, tmp, &patch->value.object.head)
 	{
-	case '\"':
-		cursor++;
-		ret = __json_string_length(cursor, &escape, &len);
-		if (ret < 0)
-			return ret;
+		pmemb = list_entry(pos, json_member_t, list);
+		if (indexed)
+		{
+			slot = __json_index_find(&index, pmemb->name);
+			memb = slot ? slot->memb : NULL;
+		}
+		else
+		{
+			found = json_object_find(pmemb->name, obj);
+			memb = found ? list_entry(found, json_member_t, value) : NULL;
+		}
 
-		val->value.string = (char *)malloc(len + 1);
-		if (!val->value.string)
-			return -1;
+		if (pmemb->value.type == JSON_VALUE_NULL)
+		{
+			if (memb)
+			{
+				list_del(&memb->list);
+				obj->size--;
+				__destroy_json_value(&memb->value);
+				__json_member_free(memb, val->allocator);
+				if (slot)
+					slot->memb = JSON_INDEX_REMOVED;
+			}
 
-		if (escape != 0)
+			continue;
+		}
+
+		if (memb)
 		{
-			ret = __parse_json_string(cursor, end, escape, val->value.string);
-			if (ret < 0)
+			if (memb->value.type == JSON_VALUE_OBJECT &&
+				pmemb->value.type == JSON_VALUE_OBJECT)
 			{
-				free(val->value.string);
-				return ret;
+				ret = __merge_json_patch(&memb->value, &pmemb->value);
+				if (ret < 0)
+					break;
+
+				continue;
 			}
+
+			__destroy_json_value(&memb->value);
+			__move_json_value(&pmemb->value, &memb->value);
+			list_del(&pmemb->list);
+			patch->value.object.size--;
+			__json_member_free(pmemb, patch->allocator);
+		}
+		else if (patch->allocator == val->allocator)
+		{
+			list_move(&pmemb->list, __json_object_tail(pmemb->name, obj));
+			patch->value.object.size--;
+			obj->size++;
+			memb = pmemb;
 		}
 		else
 		{
-			memcpy(val->value.string, cursor, len);
-			val->value.string[len] = '\0';
-			*end = cursor + len + 1;
+			memb = __json_member_alloc(strlen(pmemb->name), val->allocator);
+			if (!memb)
+			{
+				ret = -1;
+				break;
+			}
+
+			strcpy(memb->name, pmemb->name);
+			__move_json_value(&pmemb->value, &memb->value);
+			list_del(&pmemb->list);
+			patch->value.object.size--;
+			__json_member_free(pmemb, patch->allocator);
+			list_add(&memb->list, __json_object_tail(memb->name, obj));
+			obj->size++;
 		}
 
-		val->type = JSON_VALUE_STRING;
-		break;
+		if (indexed)
+			__json_index_add(&index, memb);
 
-	case '-':
-	case '0':
-	case '1':
-	case '2':
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':
-		ret = __parse_json_number(cursor, end, &val->value.number);
-		if (ret < 0)
-			return ret;
+		if (memb->value.type == JSON_VALUE_OBJECT)
+			__strip_json_nulls(&memb->value);
+	}
 
-		val->type = JSON_VALUE_NUMBER;
-		break;
+	if (indexed)
+		__json_index_destroy(&index);
 
-	case '{':
-		cursor++;
-		ret = __parse_json_object(cursor, end, depth, &val->value.object);
-		if (ret < 0)
-			return ret;
+	return ret;
+}
 
-		val->type = JSON_VALUE_OBJECT;
-		break;
+/* The node of a root value is freed with its contents' allocator. When
+   another allocator's contents have to replace them, they are copied node
+   by node instead of being moved. */
+static int __clone_json_value(const json_value_t *src,
+							  const json_allocator_t *allocator,
+							  json_value_t *dest)
+{
+	struct list_head *pos;
+	json_member_t *entry;
+	json_member_t *memb;
+	json_element_t *elem;
+	size_t len;
 
-	case '[':
-		cursor++;
-		ret = __parse_json_array(cursor, end, depth, &val->value.array);
-		if (ret < 0)
-			return ret;
+	dest->allocator = allocator;
+	dest->flags = src->flags & (JSON_FLAG_SORTED | JSON_FLAG_RAW |
+								JSON_FLAG_LAZY);
+	switch (src->type)
+	{
+	case JSON_VALUE_STRING:
+		len = strlen(src->value.string);
+		dest->value.string = (char *)__json_malloc(len + 1, allocator);
+		if (!dest->value.string)
+			return -1;
 
-		val->type = JSON_VALUE_ARRAY;
+		memcpy(dest->value.string, src->value.string, len + 1);
 		break;
 
-	case 't':
-		if (strncmp(cursor, "true", 4) != 0)
-			return -2;
+	case JSON_VALUE_NUMBER:
+		if (src->flags & JSON_FLAG_RAW)
+		{
+			len = strlen(src->value.raw);
+			dest->value.raw = (char *)__json_malloc(len + 1, allocator);
+			if (!dest->value.raw)
+				return -1;
+
+			memcpy(dest->value.raw, src->value.raw, len + 1);
+		}
+		else
+			dest->value = src->value;
 
-		*end = cursor + 4;
-		val->type = JSON_VALUE_TRUE;
 		break;
 
-	case 'f':
-		if (strncmp(cursor, "false", 5) != 0)
-			return -2;
+	case JSON_VALUE_OBJECT:
+		INIT_LIST_HEAD(&dest->value.object.head);
+		dest->value.object.size = 0;
+		list_for_each(pos, &src->value.object.head)
+		{
+			entry = list_entry(pos, json_member_t, list);
+			len = strlen(entry->name);
+			memb = __json_member_alloc(len, allocator);
+			if (!memb)
+				break;
 
-		*end = cursor + 5;
-		val->type = JSON_VALUE_FALSE;
-		break;
+			memcpy(memb->name, entry->name, len + 1);
+			if (__clone_json_value(&entry->value, allocator, &memb->value) < 0)
+			{
+				__json_member_free(memb, allocator);
+				break;
+			}
 
-	case 'n':
-		if (strncmp(cursor, "null", 4) != 0)
-			return -2;
+			list_add_tail(&memb->list, &dest->value.object.head);
+			dest->value.object.size++;
+		}
+
+		if (dest->value.object.size != src->value.object.size)
+		{
+			__destroy_json_members(&dest->value.object, allocator);
+			return -1;
+		}
 
-		*end = cursor + 4;
-		val->type = JSON_VALUE_NULL;
 		break;
 
-	default:
-		return -2;
+	case JSON_VALUE_ARRAY:
+		INIT_LIST_HEAD(&dest->value.array.head);
+		dest->value.array.size = 0;
+		list_for_each(pos, &src->value.array.head)
+		{
+			elem = __json_element_alloc(allocator);
+			if (!elem)
+				break;
+
+			if (__clone_json_value(&list_entry(pos, json_element_t, list)->value,
+								   allocator, &elem->value) < 0)
+			{
+				__json_element_free(elem, allocator);
+				break;
+			}
+
+			list_add_tail(&elem->list, &dest->value.array.head);
+			dest->value.array.size++;
+		}
+
+		if (dest->value.array.size != src->value.array.size)
+		{
+			__destroy_json_elements(&dest->value.array, allocator);
+			return -1;
+		}
+
+		break;
 	}
 
+	dest->type = src->type;
 	return 0;
 }
 
-static void __destroy_json_value(json_value_t *val)
+/* Replace the contents of root value @root with those of @src, which are
+   moved if both use the same allocator. */
+static int __json_replace_root(json_value_t *root, json_value_t *src)
 {
-	switch (val->type)
-	{
-	case JSON_VALUE_STRING:
-		free(val->value.string);
-		break;
+	json_value_t tmp;
 
-	case JSON_VALUE_OBJECT:
-		__destroy_json_members(&val->value.object);
-		break;
+	if (src->allocator == root->allocator)
+		__move_json_value(src, &tmp);
+	else if (__clone_json_value(src, root->allocator, &tmp) >= 0)
+		__destroy_json_value(src);
+	else
+		return -1;
 
-	case JSON_VALUE_ARRAY:
-		__destroy_json_elements(&val->value.array);
-		break;
-	}
+	__destroy_json_value(root);
+	__move_json_value(&tmp, root);
+	src->type = JSON_VALUE_NULL;
+	return 0;
 }
 
-json_value_t *json_value_parse(const char *cursor)
+int json_value_merge_patch(json_value_t *val, json_value_t *patch)
 {
-	json_value_t *val;
+	int ret = 0;
 
-	val = (json_value_t *)malloc(sizeof (json_value_t));
-	if (!val)
-		return NULL;
+	if ((val->flags & JSON_FLAG_FROZEN) || patch->refs != 1)
+		return -1;
 
-	while (isspace(*cursor))
-		cursor++;
+	patch = __json_batch_adopt(patch, val->allocator);
+	if (!patch)
+		return -1;
 
-	if (__parse_json_value(cursor, &cursor, 0, val) >= 0)
+	if (patch->type != JSON_VALUE_OBJECT || val->type != JSON_VALUE_OBJECT)
 	{
-		while (isspace(*cursor))
-			cursor++;
+		ret = __json_replace_root(val, patch);
+		if (ret >= 0 && val->type == JSON_VALUE_OBJECT)
+			__strip_json_nulls(val);
+	}
+	else
+		ret = __merge_json_patch(val, patch);
 
-		if (*cursor == '\0')
-			return val;
+	json_value_destroy(patch);
+	return ret;
+}
 
-		__destroy_json_value(val);
+/* Decode the JSON Pointer token at @*cursor in place. @*cursor is moved
+   to the next token, or set to NULL after the last one. */
+static int __json_pointer_token(char **cursor, char **token)
+{
+	char *p = *cursor;
+	char *q = p;
+
+	*token = p;
+	while (*p != '/' && *p != '\0')
+	{
+		if (*p == '~')
+		{
+			p++;
+			if (*p == '0')
+				*q = '~';
+			else if (*p == '1')
+				*q = '/';
+			else
+				return -2;
+		}
+		else
+			*q = *p;
+
+		p++;
+		q++;
 	}
 
-	free(val);
-	return NULL;
+	*cursor = *p == '/' ? p + 1 : NULL;
+	*q = '\0';
+	return 0;
 }
 
-static void __move_json_value(json_value_t *src, json_value_t *dest)
+static int __json_pointer_index(const char *token, size_t *index)
 {
-	switch (src->type)
-	{
-	case JSON_VALUE_STRING:
-		dest->value.string = src->value.string;
-		break;
+	size_t n = 0;
 
-	case JSON_VALUE_NUMBER:
-		dest->value.number = src->value.number;
-		break;
+	if (!isdigit(*token) || (*token == '0' && token[1] != '\0'))
+		return -1;
 
-	case JSON_VALUE_OBJECT:
-		INIT_LIST_HEAD(&dest->value.object.head);
-		list_splice(&src->value.object.head, &dest->value.object.head);
-		dest->value.object.size = src->value.object.size;
-		break;
+	do
+	{
+		if (n > ((size_t)-1 - 9) / 10)
+			return -1;
 
-	case JSON_VALUE_ARRAY:
-		INIT_LIST_HEAD(&dest->value.array.head);
-		list_splice(&src->value.array.head, &dest->value.array.head);
-		dest->value.array.size = src->value.array.size;
-		break;
-	}
+		n = n * 10 + (*token - '0');
+		token++;
+	} while (isdigit(*token));
 
-	dest->type = src->type;
+	if (*token != '\0')
+		return -1;
+
+	*index = n;
+	return 0;
 }
 
-static int __set_json_value(int type, va_list ap, json_value_t *val)
+static json_element_t *__json_array_at(const json_array_t *arr, size_t index)
 {
-	json_value_t *src;
-	const char *str;
-	size_t len;
+	struct list_head *pos;
+	size_t i;
 
-	switch (type)
+	if (index < arr->size / 2)
 	{
-	case 0:
-		src = va_arg(ap, json_value_t *);
-		__move_json_value(src, val);
-		free(src);
-		return 0;
-
-	case JSON_VALUE_STRING:
-		str = va_arg(ap, const char *);
-		len = strlen(str);
-		val->value.string = (char *)malloc(len + 1);
-		if (!val->value.string)
-			return -1;
+		pos = arr->head.next;
+		for (i = 0; i < index; i++)
+			pos = pos->next;
+	}
+	else
+	{
+		pos = arr->head.prev;
+		for (i = arr->size - 1; i > index; i--)
+			pos = pos->prev;
+	}
 
-		memcpy(val->value.string, str, len + 1);
-		break;
+	return list_entry(pos, json_element_t, list);
+}
 
-	case JSON_VALUE_NUMBER:
-		val->value.number = va_arg(ap, double);
-		break;
+static json_value_t *__json_pointer_child(json_value_t *val,
+										  const char *token)
+{
+	size_t index;
 
+	switch (val->type)
+	{
 	case JSON_VALUE_OBJECT:
-		INIT_LIST_HEAD(&val->value.object.head);
-		val->value.object.size = 0;
-		break;
+		return (json_value_t *)json_object_find(token, &val->value.object);
 
 	case JSON_VALUE_ARRAY:
-		INIT_LIST_HEAD(&val->value.array.head);
-		val->value.array.size = 0;
-		break;
+		if (__json_pointer_index(token, &index) < 0 ||
+			index >= val->value.array.size)
+			return NULL;
+
+		return &__json_array_at(&val->value.array, index)->value;
 	}
 
-	val->type = type;
-	return 0;
+	return NULL;
 }
 
-json_value_t *json_value_create(int type, ...)
+/* Resolve all but the last token of @path, which is decoded in place.
+   @*parent is set to NULL if @path refers to the whole document. */
+static int __json_pointer_parent(json_value_t *root, char *path,
+								 json_value_t **parent, char **token)
 {
-	json_value_t *val;
-	va_list ap;
-	int ret;
+	json_value_t *val = root;
+	char *cursor = path + 1;
 
-	val = (json_value_t *)malloc(sizeof (json_value_t));
-	if (!val)
-		return NULL;
+	*parent = NULL;
+	if (*path == '\0')
+		return 0;
 
-	va_start(ap, type);
-	ret = __set_json_value(type, ap, val);
-	va_end(ap);
-	if (ret >= 0)
-		return val;
+	if (*path != '/')
+		return -2;
 
-	free(val);
-	return NULL;
-}
+	while (1)
+	{
+		if (__json_pointer_token(&cursor, token) < 0)
+			return -2;
+
+		if (!cursor)
+			break;
+
+		val = __json_pointer_child(val, *token);
+		if (!val)
+			return -3;
+	}
 
-static int __copy_json_value(const json_value_t *src, json_value_t *dest);
+	*parent = val;
+	return 0;
+}
 
-static int __copy_json_members(const json_object_t *src, json_object_t *dest)
+/* Move the contents of @src to @token of @parent, or over the whole
+   document @root. With @replace the location must exist. On success @src
+   is left as null. */
+static int __json_patch_put(json_value_t *root, json_value_t *parent,
+							const char *token, int replace,
+							json_value_t *src)
 {
-	struct list_head *pos;
-	json_member_t *entry;
 	json_member_t *memb;
-	size_t len;
-	int ret;
+	json_element_t *elem;
+	json_value_t *val;
+	struct list_head *pos;
+	size_t index;
 
-	list_for_each(pos, &src->head)
-	{
-		entry = list_entry(pos, json_member_t, list);
-		len = strlen(entry->name);
-		memb = (json_member_t *)malloc(offsetof(json_member_t, name) + len + 1);
-		if (!memb)
-			return -1;
+	if (!parent)
+		return __json_replace_root(root, src);
 
-		ret = __copy_json_value(&entry->value, &memb->value);
-		if (ret < 0)
+	if (parent->flags & JSON_FLAG_FROZEN)
+		return -1;
+
+	if (parent->type == JSON_VALUE_OBJECT)
+	{
+		val = (json_value_t *)json_object_find(token, &parent->value.object);
+		if (!val)
 		{
-			free(memb);
-			return ret;
+			if (replace)
+				return -3;
+
+			memb = __json_member_alloc(strlen(token), parent->allocator);
+			if (!memb)
+				return -1;
+
+			strcpy(memb->name, token);
+			list_add(&memb->list,
+					 __json_object_tail(token, &parent->value.object));
+			parent->value.object.size++;
+			val = &memb->value;
+			val->type = JSON_VALUE_NULL;
+			val->flags = 0;
 		}
+	}
+	else if (parent->type == JSON_VALUE_ARRAY)
+	{
+		if (!replace && strcmp(token, "-") == 0)
+			index = parent->value.array.size;
+		else if (__json_pointer_index(token, &index) < 0 ||
+				 index + replace > parent->value.array.size)
+			return -3;
+
+		if (replace)
+			val = &__json_array_at(&parent->value.array, index)->value;
+		else
+		{
+			if (index < parent->value.array.size)
+				pos = &__json_array_at(&parent->value.array, index)->list;
+			else
+				pos = &parent->value.array.head;
 
-		memcpy(memb->name, entry->name, len + 1);
-		list_add_tail(&memb->list, &dest->head);
-		dest->size++;
+			elem = __json_element_alloc(parent->allocator);
+			if (!elem)
+				return -1;
+
+			list_add_tail(&elem->list, pos);
+			parent->value.array.size++;
+			val = &elem->value;
+			val->type = JSON_VALUE_NULL;
+			val->flags = 0;
+		}
 	}
+	else
+		return -3;
 
+	__destroy_json_value(val);
+	__move_json_value(src, val);
+	src->type = JSON_VALUE_NULL;
 	return 0;
 }
 
-static int __copy_json_elements(const json_array_t *src, json_array_t *dest)
+/* Detach the value at @token of @parent. Its contents are moved to @dest,
+   or destroyed if @dest is NULL. */
+static int __json_patch_take(json_value_t *parent, const char *token,
+							 json_value_t *dest)
 {
-	struct list_head *pos;
-	json_element_t *entry;
+	json_member_t *memb;
 	json_element_t *elem;
-	int ret;
+	json_value_t *val;
 
-	list_for_each(pos, &src->head)
-	{
-		elem = (json_element_t *)malloc(sizeof (json_element_t));
-		if (!elem)
-			return -1;
+	if (!parent)
+		return -3;
 
-		entry = list_entry(pos, json_element_t, list);
-		ret = __copy_json_value(&entry->value, &elem->value);
-		if (ret < 0)
-		{
-			free(elem);
-			return ret;
-		}
+	if (parent->flags & JSON_FLAG_FROZEN)
+		return -1;
+
+	val = __json_pointer_child(parent, token);
+	if (!val)
+		return -3;
 
-		list_add_tail(&elem->list, &dest->head);
-		dest->size++;
+	if (dest)
+		__move_json_value(val, dest);
+	else
+		__destroy_json_value(val);
+
+	if (parent->type == JSON_VALUE_OBJECT)
+	{
+		memb = list_entry(val, json_member_t, value);
+		list_del(&memb->list);
+		parent->value.object.size--;
+		__json_member_free(memb, parent->allocator);
+	}
+	else
+	{
+		elem = list_entry(val, json_element_t, value);
+		list_del(&elem->list);
+		parent->value.array.size--;
+		__json_element_free(elem, parent->allocator);
 	}
 
 	return 0;
 }
 
-static int __copy_json_value(const json_value_t *src, json_value_t *dest)
+static json_value_t *__json_patch_member(const json_value_t *op,
+										 const char *name, int type)
+{
+	const json_value_t *val = json_object_find(name, &op->value.object);
+
+	if (val && type && val->type != type)
+		return NULL;
+
+	return (json_value_t *)val;
+}
+
+static int __apply_json_patch_op(json_value_t *root, json_value_t *op)
 {
+	json_value_t *parent;
+	json_value_t *value;
+	json_value_t *from;
+	json_value_t *path;
+	json_value_t *copy;
+	json_value_t tmp;
+	const char *name;
+	char *token;
 	size_t len;
 	int ret;
 
-	switch (src->type)
-	{
-	case JSON_VALUE_STRING:
-		len = strlen(src->value.string);
-		dest->value.string = (char *)malloc(len + 1);
-		if (!dest->value.string)
-			return -1;
+	if (op->type != JSON_VALUE_OBJECT)
+		return -2;
 
-		memcpy(dest->value.string, src->value.string, len + 1);
-		break;
+	value = __json_patch_member(op, "op", JSON_VALUE_STRING);
+	path = __json_patch_member(op, "path", JSON_VALUE_STRING);
+	if (!value || !path)
+		return -2;
 
-	case JSON_VALUE_NUMBER:
-		dest->value.number = src->value.number;
-		break;
+	name = value->value.string;
+	if (strcmp(name, "add") == 0 || strcmp(name, "replace") == 0 ||
+		strcmp(name, "test") == 0)
+	{
+		value = __json_patch_member(op, "value", 0);
+		if (!value)
+			return -2;
 
-	case JSON_VALUE_OBJECT:
-		INIT_LIST_HEAD(&dest->value.object.head);
-		dest->value.object.size = 0;
-		ret = __copy_json_members(&src->value.object, &dest->value.object);
+		ret = __json_pointer_parent(root, path->value.string, &parent, &token);
 		if (ret < 0)
-		{
-			__destroy_json_members(&dest->value.object);
 			return ret;
-		}
 
-		break;
+		if (name[0] != 't')
+			return __json_patch_put(root, parent, token, name[0] == 'r', value);
 
-	case JSON_VALUE_ARRAY:
-		INIT_LIST_HEAD(&dest->value.array.head);
-		dest->value.array.size = 0;
-		ret = __copy_json_elements(&src->value.array, &dest->value.array);
+		from = parent ? __json_pointer_child(parent, token) : root;
+		if (!from || !__json_value_equal(from, value, 0))
+			return -3;
+
+		return 0;
+	}
+
+	if (strcmp(name, "remove") == 0)
+	{
+		ret = __json_pointer_parent(root, path->value.string, &parent, &token);
 		if (ret < 0)
-		{
-			__destroy_json_elements(&dest->value.array);
 			return ret;
-		}
 
-		break;
+		return __json_patch_take(parent, token, NULL);
 	}
 
-	dest->type = src->type;
-	return 0;
-}
+	if (strcmp(name, "move") != 0 && strcmp(name, "copy") != 0)
+		return -2;
 
-json_value_t *json_value_copy(const json_value_t *val)
-{
-	json_value_t *copy;
+	from = __json_patch_member(op, "from", JSON_VALUE_STRING);
+	if (!from)
+		return -2;
 
-	copy = (json_value_t *)malloc(sizeof (json_value_t));
-	if (!copy)
-		return NULL;
+	/* A value can't be moved into one of its own children. */
+	len = strlen(from->value.string);
+	if (name[0] == 'm' &&
+		strncmp(path->value.string, from->value.string, len) == 0 &&
+		(path->value.string[len] == '/' || path->value.string[len] == '\0'))
+	{
+		if (path->value.string[len] == '/')
+			return -3;
 
-	if (__copy_json_value(val, copy) >= 0)
-		return copy;
+		ret = __json_pointer_parent(root, from->value.string, &parent, &token);
+		if (ret < 0)
+			return ret;
 
-	free(copy);
-	return NULL;
-}
+		return !parent || __json_pointer_child(parent, token) ? 0 : -3;
+	}
 
-void json_value_destroy(json_value_t *val)
-{
-	__destroy_json_value(val);
-	free(val);
-}
+	ret = __json_pointer_parent(root, from->value.string, &parent, &token);
+	if (ret < 0)
+		return ret;
 
-int json_value_type(const json_value_t *val)
-{
-	return val->type;
-}
+	if (name[0] == 'm')
+	{
+		ret = __json_patch_take(parent, token, &tmp);
+		if (ret < 0)
+			return ret;
 
-const char *json_value_string(const json_value_t *val)
-{
-	if (val->type != JSON_VALUE_STRING)
-		return NULL;
+		ret = __json_pointer_parent(root, path->value.string, &parent, &token);
+		if (ret >= 0)
+			ret = __json_patch_put(root, parent, token, 0, &tmp);
 
-	return val->value.string;
-}
+		if (ret < 0)
+			__destroy_json_value(&tmp);
 
-double json_value_number(const json_value_t *val)
-{
-	if (val->type != JSON_VALUE_NUMBER)
-		return NAN;
+		return ret;
+	}
 
-	return val->value.number;
-}
+	value = parent ? __json_pointer_child(parent, token) : root;
+	if (!value)
+		return -3;
 
-json_object_t *json_value_object(const json_value_t *val)
-{
-	if (val->type != JSON_VALUE_OBJECT)
-		return NULL;
+	ret = __json_pointer_parent(root, path->value.string, &parent, &token);
+	if (ret < 0)
+		return ret;
 
-	return (json_object_t *)&val->value.object;
-}
+	copy = json_value_copy_alloc(value, root->allocator);
+	if (!copy)
+		return -1;
 
-json_array_t *json_value_array(const json_value_t *val)
-{
-	if (val->type != JSON_VALUE_ARRAY)
-		return NULL;
+	ret = __json_patch_put(root, parent, token, 0, copy);
+	if (ret < 0)
+		json_value_destroy(copy);
+	else
+		__json_value_free(copy, copy->allocator);
 
-	return (json_array_t *)&val->value.array;
+	return ret;
 }
 
-const json_value_t *json_object_find(const char *name,
-									 const json_object_t *obj)
+int json_value_patch(json_value_t *val, json_value_t *patch)
 {
 	struct list_head *pos;
-	json_member_t *memb;
+	int ret = 0;
 
-	list_for_each(pos, &obj->head)
+	if ((val->flags & JSON_FLAG_FROZEN) || patch->refs != 1)
+		return -1;
+
+	patch = __json_batch_adopt(patch, val->allocator);
+	if (!patch)
+		return -1;
+
+	if (patch->type != JSON_VALUE_ARRAY)
+		ret = -2;
+	else
 	{
-		memb = list_entry(pos, json_member_t, list);
-		if (strcmp(name, memb->name) == 0)
-			return &memb->value;
+		list_for_each(pos, &patch->value.array.head)
+		{
+			ret = __apply_json_patch_op(val,
+								&list_entry(pos, json_element_t, list)->value);
+			if (ret < 0)
+				break;
+		}
 	}
 
-	return NULL;
+	json_value_destroy(patch);
+	return ret;
 }
 
-size_t json_object_size(const json_object_t *obj)
+/* 64-bit digests of the objects and arrays of the documents being diffed,
+   kept aside in a table keyed by node address unless cached in frozen
+   values. Member order doesn't change the digest of an object. */
+struct __json_digest
 {
-	return obj->size;
-}
+	const json_value_t *val;
+	unsigned long long hash;
+};
 
-const char *json_object_next_name(const char *name,
-								  const json_object_t *obj)
+struct __json_path
 {
-	const struct list_head *pos;
-
-	if (name)
-		pos = &list_entry(name, json_member_t, name)->list;
-	else
-		pos = &obj->head;
-
-	if (pos->next == &obj->head)
-		return NULL;
-
-	return list_entry(pos->next, json_member_t, list)->name;
-}
+	char *buf;
+	size_t len;
+	size_t capacity;
+	const json_allocator_t *allocator;
+};
 
-const json_value_t *json_object_next_value(const json_value_t *val,
-										   const json_object_t *obj)
+struct __json_differ
 {
-	const struct list_head *pos;
-
-	if (val)
-		pos = &list_entry(val, json_member_t, value)->list;
-	else
-		pos = &obj->head;
-
-	if (pos->next == &obj->head)
-		return NULL;
+	size_t mask;
+	struct __json_digest *digests;
+	struct __json_path path;
+	json_array_t *patch;
+};
 
-	return &list_entry(pos->next, json_member_t, list)->value;
+static unsigned long long __json_mix(unsigned long long hash)
+{
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	hash ^= hash >> 31;
+	return hash;
 }
 
-const char *json_object_prev_name(const char *name,
-								  const json_object_t *obj)
+static unsigned long long __json_string_hash(const char *str)
 {
-	const struct list_head *pos;
-
-	if (name)
-		pos = &list_entry(name, json_member_t, name)->list;
-	else
-		pos = &obj->head;
+	unsigned long long hash = 14695981039346656037ULL;
 
-	if (pos->prev == &obj->head)
-		return NULL;
+	while (*str)
+	{
+		hash = (hash ^ (unsigned char)*str) * 1099511628211ULL;
+		str++;
+	}
 
-	return list_entry(pos->prev, json_member_t, list)->name;
+	return hash;
 }
 
-const json_value_t *json_object_prev_value(const json_value_t *val,
-										   const json_object_t *obj)
+static size_t __json_containers(const json_value_t *val)
 {
-	const struct list_head *pos;
+	struct list_head *pos;
+	size_t n = 1;
 
-	if (val)
-		pos = &list_entry(val, json_member_t, value)->list;
-	else
-		pos = &obj->head;
+	switch (val->type)
+	{
+	case JSON_VALUE_OBJECT:
+		list_for_each(pos, &val->value.object.head)
+			n += __json_containers(&list_entry(pos, json_member_t, list)->value);
 
-	if (pos->prev == &obj->head)
-		return NULL;
+		return n;
 
-	return &list_entry(pos->prev, json_member_t, list)->value;
+	case JSON_VALUE_ARRAY:
+		list_for_each(pos, &val->value.array.head)
+			n += __json_containers(&list_entry(pos, json_element_t, list)->value);
+
+		return n;
+	}
+
+	return 0;
 }
 
-const char *json_object_value_name(const json_value_t *val,
-								   const json_object_t *obj)
+static size_t __json_digest_slot(const json_value_t *val,
+								 const struct __json_differ *differ)
 {
-	return list_entry(val, json_member_t, value)->name;
+	size_t i = __json_mix((unsigned long long)(size_t)val) & differ->mask;
+
+	while (differ->digests[i].val && differ->digests[i].val != val)
+		i = (i + 1) & differ->mask;
+
+	return i;
 }
 
-static const json_value_t *__json_object_insert(const char *name,
-												int type, va_list ap,
-												struct list_head *pos,
-												json_object_t *obj)
+static unsigned long long __json_digest(const json_value_t *val,
+										struct __json_differ *differ)
 {
+	struct list_head *pos;
 	json_member_t *memb;
-	size_t len;
+	unsigned long long hash;
+	double number;
+	size_t i;
 
-	len = strlen(name);
-	memb = (json_member_t *)malloc(offsetof(json_member_t, name) + len + 1);
-	if (!memb)
-		return NULL;
+	switch (val->type)
+	{
+	case JSON_VALUE_STRING:
+		return __json_mix(__json_string_hash(val->value.string) +
+						  JSON_VALUE_STRING);
 
-	memcpy(memb->name, name, len + 1);
-	if (__set_json_value(type, ap, &memb->value) < 0)
+	case JSON_VALUE_NUMBER:
+		number = __json_number_value(val);
+		if (number == 0)
+			number = 0;
+
+		memcpy(&hash, &number, sizeof (double));
+		return __json_mix(hash + JSON_VALUE_NUMBER);
+
+	case JSON_VALUE_OBJECT:
+#ifdef JSON_PARSER_DIGEST
+		if (val->flags & JSON_FLAG_DIGEST)
+			return val->digest;
+#endif
+		hash = 0;
+		list_for_each(pos, &val->value.object.head)
+		{
+			memb = list_entry(pos, json_member_t, list);
+			hash += __json_mix(__json_string_hash(memb->name) * 31 +
+							   __json_digest(&memb->value, differ));
+		}
+
+		hash = __json_mix(hash + val->value.object.size + JSON_VALUE_OBJECT);
+		break;
+
+	case JSON_VALUE_ARRAY:
+#ifdef JSON_PARSER_DIGEST
+		if (val->flags & JSON_FLAG_DIGEST)
+			return val->digest;
+#endif
+		hash = JSON_VALUE_ARRAY;
+		list_for_each(pos, &val->value.array.head)
+		{
+			hash = __json_mix(hash + __json_digest(
+						&list_entry(pos, json_element_t, list)->value, differ));
+		}
+
+		break;
+
+	default:
+		return __json_mix(val->type);
+	}
+
+	if (differ)
 	{
-		free(memb);
-		return NULL;
+		i = __json_digest_slot(val, differ);
+		differ->digests[i].val = val;
+		differ->digests[i].hash = hash;
 	}
 
-	list_add(&memb->list, pos);
-	obj->size++;
-	return &memb->value;
+	return hash;
 }
 
-const json_value_t *json_object_append(json_object_t *obj,
-									   const char *name,
-									   int type, ...)
+unsigned long long json_value_hash(const json_value_t *val)
 {
-	const json_value_t *val;
-	va_list ap;
+	return __json_digest(val, NULL);
+}
 
-	va_start(ap, type);
-	val = __json_object_insert(name, type, ap, obj->head.prev, obj);
-	va_end(ap);
-	return val;
+static unsigned long long __json_digest_find(const json_value_t *val,
+											 const struct __json_differ *differ)
+{
+#ifdef JSON_PARSER_DIGEST
+	if (val->flags & JSON_FLAG_DIGEST)
+		return val->digest;
+#endif
+	return differ->digests[__json_digest_slot(val, differ)].hash;
 }
 
-const json_value_t *json_object_insert_after(const json_value_t *val,
-											 json_object_t *obj,
-											 const char *name,
-											 int type, ...)
+static int __json_digest_equal(const json_value_t *a, const json_value_t *b,
+							   const struct __json_differ *differ)
 {
-	struct list_head *pos;
-	va_list ap;
+	if (a->type != b->type)
+		return 0;
 
-	if (val)
-		pos = &list_entry(val, json_member_t, value)->list;
-	else
-		pos = &obj->head;
+	if ((a->type == JSON_VALUE_OBJECT || a->type == JSON_VALUE_ARRAY) &&
+		__json_digest_find(a, differ) != __json_digest_find(b, differ))
+		return 0;
 
-	va_start(ap, type);
-	val = __json_object_insert(name, type, ap, pos, obj);
-	va_end(ap);
-	return val;
+	return __json_value_equal(a, b, 0);
 }
 
-const json_value_t *json_object_insert_before(const json_value_t *val,
-											  json_object_t *obj,
-											  const char *name,
-											  int type, ...)
+static int __json_path_push(const char *token, struct __json_path *path)
 {
-	struct list_head *pos;
-	va_list ap;
+	size_t n = 1;
+	const char *p;
+	char *buf;
 
-	if (val)
-		pos = &list_entry(val, json_member_t, value)->list;
-	else
-		pos = &obj->head;
+	for (p = token; *p; p++)
+		n += 1 + (*p == '~' || *p == '/');
 
-	va_start(ap, type);
-	val = __json_object_insert(name, type, ap, pos->prev, obj);
-	va_end(ap);
-	return val;
-}
+	if (path->len + n >= path->capacity)
+	{
+		buf = (char *)__json_realloc(path->buf, 2 * (path->len + n),
+									 path->allocator);
+		if (!buf)
+			return -1;
 
-json_value_t *json_object_remove(const json_value_t *val,
-								 json_object_t *obj)
-{
-	json_member_t *memb = list_entry(val, json_member_t, value);
+		path->buf = buf;
+		path->capacity = 2 * (path->len + n);
+	}
 
-	val = (json_value_t *)malloc(sizeof (json_value_t));
-	if (!val)
-		return NULL;
+	buf = path->buf + path->len;
+	*buf++ = '/';
+	for (p = token; *p; p++)
+	{
+		if (*p == '~' || *p == '/')
+		{
+			*buf++ = '~';
+			*buf++ = *p == '~' ? '0' : '1';
+		}
+		else
+			*buf++ = *p;
+	}
 
-	list_del(&memb->list);
-	obj->size--;
+	*buf = '\0';
+	path->len += n;
+	return 0;
+}
 
-	__move_json_value(&memb->value, (json_value_t *)val);
-	free(memb);
-	return (json_value_t *)val;
+static int __json_path_push_index(size_t index, struct __json_path *path)
+{
+	char buf[32];
+
+	sprintf(buf, "%lu", (unsigned long)index);
+	return __json_path_push(buf, path);
 }
 
-size_t json_array_size(const json_array_t *arr)
+static void __json_path_pop(size_t len, struct __json_path *path)
 {
-	return arr->size;
+	path->len = len;
+	path->buf[len] = '\0';
 }
 
-const json_value_t *json_array_next_value(const json_value_t *val,
-										  const json_array_t *arr)
+/* Append operation @op at the current path. @val is copied. */
+static int __json_diff_op(const char *op, const json_value_t *val,
+						  struct __json_differ *differ)
 {
-	const struct list_head *pos;
+	const json_value_t *entry;
+	json_object_t *obj;
+	json_value_t *copy;
+
+	entry = json_array_append(differ->patch, JSON_VALUE_OBJECT);
+	if (!entry)
+		return -1;
+
+	obj = json_value_object(entry);
+	if (!json_object_append(obj, "op", JSON_VALUE_STRING, op) ||
+		!json_object_append(obj, "path", JSON_VALUE_STRING, differ->path.buf))
+		return -1;
 
 	if (val)
-		pos = &list_entry(val, json_element_t, value)->list;
-	else
-		pos = &arr->head;
+	{
+		copy = json_value_copy_alloc(val, NULL);
+		if (!copy)
+			return -1;
 
-	if (pos->next == &arr->head)
-		return NULL;
+		if (!json_object_append(obj, "value", 0, copy))
+		{
+			json_value_destroy(copy);
+			return -1;
+		}
+	}
 
-	return &list_entry(pos->next, json_element_t, list)->value;
+	return 0;
 }
 
-const json_value_t *json_array_prev_value(const json_value_t *val,
-										  const json_array_t *arr)
+static int __diff_json_value(const json_value_t *a, const json_value_t *b,
+							 struct __json_differ *differ);
+
+static int __diff_json_members(const json_object_t *a, const json_object_t *b,
+							   struct __json_differ *differ)
 {
-	const struct list_head *pos;
+	struct __json_index index_a, index_b;
+	size_t len = differ->path.len;
+	int indexed_a = 0, indexed_b = 0;
+	struct list_head *pos;
+	json_member_t *memb;
+	json_member_t *memb2;
+	int ret = 0;
 
-	if (val)
-		pos = &list_entry(val, json_element_t, value)->list;
-	else
-		pos = &arr->head;
+	if (a->size >= JSON_INDEX_MIN)
+		indexed_a = __json_index_create(a, 0, __json_object_allocator(a),
+										&index_a) >= 0;
 
-	if (pos->prev == &arr->head)
-		return NULL;
+	if (b->size >= JSON_INDEX_MIN)
+		indexed_b = __json_index_create(b, 0, __json_object_allocator(b),
+										&index_b) >= 0;
 
-	return &list_entry(pos->prev, json_element_t, list)->value;
-}
+	list_for_each(pos, &a->head)
+	{
+		memb = list_entry(pos, json_member_t, list);
+		memb2 = __json_member_find(memb->name, b, indexed_b ? &index_b : NULL);
+		ret = __json_path_push(memb->name, &differ->path);
+		if (ret < 0)
+			break;
 
-static const json_value_t *__json_array_insert(int type, va_list ap,
-											   struct list_head *pos,
-											   json_array_t *arr)
-{
-	json_element_t *elem;
+		if (memb2)
+			ret = __diff_json_value(&memb->value, &memb2->value, differ);
+		else
+			ret = __json_diff_op("remove", NULL, differ);
 
-	elem = (json_element_t *)malloc(sizeof (json_element_t));
-	if (!elem)
-		return NULL;
+		__json_path_pop(len, &differ->path);
+		if (ret < 0)
+			break;
+	}
 
-	if (__set_json_value(type, ap, &elem->value) < 0)
+	if (ret >= 0)
 	{
-		free(elem);
-		return NULL;
+		list_for_each(pos, &b->head)
+		{
+			memb2 = list_entry(pos, json_member_t, list);
+			if (__json_member_find(memb2->name, a, indexed_a ? &index_a : NULL))
+				continue;
+
+			ret = __json_path_push(memb2->name, &differ->path);
+			if (ret >= 0)
+				ret = __json_diff_op("add", &memb2->value, differ);
+
+			__json_path_pop(len, &differ->path);
+			if (ret < 0)
+				break;
+		}
 	}
 
-	list_add(&elem->list, pos);
-	arr->size++;
-	return &elem->value;
-}
+	if (indexed_a)
+		__json_index_destroy(&index_a);
 
-const json_value_t *json_array_append(json_array_t *arr,
-									  int type, ...)
-{
-	const json_value_t *val;
-	va_list ap;
+	if (indexed_b)
+		__json_index_destroy(&index_b);
 
-	va_start(ap, type);
-	val = __json_array_insert(type, ap, arr->head.prev, arr);
-	va_end(ap);
-	return val;
+	return ret;
 }
 
-const json_value_t *json_array_insert_after(const json_value_t *val,
-											json_array_t *arr,
-											int type, ...)
+/* Elements equal at both ends are skipped. What remains in the middle is
+   diffed pairwise, then the surplus is removed or added. */
+static int __diff_json_elements(const json_array_t *a, const json_array_t *b,
+								struct __json_differ *differ)
 {
-	struct list_head *pos;
-	va_list ap;
+	const struct list_head *pos = a->head.next;
+	const struct list_head *pos2 = b->head.next;
+	const struct list_head *end = &a->head;
+	const struct list_head *end2 = &b->head;
+	size_t len = differ->path.len;
+	size_t prefix = 0;
+	size_t n = a->size;
+	size_t n2 = b->size;
+	size_t i;
+	int ret = 0;
+
+	while (n != 0 && n2 != 0 &&
+		   __json_digest_equal(&list_entry(pos, json_element_t, list)->value,
+							   &list_entry(pos2, json_element_t, list)->value,
+							   differ))
+	{
+		pos = pos->next;
+		pos2 = pos2->next;
+		prefix++;
+		n--;
+		n2--;
+	}
 
-	if (val)
-		pos = &list_entry(val, json_element_t, value)->list;
-	else
-		pos = &arr->head;
+	while (n != 0 && n2 != 0 &&
+		   __json_digest_equal(&list_entry(end->prev, json_element_t, list)->value,
+							   &list_entry(end2->prev, json_element_t, list)->value,
+							   differ))
+	{
+		end = end->prev;
+		end2 = end2->prev;
+		n--;
+		n2--;
+	}
 
-	va_start(ap, type);
-	val = __json_array_insert(type, ap, pos, arr);
-	va_end(ap);
-	return val;
+	for (i = 0; i < n || i < n2; i++)
+	{
+		ret = __json_path_push_index(prefix + (i < n2 ? i : n2),
+									 &differ->path);
+		if (ret < 0)
+			break;
+
+		if (i < n && i < n2)
+			ret = __diff_json_value(&list_entry(pos, json_element_t, list)->value,
+									&list_entry(pos2, json_element_t, list)->value,
+									differ);
+		else if (i < n)
+			ret = __json_diff_op("remove", NULL, differ);
+		else
+			ret = __json_diff_op("add",
+								 &list_entry(pos2, json_element_t, list)->value,
+								 differ);
+
+		__json_path_pop(len, &differ->path);
+		if (ret < 0)
+			break;
+
+		pos = pos->next;
+		pos2 = pos2->next;
+	}
+
+	return ret;
 }
 
-const json_value_t *json_array_insert_before(const json_value_t *val,
-											 json_array_t *arr,
-											 int type, ...)
+static int __diff_json_value(const json_value_t *a, const json_value_t *b,
+							 struct __json_differ *differ)
 {
-	struct list_head *pos;
-	va_list ap;
+	if (__json_digest_equal(a, b, differ))
+		return 0;
 
-	if (val)
-		pos = &list_entry(val, json_element_t, value)->list;
-	else
-		pos = &arr->head;
+	if (a->type == b->type)
+	{
+		if (a->type == JSON_VALUE_OBJECT)
+			return __diff_json_members(&a->value.object, &b->value.object,
+									   differ);
 
-	va_start(ap, type);
-	val = __json_array_insert(type, ap, pos->prev, arr);
-	va_end(ap);
-	return val;
+		if (a->type == JSON_VALUE_ARRAY)
+			return __diff_json_elements(&a->value.array, &b->value.array,
+										differ);
+	}
+
+	return __json_diff_op("replace", b, differ);
 }
 
-json_value_t *json_array_remove(const json_value_t *val,
-								json_array_t *arr)
+json_value_t *json_value_diff(const json_value_t *from, const json_value_t *to)
 {
-	json_element_t *elem = list_entry(val, json_element_t, value);
-
-	val = (json_value_t *)malloc(sizeof (json_value_t));
-	if (!val)
+	size_t count = __json_containers(from) + __json_containers(to);
+	const json_allocator_t *allocator = __json_user_allocator(from->allocator);
+	size_t n = __json_table_size(count);
+	struct __json_differ differ;
+	json_value_t *patch;
+	int ret = -1;
+
+	patch = json_value_create(JSON_VALUE_ARRAY);
+	if (!patch)
 		return NULL;
 
-	list_del(&elem->list);
-	arr->size--;
+	differ.mask = n - 1;
+	differ.digests = (struct __json_digest *)
+		__json_table_alloc(n, sizeof (struct __json_digest), allocator);
+	differ.path.buf = (char *)__json_malloc(64, allocator);
+	differ.path.len = 0;
+	differ.path.capacity = 64;
+	differ.path.allocator = allocator;
+	differ.patch = json_value_array(patch);
+	if (differ.digests && differ.path.buf)
+	{
+		differ.path.buf[0] = '\0';
+		__json_digest(from, &differ);
+		__json_digest(to, &differ);
+		ret = __diff_json_value(from, to, &differ);
+	}
 
-	__move_json_value(&elem->value, (json_value_t *)val);
-	free(elem);
-	return (json_value_t *)val;
-}
+	if (differ.digests)
+		__json_table_free(differ.digests, allocator);
+
+	if (differ.path.buf)
+		__json_free(differ.path.buf, allocator);
+
+	if (ret < 0)
+	{
+		json_value_destroy(patch);
+		return NULL;
+	}
 
+	return patch;
+}
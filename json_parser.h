@@ -11,9 +11,122 @@
 #define JSON_VALUE_FALSE	6
 #define JSON_VALUE_NULL		7
 
+#define JSON_WRITER_ASCII	1
+
+#define JSON_DUPLICATE_KEEP_ALL		0
+#define JSON_DUPLICATE_KEEP_FIRST	1
+#define JSON_DUPLICATE_KEEP_LAST	2
+#define JSON_DUPLICATE_REJECT		3
+
+#define JSON_RELAXED_COMMENTS			0x1
+#define JSON_RELAXED_TRAILING_COMMAS	0x2
+#define JSON_RELAXED_NONFINITE			0x4
+#define JSON_RELAXED_SINGLE_QUOTES		0x8
+#define JSON_RELAXED_ALL				0xf
+
+#define JSON_NUMBERS_DOUBLE		0
+#define JSON_NUMBERS_RAW		1
+#define JSON_NUMBERS_LAZY		2
+
+#define JSON_AFFINITY_NONE	0
+#define JSON_AFFINITY_NODE	1
+#define JSON_AFFINITY_CPU	2
+
+#define JSON_FIELD_BOOL		1
+#define JSON_FIELD_INT		2
+#define JSON_FIELD_INT64	3
+#define JSON_FIELD_DOUBLE	4
+#define JSON_FIELD_CHARS	5
+#define JSON_FIELD_STRING	6
+#define JSON_FIELD_OBJECT	7
+#define JSON_FIELD_ARRAY	8
+
 typedef struct __json_value json_value_t;
 typedef struct __json_object json_object_t;
 typedef struct __json_array json_array_t;
+typedef struct __json_allocator json_allocator_t;
+typedef struct __json_node_pool_stats json_node_pool_stats_t;
+typedef struct __json_writer json_writer_t;
+typedef struct __json_parse_stats json_parse_stats_t;
+typedef struct __json_parse_options json_parse_options_t;
+typedef struct __json_text json_text_t;
+typedef struct __json_batch json_batch_t;
+typedef struct __json_service json_service_t;
+typedef struct __json_service_options json_service_options_t;
+typedef struct __json_field json_field_t;
+typedef struct __json_schema json_schema_t;
+typedef struct __json_view json_view_t;
+
+struct __json_allocator
+{
+	void *(*alloc)(size_t size, void *context);
+	void *(*realloc)(void *ptr, size_t size, void *context);
+	void (*free)(void *ptr, void *context);
+	void *context;
+};
+
+struct __json_node_pool_stats
+{
+	size_t hits;
+	size_t misses;
+	size_t recycled;
+	size_t released;
+	size_t cached;
+};
+
+struct __json_parse_stats
+{
+	size_t documents;
+	size_t bytes;
+	size_t nodes[8];
+	size_t escaped_strings;
+	size_t copied_bytes;
+	size_t allocs;
+	size_t max_depth;
+	unsigned long long parse_ticks;
+	unsigned long long number_ticks;
+};
+
+struct __json_parse_options
+{
+	const json_allocator_t *allocator;
+	int duplicates;
+	int relaxed;
+	int numbers;
+	int max_depth;
+	size_t max_nodes;
+	size_t max_string;
+	size_t max_members;
+	size_t max_elements;
+	size_t max_memory;
+};
+
+struct __json_text
+{
+	const char *text;
+	size_t size;
+};
+
+struct __json_service_options
+{
+	int workers;
+	size_t queue_size;
+	const json_parse_options_t *options;
+	int affinity;
+	const json_allocator_t *const *node_allocators;
+	int nodes;
+};
+
+struct __json_field
+{
+	const char *name;
+	int type;
+	size_t offset;
+	size_t size;
+	const json_field_t *fields;
+	size_t nfields;
+	size_t count_offset;
+};
 
 #ifdef __cplusplus
 extern "C"
@@ -25,9 +138,83 @@ json_value_t *json_value_create(int type, ...);
 json_value_t *json_value_copy(const json_value_t *val);
 void json_value_destroy(json_value_t *val);
 
+json_value_t *json_value_parse_alloc(const char *text,
+									 const json_allocator_t *allocator);
+json_value_t *json_value_create_alloc(const json_allocator_t *allocator,
+									  int type, ...);
+json_value_t *json_value_copy_alloc(const json_value_t *val,
+									const json_allocator_t *allocator);
+json_value_t *json_value_parse_into(json_value_t *val, const char *text);
+json_value_t *json_value_parse_options(const char *text,
+									   const json_parse_options_t *options);
+json_batch_t *json_batch_parse(const json_text_t *texts, size_t n,
+							   const json_parse_options_t *options,
+							   json_value_t *vals[]);
+void json_batch_destroy(json_batch_t *batch);
+
+json_service_t *json_service_create(const json_service_options_t *options);
+int json_service_submit(json_service_t *service, const char *text,
+						void (*callback)(json_value_t *val, void *context),
+						void *context);
+int json_service_try_submit(json_service_t *service, const char *text,
+							void (*callback)(json_value_t *val,
+											 void *context),
+							void *context);
+void json_service_destroy(json_service_t *service);
+
+json_schema_t *json_schema_create(const json_field_t *fields, size_t n);
+json_schema_t *json_schema_create_alloc(const json_field_t *fields, size_t n,
+										const json_allocator_t *allocator);
+void json_schema_destroy(json_schema_t *schema);
+int json_struct_parse(const char *text, const json_schema_t *schema,
+					  void *st);
+void json_struct_free(const json_schema_t *schema, void *st);
+
+size_t json_value_encode(const json_value_t *val, void *buf, size_t size);
+json_value_t *json_value_decode(const void *buf, size_t size);
+json_value_t *json_value_decode_alloc(const void *buf, size_t size,
+									  const json_allocator_t *allocator);
+
+const json_view_t *json_view_root(const void *buf, size_t size);
+int json_view_type(const json_view_t *view);
+const char *json_view_string(const json_view_t *view);
+size_t json_view_string_length(const json_view_t *view);
+double json_view_number(const json_view_t *view);
+size_t json_view_size(const json_view_t *view);
+const json_view_t *json_view_array_at(size_t index, const json_view_t *view);
+const char *json_view_object_name_at(size_t index, const json_view_t *view);
+const json_view_t *json_view_object_value_at(size_t index,
+											 const json_view_t *view);
+const json_view_t *json_view_object_find(const char *name,
+										 const json_view_t *view);
+
+int json_value_merge_patch(json_value_t *val, json_value_t *patch);
+int json_value_patch(json_value_t *val, json_value_t *patch);
+json_value_t *json_value_diff(const json_value_t *from,
+							 const json_value_t *to);
+
+int json_value_equal(const json_value_t *a, const json_value_t *b);
+int json_value_equal_ordered(const json_value_t *a, const json_value_t *b);
+unsigned long long json_value_hash(const json_value_t *val);
+
+int json_value_sort(json_value_t *val);
+
+json_value_t *json_value_retain(json_value_t *val);
+void json_value_release(json_value_t *val);
+void json_value_freeze(json_value_t *val);
+int json_value_frozen(const json_value_t *val);
+
+void json_node_pool_enable(size_t max_nodes);
+void json_node_pool_disable(void);
+void json_node_pool_stats(json_node_pool_stats_t *stats);
+
+int json_parse_stats(json_parse_stats_t *stats);
+void json_parse_stats_reset(void);
+
 int json_value_type(const json_value_t *val);
 const char *json_value_string(const json_value_t *val);
 double json_value_number(const json_value_t *val);
+const char *json_value_number_text(const json_value_t *val);
 json_object_t *json_value_object(const json_value_t *val);
 json_array_t *json_value_array(const json_value_t *val);
 
@@ -74,6 +261,39 @@ const json_value_t *json_array_insert_before(const json_value_t *val,
 json_value_t *json_array_remove(const json_value_t *val,
 								json_array_t *arr);
 
+int json_value_write(const json_value_t *val,
+					 int (*write)(const char *buf, size_t size, void *context),
+					 void *context);
+int json_value_write_canonical(const json_value_t *val,
+							   int (*write)(const char *buf, size_t size,
+											void *context),
+							   void *context);
+int json_value_write_msgpack(const json_value_t *val,
+							 int (*write)(const char *buf, size_t size,
+										  void *context),
+							 void *context);
+int json_value_write_cbor(const json_value_t *val,
+						  int (*write)(const char *buf, size_t size,
+									   void *context),
+						  void *context);
+json_value_t *json_value_parse_msgpack(const void *buf, size_t size);
+json_value_t *json_value_parse_cbor(const void *buf, size_t size);
+
+json_writer_t *json_writer_create(int (*write)(const char *buf, size_t size,
+											   void *context),
+								  void *context);
+json_writer_t *json_writer_create_alloc(int (*write)(const char *buf,
+													 size_t size,
+													 void *context),
+										void *context,
+										const json_allocator_t *allocator);
+void json_writer_set_flags(json_writer_t *writer, int flags);
+int json_writer_append(json_writer_t *writer, const char *name,
+					   int type, ...);
+int json_writer_end(json_writer_t *writer);
+int json_writer_flush(json_writer_t *writer);
+void json_writer_destroy(json_writer_t *writer);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,9 +1,19 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <float.h>
 #include "json_parser.h"
 
 #define BUFSIZE		(64 * 1024 * 1024)
 
+#if defined(__GNUC__)
+# define test_load(ptr)			__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+# define test_store(ptr, val)	__atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#else
+# define test_load(ptr)			(*(ptr))
+# define test_store(ptr, val)	(*(ptr) = (val))
+#endif
+
 void print_json_value(const json_value_t *val, int depth);
 
 void print_json_string(const char *str)
@@ -140,10 +150,1841 @@ void print_json_value(const json_value_t *val, int depth)
 	}
 }
 
-int main()
+struct counting_context
+{
+	size_t blocks;
+	size_t bytes;
+	size_t limit;	/* blocks allowed at once, 0 for no limit */
+};
+
+void *counting_alloc(size_t size, void *context)
+{
+	struct counting_context *ctx = (struct counting_context *)context;
+	void *ptr;
+
+	if (ctx->limit != 0 && ctx->blocks >= ctx->limit)
+		return NULL;
+
+	ptr = malloc(size);
+
+	if (ptr)
+	{
+		ctx->blocks++;
+		ctx->bytes += size;
+	}
+
+	return ptr;
+}
+
+void *counting_realloc(void *ptr, size_t size, void *context)
+{
+	struct counting_context *ctx = (struct counting_context *)context;
+	void *p = realloc(ptr, size);
+
+	if (p && !ptr)
+		ctx->blocks++;
+
+	return p;
+}
+
+void counting_free(void *ptr, void *context)
+{
+	struct counting_context *ctx = (struct counting_context *)context;
+
+	if (ptr)
+		ctx->blocks--;
+
+	free(ptr);
+}
+
+int failures;
+
+/* Allocator of the documents the tests parse, NULL for malloc(). */
+const json_allocator_t *test_allocator;
+
+void check(int ok, const char *what)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "Check failed: %s\n", what);
+		failures++;
+	}
+}
+
+/* Parse @text with the test allocator, failing the check if invalid. */
+json_value_t *parse(const char *text)
+{
+	json_value_t *val = json_value_parse_alloc(text, test_allocator);
+
+	check(val != NULL, text);
+	return val;
+}
+
+const json_value_t *find(const char *name, const json_value_t *val)
+{
+	if (!val || json_value_type(val) != JSON_VALUE_OBJECT)
+		return NULL;
+
+	return json_object_find(name, json_value_object(val));
+}
+
+struct output
+{
+	char *buf;
+	size_t size;
+	size_t capacity;
+};
+
+int output_write(const char *data, size_t size, void *context)
+{
+	struct output *out = (struct output *)context;
+
+	if (out->size + size > out->capacity)
+		return -1;
+
+	memcpy(out->buf + out->size, data, size);
+	out->size += size;
+	return 0;
+}
+
+/* Values moved or applied from a batch must survive json_batch_destroy(). */
+void test_batch(void)
+{
+	static const char *lines[] = {
+		"{\"a\":[1,2,{\"b\":\"moved\"}]}",
+		"{\"c\":{\"d\":\"merged\"},\"e\":null}",
+	};
+	json_parse_options_t options = { NULL };
+	json_text_t texts[2];
+	json_value_t *vals[2];
+	json_batch_t *batch;
+	json_value_t *doc;
+	const json_value_t *val;
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		texts[i].text = lines[i];
+		texts[i].size = strlen(lines[i]);
+	}
+
+	options.allocator = test_allocator;
+	batch = json_batch_parse(texts, 2, &options, vals);
+	check(batch && vals[0] && vals[1], "batch parse");
+	if (!batch || !vals[0] || !vals[1])
+		return;
+
+	doc = parse("{\"e\":true}");
+	val = json_object_append(json_value_object(doc), "root", 0, vals[0]);
+	check(val != NULL, "batch root moved into a document");
+	check(json_value_merge_patch(doc, vals[1]) == 0,
+		  "batch root applied as merge patch");
+	json_batch_destroy(batch);
+
+	val = find("a", find("root", doc));
+	if (val)
+		val = json_array_prev_value(NULL, json_value_array(val));
+
+	val = find("b", val);
+	check(val && strcmp(json_value_string(val), "moved") == 0,
+		  "moved batch value read after destroying the batch");
+	val = find("d", find("c", doc));
+	check(val && strcmp(json_value_string(val), "merged") == 0,
+		  "merged batch value read after destroying the batch");
+	check(find("e", doc) == NULL, "merge patch null removes a member");
+	json_value_destroy(doc);
+}
+
+/* A batch patch that can't be copied out of its arena fails the patch,
+   without leaking the partial copy. */
+void test_batch_failure(void)
+{
+	static const char *line = "{\"c\":{\"d\":\"merged\"},\"e\":[1,2]}";
+	struct counting_context ctx = { 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	json_text_t text = { line, strlen(line) };
+	json_value_t *val;
+	json_batch_t *batch;
+	json_value_t *doc;
+	size_t blocks;
+
+	doc = json_value_parse_alloc("{\"a\":1}", &allocator);
+	batch = json_batch_parse(&text, 1, NULL, &val);
+	check(doc && batch, "batch parse");
+	if (!doc || !batch)
+		return;
+
+	blocks = ctx.blocks;
+	ctx.limit = blocks + 4;
+	check(json_value_merge_patch(doc, val) == -1,
+		  "merge patch fails when copying out of the batch fails");
+	check(ctx.blocks == blocks, "partial copy of a batch patch freed");
+	json_batch_destroy(batch);
+	json_value_destroy(doc);
+	check(ctx.blocks == 0, "document freed after a failed patch");
+}
+
+/* Apply @patch to @text with @apply. If @expect is not NULL, the result
+   has to equal it. Returns what @apply returned. */
+int patch_text(int (*apply)(json_value_t *, json_value_t *),
+			   const char *text, const char *patch, const char *expect)
+{
+	json_value_t *val = parse(text);
+	json_value_t *pat = parse(patch);
+	json_value_t *exp = NULL;
+	int ret = -1;
+
+	if (expect)
+		exp = parse(expect);
+
+	if (val && pat)
+	{
+		ret = apply(val, pat);
+		pat = NULL;
+		if (exp)
+			check(ret == 0 && json_value_equal(val, exp), patch);
+	}
+
+	if (pat)
+		json_value_destroy(pat);
+
+	if (val)
+		json_value_destroy(val);
+
+	if (exp)
+		json_value_destroy(exp);
+
+	return ret;
+}
+
+/* The examples of RFC 7386 Appendix A and RFC 6902 Appendix A. */
+void test_patch(void)
+{
+	static const char *merge[][3] = {
+		{ "{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}" },
+		{ "{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}" },
+		{ "{\"a\":\"b\"}", "{\"a\":null}", "{}" },
+		{ "{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}" },
+		{ "{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}" },
+		{ "{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}" },
+		{ "{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}",
+		  "{\"a\":{\"b\":\"d\"}}" },
+		{ "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}" },
+		{ "[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]" },
+		{ "{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]" },
+		{ "{\"a\":\"foo\"}", "null", "null" },
+		{ "{\"a\":\"foo\"}", "\"bar\"", "\"bar\"" },
+		{ "{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}" },
+		{ "[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}" },
+		{ "{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}" },
+	};
+	static const char *patch[][3] = {
+		{ "{\"foo\":\"bar\"}",
+		  "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]",
+		  "{\"baz\":\"qux\",\"foo\":\"bar\"}" },
+		{ "{\"foo\":[\"bar\",\"baz\"]}",
+		  "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]",
+		  "{\"foo\":[\"bar\",\"qux\",\"baz\"]}" },
+		{ "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+		  "[{\"op\":\"remove\",\"path\":\"/baz\"}]",
+		  "{\"foo\":\"bar\"}" },
+		{ "{\"foo\":[\"bar\",\"qux\",\"baz\"]}",
+		  "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]",
+		  "{\"foo\":[\"bar\",\"baz\"]}" },
+		{ "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+		  "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]",
+		  "{\"baz\":\"boo\",\"foo\":\"bar\"}" },
+		{ "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},"
+		  "\"qux\":{\"corge\":\"grault\"}}",
+		  "[{\"op\":\"move\",\"from\":\"/foo/waldo\","
+		  "\"path\":\"/qux/thud\"}]",
+		  "{\"foo\":{\"bar\":\"baz\"},"
+		  "\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}" },
+		{ "{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+		  "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+		  "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}" },
+		{ "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+		  "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},"
+		  "{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]",
+		  "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}" },
+		{ "{\"foo\":\"bar\"}",
+		  "[{\"op\":\"add\",\"path\":\"/child\","
+		  "\"value\":{\"grandchild\":{}}}]",
+		  "{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}" },
+		{ "{\"foo\":\"bar\"}",
+		  "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\","
+		  "\"xyz\":123}]",
+		  "{\"foo\":\"bar\",\"baz\":\"qux\"}" },
+		{ "{\"/\":9,\"~1\":10}",
+		  "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":10}]",
+		  "{\"/\":9,\"~1\":10}" },
+		{ "{\"foo\":[\"bar\"]}",
+		  "[{\"op\":\"add\",\"path\":\"/foo/-\","
+		  "\"value\":[\"abc\",\"def\"]}]",
+		  "{\"foo\":[\"bar\",[\"abc\",\"def\"]]}" },
+		{ "{\"foo\":{\"bar\":1}}",
+		  "[{\"op\":\"copy\",\"from\":\"/foo\",\"path\":\"/baz\"}]",
+		  "{\"foo\":{\"bar\":1},\"baz\":{\"bar\":1}}" },
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof merge / sizeof merge[0]; i++)
+		patch_text(json_value_merge_patch, merge[i][0], merge[i][1],
+				   merge[i][2]);
+
+	for (i = 0; i < sizeof patch / sizeof patch[0]; i++)
+		patch_text(json_value_patch, patch[i][0], patch[i][1], patch[i][2]);
+
+	check(patch_text(json_value_patch, "{\"baz\":\"qux\"}",
+					 "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]",
+					 NULL) == -3, "failing test operation");
+	check(patch_text(json_value_patch, "{\"/\":9,\"~1\":10}",
+					 "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":\"10\"}]",
+					 NULL) == -3, "test comparing a string and a number");
+	check(patch_text(json_value_patch, "{\"foo\":\"bar\"}",
+					 "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":1}]",
+					 NULL) == -3, "add to a nonexistent target");
+	check(patch_text(json_value_patch, "{\"foo\":\"bar\"}",
+					 "[{\"op\":\"remove\",\"path\":\"foo\"}]",
+					 NULL) < 0, "pointer without a leading slash");
+	check(patch_text(json_value_patch, "{\"a\":[1,2]}",
+					 "[{\"op\":\"remove\",\"path\":\"/a/01\"}]",
+					 NULL) < 0, "array index with a leading zero");
+	check(patch_text(json_value_patch, "{\"a\":1}",
+					 "[{\"op\":\"remove\",\"path\":\"/a~2\"}]",
+					 NULL) < 0, "invalid escape in a pointer");
+	check(patch_text(json_value_patch, "{\"a\":1}",
+					 "[{\"op\":\"jump\",\"path\":\"/a\"}]",
+					 NULL) == -2, "unknown operation");
+}
+
+/* Diff @from and @to, apply the diff to @from and compare with @to. */
+void diff_text(const char *from, const char *to)
+{
+	json_value_t *a = parse(from);
+	json_value_t *b = parse(to);
+	json_value_t *patch;
+
+	if (a && b)
+	{
+		patch = json_value_diff(a, b);
+		check(patch != NULL, to);
+		if (patch)
+		{
+			check(json_value_patch(a, patch) == 0 && json_value_equal(a, b),
+				  to);
+		}
+	}
+
+	if (a)
+		json_value_destroy(a);
+
+	if (b)
+		json_value_destroy(b);
+}
+
+void test_diff(void)
+{
+	static const char *pairs[][2] = {
+		{ "{\"a\":1,\"b\":[1,2,3]}", "{\"a\":1,\"b\":[1,2,3]}" },
+		{ "{\"a\":1,\"b\":2}", "{\"b\":3,\"c\":{\"d\":null}}" },
+		{ "[1,2,3,4,5]", "[1,9,4,5]" },
+		{ "[1,2,3]", "[0,1,2,3,4]" },
+		{ "[{\"a\":[1]},true]", "[{\"a\":[1,2]},false,\"x\"]" },
+		{ "{\"a/b\":1,\"c~d\":2}", "{\"a/b\":2,\"e~/\":3}" },
+		{ "{\"a\":{\"b\":{\"c\":1}}}", "{\"a\":{\"b\":[\"c\"]}}" },
+		{ "{\"a\":1}", "[\"a\",1]" },
+		{ "\"text\"", "42" },
+	};
+	char from[1024], to[1024];
+	char *p = from, *q = to;
+	size_t i;
+	int k;
+
+	for (i = 0; i < sizeof pairs / sizeof pairs[0]; i++)
+		diff_text(pairs[i][0], pairs[i][1]);
+
+	/* Objects large enough for the members to be matched by indexes. */
+	for (k = 0; k < 40; k++)
+	{
+		p += sprintf(p, "%s\"k%d\":%d", k ? "," : "{", k, k);
+		if (k % 7 != 0)
+			q += sprintf(q, "%s\"k%d\":%d", q != to ? "," : "{", k,
+						 k % 5 == 0 ? -k : k);
+	}
+
+	strcpy(p, "}");
+	strcpy(q, ",\"new\":[1,2]}");
+	diff_text(from, to);
+	diff_text(to, from);
+}
+
+json_value_t *parse_options(const char *text, int duplicates,
+							int relaxed)
+{
+	json_parse_options_t options = { NULL };
+
+	options.duplicates = duplicates;
+	options.relaxed = relaxed;
+	options.allocator = test_allocator;
+	return json_value_parse_options(text, &options);
+}
+
+/* @text has @size distinct names, and its first member "a" is repeated
+   with 2 after being 1. */
+void check_duplicates(const char *text, size_t size)
+{
+	const json_value_t *member;
+	json_value_t *val;
+
+	val = parse_options(text, JSON_DUPLICATE_KEEP_ALL, 0);
+	member = find("a", val);
+	check(val && json_object_size(json_value_object(val)) == size + 1 &&
+		  member && json_value_number(member) == 1, "keep all duplicates");
+	if (val)
+		json_value_destroy(val);
+
+	val = parse_options(text, JSON_DUPLICATE_KEEP_FIRST, 0);
+	member = find("a", val);
+	check(val && json_object_size(json_value_object(val)) == size &&
+		  member && json_value_number(member) == 1, "keep first duplicate");
+	if (val)
+		json_value_destroy(val);
+
+	val = parse_options(text, JSON_DUPLICATE_KEEP_LAST, 0);
+	member = find("a", val);
+	check(val && json_object_size(json_value_object(val)) == size &&
+		  member && json_value_number(member) == 2 &&
+		  strcmp(json_object_next_name(NULL, json_value_object(val)),
+				 "a") == 0, "keep last duplicate in the first position");
+	if (val)
+		json_value_destroy(val);
+
+	val = parse_options(text, JSON_DUPLICATE_REJECT, 0);
+	check(val == NULL, "reject duplicates");
+	if (val)
+		json_value_destroy(val);
+}
+
+void test_duplicates(void)
+{
+	char text[1024];
+	char *p = text;
+	int i;
+
+	check_duplicates("{\"a\":1,\"a\":2}", 1);
+	check_duplicates("{\"a\":1,\"b\":{\"a\":0,\"b\":0},\"a\":2}", 2);
+
+	/* More members than JSON_INDEX_MIN, so names are found by the index
+	   built while parsing. */
+	p += sprintf(p, "{\"a\":1");
+	for (i = 0; i < 40; i++)
+	{
+		p += sprintf(p, ",\"k%d\":%d", i, i);
+		if (i == 30)
+			p += sprintf(p, ",\"a\":2");
+	}
+
+	strcpy(p, "}");
+	check_duplicates(text, 41);
+}
+
+/* Whether @text parses with @options. */
+int parses(const char *text, const json_parse_options_t *options)
+{
+	json_value_t *val = json_value_parse_options(text, options);
+
+	if (!val)
+		return 0;
+
+	json_value_destroy(val);
+	return 1;
+}
+
+/* Each limit is reached by its document, which parses at exactly the
+   limit and fails one below it. */
+void test_limits(void)
+{
+	static const char *text = "{\"abc\":\"defgh\",\"x\":[1,[2,3],4]}";
+	json_parse_options_t options = { NULL };
+	struct counting_context ctx = { 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	char large[1024];
+	char *p = large;
+	size_t bytes;
+	int i;
+
+	options.max_depth = 3;
+	check(parses(text, &options), "max_depth reached");
+	options.max_depth = 2;
+	check(!parses(text, &options), "max_depth exceeded");
+
+	memset(&options, 0, sizeof (json_parse_options_t));
+	options.max_nodes = 8;
+	check(parses(text, &options), "max_nodes reached");
+	options.max_nodes = 7;
+	check(!parses(text, &options), "max_nodes exceeded");
+
+	memset(&options, 0, sizeof (json_parse_options_t));
+	options.max_string = 5;
+	check(parses(text, &options), "max_string reached");
+	options.max_string = 4;
+	check(!parses(text, &options), "max_string exceeded");
+
+	/* Escaped strings and names count once unescaped. */
+	options.max_string = 4;
+	check(parses("{\"a\":\"\\u0041\\u0042\\u0043\\n\"}", &options),
+		  "max_string reached by an escaped string");
+	check(parses("{\"\\u0061\\u0062\\u00e9\":1}", &options),
+		  "max_string reached by an escaped name");
+	check(parses("[\"\\ud83d\\ude00\"]", &options),
+		  "max_string reached by a surrogate pair");
+	options.max_string = 3;
+	check(!parses("{\"a\":\"\\u0041\\u0042\\u0043\\n\"}", &options),
+		  "max_string exceeded by an escaped string");
+	check(!parses("{\"\\u0061\\u0062\\u00e9\":1}", &options),
+		  "max_string exceeded by an escaped name");
+	check(!parses("[\"\\ud83d\\ude00\"]", &options),
+		  "max_string exceeded by a surrogate pair");
+	options.relaxed = JSON_RELAXED_SINGLE_QUOTES;
+	check(parses("{'\\u0061':'\\'\\u0041\\u0042'}", &options),
+		  "max_string reached by a single-quoted string");
+	check(!parses("{'a':'\\'\\u0041\\u0042\\u0043'}", &options),
+		  "max_string exceeded by a single-quoted string");
+
+	memset(&options, 0, sizeof (json_parse_options_t));
+	options.max_members = 2;
+	check(parses(text, &options), "max_members reached");
+	options.max_members = 1;
+	check(!parses(text, &options), "max_members exceeded");
+
+	memset(&options, 0, sizeof (json_parse_options_t));
+	options.max_elements = 3;
+	check(parses(text, &options), "max_elements reached");
+	options.max_elements = 2;
+	check(!parses(text, &options), "max_elements exceeded");
+
+	/* The memory limit counts what is asked of the allocator, including
+	   the index for duplicate names of a large object. */
+	p += sprintf(p, "{\"a\":\"b\"");
+	for (i = 0; i < 40; i++)
+		p += sprintf(p, ",\"k%d\":[%d]", i, i);
+
+	strcpy(p, "}");
+	memset(&options, 0, sizeof (json_parse_options_t));
+	options.allocator = &allocator;
+	options.duplicates = JSON_DUPLICATE_REJECT;
+	check(parses(large, &options), large);
+	bytes = ctx.bytes;
+	options.max_memory = bytes;
+	check(parses(large, &options), "max_memory reached");
+	options.max_memory = bytes - 1;
+	check(!parses(large, &options), "max_memory exceeded");
+	check(ctx.blocks == 0, "memory freed after exceeding a limit");
+}
+
+/* Each extension is accepted with its flag, and rejected without it,
+   whether other extensions are enabled or not. */
+void test_relaxed(void)
+{
+	static const struct
+	{
+		int flag;
+		const char *text;
+	} cases[] = {
+		{ JSON_RELAXED_COMMENTS, "// line\n{\"a\": /* block */ 1}" },
+		{ JSON_RELAXED_COMMENTS, "[1, 2] /* at the end */" },
+		{ JSON_RELAXED_TRAILING_COMMAS, "{\"a\":[1,2,],}" },
+		{ JSON_RELAXED_NONFINITE, "[NaN,Infinity,+Infinity,-Infinity]" },
+		{ JSON_RELAXED_SINGLE_QUOTES, "{'a':'it\\'s \"quoted\"'}" },
+	};
+	const json_value_t *member;
+	json_value_t *val;
+	double number;
+	size_t i;
+
+	for (i = 0; i < sizeof cases / sizeof cases[0]; i++)
+	{
+		val = parse_options(cases[i].text, 0, cases[i].flag);
+		check(val != NULL, cases[i].text);
+		if (val)
+			json_value_destroy(val);
+
+		val = parse_options(cases[i].text, 0, JSON_RELAXED_ALL);
+		check(val != NULL, cases[i].text);
+		if (val)
+			json_value_destroy(val);
+
+		val = parse_options(cases[i].text, 0, 0);
+		check(val == NULL, cases[i].text);
+		if (val)
+			json_value_destroy(val);
+
+		val = json_value_parse(cases[i].text);
+		check(val == NULL, cases[i].text);
+		if (val)
+			json_value_destroy(val);
+
+		val = parse_options(cases[i].text, 0,
+							JSON_RELAXED_ALL & ~cases[i].flag);
+		check(val == NULL, cases[i].text);
+		if (val)
+			json_value_destroy(val);
+	}
+
+	val = parse_options("[NaN,-Infinity]", 0, JSON_RELAXED_NONFINITE);
+	if (val)
+	{
+		member = json_array_next_value(NULL, json_value_array(val));
+		number = json_value_number(member);
+		check(number != number, "NaN");
+		member = json_array_next_value(member, json_value_array(val));
+		number = json_value_number(member);
+		check(number < 0 && number * 0.5 == number, "-Infinity");
+		json_value_destroy(val);
+	}
+
+	val = parse_options("{'a':'it\\'s \"quoted\"'}", 0,
+						JSON_RELAXED_SINGLE_QUOTES);
+	member = find("a", val);
+	check(member && strcmp(json_value_string(member),
+						   "it's \"quoted\"") == 0, "single-quoted string");
+	if (val)
+		json_value_destroy(val);
+}
+
+/* Members freed on a bad name go back to the node pool, and must come
+   out of it large enough for the names parsed next. */
+void test_pool(void)
+{
+	static const char *bad[] = {
+		"{\"abcdefghijklmnopqrstuvwxyzabcdefghij\\q\":1}",
+		"{\"abcdefghijklmnopqrstuvwxyz\\u12\":1}",
+		"{\"abcdefghij\\ud800\\u0041\":1}",
+		"{\"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz",
+		"{\"abc\tdefghijklmnopqrstuvwxyzabcdefghij\":1}",
+	};
+	const json_value_t *member;
+	json_value_t *val;
+	size_t i;
+	int k;
+
+	json_node_pool_enable(1000);
+	for (k = 0; k < 3; k++)
+	{
+		for (i = 0; i < sizeof bad / sizeof bad[0]; i++)
+		{
+			val = json_value_parse(bad[i]);
+			check(val == NULL, bad[i]);
+			if (val)
+				json_value_destroy(val);
+		}
+
+		val = parse("{\"abcdefghijklmnopqrstuvwxyz"
+					"abcdefghijklmnopqrstuvwxyz\":1,"
+					"\"abcdefghijklmnopqrstuvwxyzabcdefghij\":2,\"a\":3}");
+		member = find("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz",
+					  val);
+		check(member && json_value_number(member) == 1,
+			  "long name from the pool");
+		member = find("a", val);
+		check(member && json_value_number(member) == 3,
+			  "short name from the pool");
+		if (val)
+			json_value_destroy(val);
+	}
+
+	json_node_pool_disable();
+}
+
+/* References keep a document alive, shared values can't be moved, and
+   frozen ones can't be modified. */
+void test_sharing(void)
+{
+	const json_value_t *member;
+	json_value_t *patch;
+	json_value_t *doc;
+	json_value_t *val;
+
+	doc = parse("{\"a\":[1,2],\"b\":{\"c\":true}}");
+	val = parse("{\"x\":1}");
+	if (!doc || !val)
+		return;
+
+	check(json_value_retain(val) == val, "retain returns the value");
+	check(json_object_append(json_value_object(doc), "v", 0, val) == NULL,
+		  "shared value not moved");
+	json_value_release(val);
+	member = json_object_append(json_value_object(doc), "v", 0, val);
+	check(member && find("x", member), "value moved once released");
+
+	json_value_retain(doc);
+	json_value_destroy(doc);
+	check(find("v", doc) != NULL, "retained document still alive");
+
+	check(!json_value_frozen(doc), "not frozen");
+	json_value_freeze(doc);
+	member = find("a", doc);
+	check(json_value_frozen(doc) && member && json_value_frozen(member),
+		  "frozen with its descendants");
+	check(json_object_append(json_value_object(doc), "n", JSON_VALUE_NULL) ==
+		  NULL, "append to a frozen object");
+	check(json_array_append(json_value_array(member), JSON_VALUE_TRUE) ==
+		  NULL, "append to a frozen array");
+	check(json_object_remove(member, json_value_object(doc)) == NULL,
+		  "remove from a frozen object");
+	check(json_value_sort(doc) == -1, "sort a frozen object");
+	patch = parse("{\"a\":null}");
+	check(patch && json_value_merge_patch(doc, patch) == -1,
+		  "merge patch on a frozen document");
+	if (patch)
+		json_value_destroy(patch);
+
+	check(json_array_size(json_value_array(member)) == 2 &&
+		  json_object_size(json_value_object(doc)) == 3,
+		  "frozen document unchanged");
+	json_value_release(doc);
+}
+
+/* Freezing a document leaves the subtrees frozen before alone. */
+void test_freeze(void)
+{
+	static const char *text = "{\"i\":9,\"h\":8,\"g\":7,\"f\":6,\"e\":5,"
+							  "\"d\":4,\"c\":3,\"b\":2,\"a\":1}";
+	const json_value_t *member;
+	json_value_t *root;
+	json_value_t *obj;
+	json_value_t *exp;
+
+	root = parse("{\"y\":[1,2]}");
+	obj = parse(text);
+	exp = parse("{\"y\":[1,2],\"x\":{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,"
+				"\"f\":6,\"g\":7,\"h\":8,\"i\":9}}");
+	if (!root || !obj || !exp)
+		return;
+
+	json_value_sort(obj);
+	json_value_freeze(obj);
+	member = json_object_append(json_value_object(root), "x", 0, obj);
+	check(member && json_value_frozen(member), "frozen child moved");
+	check(!json_value_frozen(root), "parent of a frozen child");
+	json_value_freeze(root);
+	check(json_value_frozen(root), "parent frozen");
+	member = find("e", find("x", root));
+	check(member && json_value_number(member) == 5,
+		  "member of a frozen child found");
+	check(json_value_equal(root, exp) &&
+		  json_value_hash(root) == json_value_hash(exp),
+		  "frozen parent equals its unfrozen copy");
+	json_value_destroy(root);
+	json_value_destroy(exp);
+}
+
+/* Parsing a document of the same shape into a value reuses its nodes and
+   strings, and a failure leaves it null. */
+void test_parse_into(void)
+{
+	static const char *texts[] = {
+		"{\"id\":1,\"name\":\"first\",\"tags\":[\"a\",\"b\"]}",
+		"{\"id\":2,\"name\":\"other\",\"tags\":[\"c\",\"d\"]}",
+	};
+	struct counting_context ctx = { 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	json_value_t *doc;
+	json_value_t *exp;
+	size_t bytes;
+
+	doc = json_value_create_alloc(&allocator, JSON_VALUE_NULL);
+	if (!doc)
+		return;
+
+	check(json_value_parse_into(doc, texts[0]) == doc, texts[0]);
+	bytes = ctx.bytes;
+	check(json_value_parse_into(doc, texts[1]) == doc, texts[1]);
+	check(ctx.bytes == bytes, "parsing the same shape again allocates nothing");
+	exp = parse(texts[1]);
+	check(exp && json_value_equal(doc, exp), "document parsed into a value");
+	if (exp)
+		json_value_destroy(exp);
+
+	check(json_value_parse_into(doc, "{\"id\":3,") == NULL &&
+		  json_value_type(doc) == JSON_VALUE_NULL,
+		  "failed parse leaves a null value");
+	check(json_value_parse_into(doc, "[true,\"x\"]") == doc &&
+		  json_value_type(doc) == JSON_VALUE_ARRAY,
+		  "value reused after a failed parse");
+	json_value_freeze(doc);
+	check(json_value_parse_into(doc, "{}") == NULL &&
+		  json_value_type(doc) == JSON_VALUE_ARRAY,
+		  "frozen value not reused");
+	json_value_destroy(doc);
+	check(ctx.blocks == 0, "reused value freed");
+
+	doc = json_value_create_alloc(test_allocator, JSON_VALUE_NULL);
+	check(doc && json_value_parse_into(doc, texts[0]) == doc &&
+		  json_value_parse_into(doc, "\"abcdefghijklmnopqrstuvwxyz\"") == doc,
+		  "string parsed into a reused object");
+	if (!doc)
+		return;
+
+	check(json_value_type(doc) == JSON_VALUE_STRING &&
+		  strcmp(json_value_string(doc), "abcdefghijklmnopqrstuvwxyz") == 0,
+		  "reused object becomes a string");
+	json_value_destroy(doc);
+}
+
+/* Whether @number written as a document parses back bit-exactly. */
+int number_round_trip(double number)
+{
+	char buf[64];
+	struct output out = { buf, 0, sizeof buf - 1 };
+	json_value_t *val;
+	double back;
+	int ret;
+
+	val = json_value_create_alloc(test_allocator, JSON_VALUE_NUMBER, number);
+	if (!val)
+		return 0;
+
+	ret = json_value_write(val, output_write, &out);
+	json_value_destroy(val);
+	if (ret < 0)
+		return 0;
+
+	buf[out.size] = '\0';
+	val = json_value_parse_alloc(buf, test_allocator);
+	if (!val)
+		return 0;
+
+	back = json_value_number(val);
+	json_value_destroy(val);
+	return memcmp(&back, &number, sizeof (double)) == 0;
+}
+
+void test_numbers(void)
+{
+	static const double edges[] = {
+		0.0, -0.0, 5e-324, -5e-324, 2.2250738585072009e-308,
+		DBL_MIN, DBL_MAX, -DBL_MAX, DBL_EPSILON, 1e23, 8.98846567431158e307,
+		9007199254740991.0, 9007199254740992.0, 9007199254740994.0,
+		-9007199254740991.0, 0.1, 0.3, 1.0 / 3, 2.0 / 3, 123456789.125,
+		1e21, 1e-7, 4.35e-5, 5e-5, 1.7976931348623157e308,
+	};
+	unsigned long long x = 88172645463325252ULL;
+	unsigned long long bits;
+	double number;
+	char what[64];
+	size_t i;
+
+	for (i = 0; i < sizeof edges / sizeof edges[0]; i++)
+	{
+		sprintf(what, "round trip of %.17g", edges[i]);
+		check(number_round_trip(edges[i]), what);
+	}
+
+	number = 9007199254740992.0;
+	check(number_round_trip(number + 1) && number + 1 == number,
+		  "round trip of 2^53 + 1");
+
+	/* Random bit patterns cover every exponent, subnormals included. */
+	for (i = 0; i < 20000; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		bits = i % 2 ? x : x >> 12;
+		memcpy(&number, &bits, sizeof (double));
+		if (number - number != 0)
+			continue;
+
+		sprintf(what, "round trip of %.17g", number);
+		check(number_round_trip(number), what);
+	}
+}
+
+/* Schemas, their strings and writers come from the given allocator. */
+void test_alloc(void)
+{
+	struct point
+	{
+		char *name;
+		struct
+		{
+			int x;
+			int y;
+		} at;
+	};
+	static const json_field_t at_fields[] = {
+		{ "x", JSON_FIELD_INT, 0 },
+		{ "y", JSON_FIELD_INT, sizeof (int) },
+	};
+	static const json_field_t fields[] = {
+		{ "name", JSON_FIELD_STRING, offsetof(struct point, name) },
+		{ "at", JSON_FIELD_OBJECT, offsetof(struct point, at), 0,
+		  at_fields, 2 },
+	};
+	struct counting_context ctx = { 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	char buf[64];
+	struct output out = { buf, 0, sizeof buf };
+	struct point pt = { NULL };
+	json_schema_t *schema;
+	json_writer_t *writer;
+
+	schema = json_schema_create_alloc(fields, 2, &allocator);
+	check(schema && ctx.blocks == 2, "schema and nested schema allocated");
+	if (!schema)
+		return;
+
+	check(json_struct_parse("{\"name\":\"origin\",\"at\":{\"x\":1}}",
+							schema, &pt) == 0 &&
+		  strcmp(pt.name, "origin") == 0 && pt.at.x == 1 &&
+		  ctx.blocks == 3, "bound string allocated");
+	json_struct_free(schema, &pt);
+	json_schema_destroy(schema);
+	check(ctx.blocks == 0, "schema and strings freed");
+
+	writer = json_writer_create_alloc(output_write, &out, &allocator);
+	check(writer && ctx.blocks == 1, "writer allocated");
+	if (!writer)
+		return;
+
+	json_writer_append(writer, NULL, JSON_VALUE_ARRAY);
+	json_writer_append(writer, NULL, JSON_VALUE_NUMBER, 1.0);
+	json_writer_end(writer);
+	check(json_writer_flush(writer) == 0 && out.size == 3 &&
+		  memcmp(buf, "[1]", 3) == 0, "writer output");
+	json_writer_destroy(writer);
+	check(ctx.blocks == 0, "writer freed");
+}
+
+/* The streaming writer flushes its buffer when full and passes long items
+   straight through. Whatever the split, it writes what json_value_write()
+   writes. */
+void test_writer(void)
+{
+	static char expected[32768];
+	static char buf[32768];
+	static char text[32768];
+	struct output want = { expected, 0, sizeof expected };
+	struct output out = { buf, 0, sizeof buf };
+	const json_value_t *elem;
+	json_writer_t *writer;
+	json_value_t *val;
+	size_t len = 0;
+	int i;
+
+	/* Strings of most lengths up to 60 move the items across the buffer
+	   boundary at all offsets, and a 10000 byte one doesn't fit at all. */
+	text[len++] = '[';
+	for (i = 0; i < 300; i++)
+	{
+		len += sprintf(text + len, "\"%.*s%s\",%d,", i % 53,
+					   "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz",
+					   i % 2 ? "\\n\\u00e9" : "", i);
+	}
+
+	text[len++] = '"';
+	memset(text + len, 'x', 10000);
+	len += 10000;
+	strcpy(text + len, "\"]");
+
+	val = parse(text);
+	if (!val)
+		return;
+
+	check(json_value_write(val, output_write, &want) == 0 &&
+		  want.size > 3 * 4096, "whole value written");
+
+	writer = json_writer_create_alloc(output_write, &out, test_allocator);
+	if (!writer)
+	{
+		json_value_destroy(val);
+		return;
+	}
+
+	json_writer_append(writer, NULL, JSON_VALUE_ARRAY);
+	json_array_for_each(elem, json_value_array(val))
+		json_writer_append(writer, NULL, 0, elem);
+
+	json_writer_end(writer);
+	check(json_writer_flush(writer) == 0 && out.size == want.size &&
+		  memcmp(buf, expected, out.size) == 0, "streamed like the value");
+	json_writer_destroy(writer);
+
+	/* A failed callback fails the writer for good. */
+	out.size = 0;
+	out.capacity = 4096;
+	writer = json_writer_create_alloc(output_write, &out, test_allocator);
+	if (writer)
+	{
+		check(json_writer_append(writer, NULL, 0, val) < 0 &&
+			  json_writer_append(writer, NULL, JSON_VALUE_NULL) < 0 &&
+			  json_writer_flush(writer) < 0, "writer stays failed");
+		json_writer_destroy(writer);
+	}
+
+	json_value_destroy(val);
+}
+
+/* Write @str alone with @flags, as a '\0' terminated string in @buf. */
+int write_string(const char *str, int flags, char *buf, size_t size)
+{
+	struct output out = { buf, 0, size - 1 };
+	json_writer_t *writer;
+	int ret;
+
+	writer = json_writer_create_alloc(output_write, &out, test_allocator);
+	if (!writer)
+		return -1;
+
+	json_writer_set_flags(writer, flags);
+	json_writer_append(writer, NULL, JSON_VALUE_STRING, str);
+	ret = json_writer_flush(writer);
+	json_writer_destroy(writer);
+	buf[out.size] = '\0';
+	return ret;
+}
+
+/* Characters to escape are found wherever the block scans put them. */
+void test_escape(void)
+{
+	static const struct
+	{
+		const char *c;
+		const char *plain;
+		const char *ascii;
+	} chars[] = {
+		{ "\"", "\\\"", "\\\"" },
+		{ "\\", "\\\\", "\\\\" },
+		{ "\n", "\\n", "\\n" },
+		{ "\x1f", "\\u001f", "\\u001f" },
+		{ "\x7f", "\x7f", "\x7f" },
+		{ "\xc3\xa9", "\xc3\xa9", "\\u00e9" },
+		{ "\xe2\x82\xac", "\xe2\x82\xac", "\\u20ac" },
+		{ "\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80", "\\ud83d\\ude00" },
+		{ "\xff", "\xff", "\\ufffd" },
+		{ "\xed\xa0\x80", "\xed\xa0\x80", "\\ufffd\\ufffd\\ufffd" },
+	};
+	static const size_t lengths[] = { 15, 16, 17, 31, 32, 33, 48, 65 };
+	static const char fill[] =
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaa";
+	char str[160];
+	char want[256];
+	char buf[256];
+	size_t i, j;
+	int pos, len;
+	int ok = 1;
+
+	/* @c after @pos clean bytes, followed by more to fill a block. */
+	for (i = 0; i < sizeof chars / sizeof chars[0]; i++)
+	{
+		for (j = 0; j < sizeof lengths / sizeof lengths[0]; j++)
+		{
+			len = (int)lengths[j];
+			for (pos = 0; pos <= len; pos++)
+			{
+				sprintf(str, "%.*s%s%.*s", pos, fill, chars[i].c,
+						len - pos, fill);
+				sprintf(want, "\"%.*s%s%.*s\"", pos, fill, chars[i].plain,
+						len - pos, fill);
+				if (write_string(str, 0, buf, sizeof buf) < 0 ||
+					strcmp(buf, want) != 0)
+					ok = 0;
+
+				sprintf(want, "\"%.*s%s%.*s\"", pos, fill, chars[i].ascii,
+						len - pos, fill);
+				if (write_string(str, JSON_WRITER_ASCII, buf, sizeof buf) < 0 ||
+					strcmp(buf, want) != 0)
+					ok = 0;
+			}
+		}
+	}
+
+	check(ok, "characters escaped at every position");
+
+	check(write_string("a\xe2\x82", JSON_WRITER_ASCII, buf, sizeof buf) == 0 &&
+		  strcmp(buf, "\"a\\ufffd\\ufffd\"") == 0, "truncated UTF-8");
+	check(write_string("\xc0\xaf", JSON_WRITER_ASCII, buf, sizeof buf) == 0 &&
+		  strcmp(buf, "\"\\ufffd\\ufffd\"") == 0, "overlong UTF-8");
+}
+
+/* Documents bound straight into structs, including nested ones and arrays
+   of them. Unknown members are skipped and null resets strings and
+   arrays. */
+void test_schema(void)
+{
+	struct item
+	{
+		char tag[4];
+		double weight;
+	};
+	struct record
+	{
+		int id;
+		long long big;
+		int ok;
+		char name[8];
+		char *note;
+		struct
+		{
+			int x;
+			int y;
+		} at;
+		int scores[3];
+		size_t nscores;
+		struct item items[2];
+		size_t nitems;
+		char *words[2];
+		size_t nwords;
+	};
+	static const json_field_t at_fields[] = {
+		{ "x", JSON_FIELD_INT, 0 },
+		{ "y", JSON_FIELD_INT, sizeof (int) },
+	};
+	static const json_field_t item_fields[] = {
+		{ "tag", JSON_FIELD_CHARS, offsetof(struct item, tag), 4 },
+		{ "weight", JSON_FIELD_DOUBLE, offsetof(struct item, weight) },
+	};
+	static const json_field_t score_field = { NULL, JSON_FIELD_INT, 0 };
+	static const json_field_t item_field = {
+		NULL, JSON_FIELD_OBJECT, 0, sizeof (struct item), item_fields, 2
+	};
+	static const json_field_t word_field = { NULL, JSON_FIELD_STRING, 0 };
+	static const json_field_t fields[] = {
+		{ "id", JSON_FIELD_INT, offsetof(struct record, id) },
+		{ "big", JSON_FIELD_INT64, offsetof(struct record, big) },
+		{ "ok", JSON_FIELD_BOOL, offsetof(struct record, ok) },
+		{ "name", JSON_FIELD_CHARS, offsetof(struct record, name), 8 },
+		{ "note", JSON_FIELD_STRING, offsetof(struct record, note) },
+		{ "at", JSON_FIELD_OBJECT, offsetof(struct record, at), 0,
+		  at_fields, 2 },
+		{ "scores", JSON_FIELD_ARRAY, offsetof(struct record, scores),
+		  3 * sizeof (int), &score_field, 1,
+		  offsetof(struct record, nscores) },
+		{ "items", JSON_FIELD_ARRAY, offsetof(struct record, items),
+		  2 * sizeof (struct item), &item_field, 1,
+		  offsetof(struct record, nitems) },
+		{ "words", JSON_FIELD_ARRAY, offsetof(struct record, words),
+		  2 * sizeof (char *), &word_field, 1,
+		  offsetof(struct record, nwords) },
+	};
+	static const json_field_t dup_fields[] = {
+		{ "x", JSON_FIELD_INT, 0 },
+		{ "x", JSON_FIELD_INT, sizeof (int) },
+	};
+	struct record rec;
+	json_schema_t *schema;
+
+	schema = json_schema_create_alloc(fields, 9, test_allocator);
+	check(schema != NULL, "schema created");
+	if (!schema)
+		return;
+
+	memset(&rec, 0, sizeof rec);
+	check(json_struct_parse("{\"\\u0069d\":7,\"big\":9007199254740993,"
+							"\"ok\":true,\"name\":\"n\\u00e9\",\"note\":\"hi\","
+							"\"skip\":{\"a\":[1,{\"b\":\"\\\"\"}]},"
+							"\"at\":{\"y\":-2,\"z\":null,\"x\":3},"
+							"\"scores\":[1,2,3],\"items\":[{\"tag\":\"abc\","
+							"\"weight\":0.5},{\"weight\":2}],"
+							"\"words\":[\"x\",\"y\"]}", schema, &rec) == 0,
+		  "document bound");
+	check(rec.id == 7 && rec.big == 9007199254740993LL && rec.ok == 1 &&
+		  strcmp(rec.name, "n\xc3\xa9") == 0 && rec.note &&
+		  strcmp(rec.note, "hi") == 0, "scalar fields");
+	check(rec.at.x == 3 && rec.at.y == -2, "nested struct");
+	check(rec.nscores == 3 && rec.scores[2] == 3 && rec.nitems == 2 &&
+		  strcmp(rec.items[0].tag, "abc") == 0 &&
+		  rec.items[0].weight == 0.5 && rec.items[1].weight == 2 &&
+		  rec.nwords == 2 && rec.words[1] && strcmp(rec.words[1], "y") == 0,
+		  "arrays");
+
+	check(json_struct_parse("{\"id\":null,\"note\":null,\"scores\":null,"
+							"\"words\":null}", schema, &rec) == 0 &&
+		  rec.id == 7 && !rec.note && rec.nscores == 0 && rec.nwords == 0 &&
+		  rec.nitems == 2, "null fields");
+	json_struct_free(schema, &rec);
+
+	memset(&rec, 0, sizeof rec);
+	check(json_struct_parse("{\"name\":\"12345678\"}", schema, &rec) == -2,
+		  "chars too long");
+	check(json_struct_parse("{\"name\":\"1234567\"}", schema, &rec) == 0 &&
+		  strcmp(rec.name, "1234567") == 0, "chars filled");
+	check(json_struct_parse("{\"scores\":[1,2,3,4]}", schema, &rec) == -2,
+		  "too many elements");
+	check(json_struct_parse("{\"id\":1.5}", schema, &rec) == -2 &&
+		  json_struct_parse("{\"id\":4294967296}", schema, &rec) == -2 &&
+		  json_struct_parse("{\"ok\":1}", schema, &rec) == -2 &&
+		  json_struct_parse("{\"at\":[]}", schema, &rec) == -2,
+		  "mismatched values");
+	check(json_struct_parse("{\"note\":\"x\",\"id\":}", schema, &rec) == -2 &&
+		  json_struct_parse("[]", schema, &rec) == -2, "invalid documents");
+	json_struct_free(schema, &rec);
+	json_schema_destroy(schema);
+
+	check(json_schema_create_alloc(dup_fields, 2, test_allocator) == NULL,
+		  "duplicate names");
+}
+
+/* Binary documents decode to equal values and are read in place, and no
+   prefix of one is valid. */
+void test_binary(void)
+{
+	const json_view_t *root;
+	const json_view_t *view;
+	json_value_t *back;
+	json_value_t *val;
+	unsigned char *buf;
+	size_t size;
+	size_t n;
+	int ok = 1;
+
+	val = parse("{\"s\":\"str\\u00e9\",\"i\":-42,\"d\":0.25,\"big\":1e300,"
+				"\"a\":[true,false,null,[],{}],\"o\":{\"k\":\"\"}}");
+	if (!val)
+		return;
+
+	size = json_value_encode(val, NULL, 0);
+	buf = (unsigned char *)malloc(size);
+	check(size != 0 && buf, "encoded size");
+	if (!buf)
+	{
+		json_value_destroy(val);
+		return;
+	}
+
+	memset(buf, 0xa5, size);
+	check(json_value_encode(val, buf, size - 1) == size && buf[0] == 0xa5,
+		  "nothing encoded into a short buffer");
+	check(json_value_encode(val, buf, size) == size, "encoded");
+
+	back = json_value_decode_alloc(buf, size, test_allocator);
+	check(back && json_value_equal_ordered(val, back), "decoded");
+	if (back)
+		json_value_destroy(back);
+
+	root = json_view_root(buf, size);
+	check(root && json_view_type(root) == JSON_VALUE_OBJECT &&
+		  json_view_size(root) == 6, "root view");
+	if (root)
+	{
+		view = json_view_object_find("s", root);
+		check(view && json_view_type(view) == JSON_VALUE_STRING &&
+			  json_view_string_length(view) == 5 &&
+			  strcmp(json_view_string(view), "str\xc3\xa9") == 0,
+			  "string view");
+		view = json_view_object_find("i", root);
+		check(view && json_view_type(view) == JSON_VALUE_NUMBER &&
+			  json_view_number(view) == -42, "integer view");
+		view = json_view_object_find("big", root);
+		check(view && json_view_number(view) == 1e300, "double view");
+		view = json_view_object_find("a", root);
+		check(view && json_view_size(view) == 5 &&
+			  json_view_type(json_view_array_at(1, view)) ==
+			  JSON_VALUE_FALSE &&
+			  json_view_size(json_view_array_at(3, view)) == 0 &&
+			  !json_view_array_at(5, view), "array view");
+		check(strcmp(json_view_object_name_at(5, root), "o") == 0 &&
+			  json_view_object_value_at(5, root) ==
+			  json_view_object_find("o", root) &&
+			  !json_view_object_name_at(6, root) &&
+			  !json_view_object_find("x", root), "object view");
+	}
+
+	for (n = 0; n < size; n++)
+	{
+		if (json_view_root(buf, n) || json_value_decode(buf, n))
+			ok = 0;
+	}
+
+	check(ok, "truncated encodings rejected");
+	free(buf);
+	json_value_destroy(val);
+}
+
+/* Values written as MessagePack or CBOR parse back the same, and bad
+   or truncated data is rejected. */
+void test_interchange(void)
+{
+	static const char doc[] =
+		"{\"ints\":[0,1,23,24,127,128,-1,-24,-25,-32,-33,255,256,65535,"
+		"65536,-2147483648,4294967296,9007199254740992,-1e19,1e19],"
+		"\"floats\":[0.5,-1.5,0.1,1e300,3.4028234663852886e38],"
+		"\"strings\":[\"\",\"a\",\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\","
+		"\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\",\"\\u00e9\\ud83d\\ude00\"],"
+		"\"arrays\":[[],[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15],"
+		"[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16]],"
+		"\"o\":{\"t\":true,\"f\":false,\"n\":null}}";
+	static const struct
+	{
+		const char *data;
+		size_t size;
+		int cbor;
+	} bad[] = {
+		{ "\xc1", 1, 0 },
+		{ "\xc4\x01\x00", 3, 0 },
+		{ "\xd4\x01\x00", 3, 0 },
+		{ "\x81\x01\x01", 3, 0 },
+		{ "\xa1\x00", 2, 0 },
+		{ "\x01\x01", 2, 0 },
+		{ "\x41\x00", 2, 1 },
+		{ "\xa1\x01\x01", 3, 1 },
+		{ "\xf0", 1, 1 },
+		{ "\x9f\x01", 2, 1 },
+		{ "\x01\x01", 2, 1 },
+	};
+	static char buf[4096];
+	struct output out = { buf, 0, sizeof buf };
+	json_value_t *back;
+	json_value_t *val;
+	size_t i;
+	int cbor;
+	int ok;
+
+	val = parse(doc);
+	if (!val)
+		return;
+
+	for (cbor = 0; cbor < 2; cbor++)
+	{
+		out.size = 0;
+		if (cbor)
+			check(json_value_write_cbor(val, output_write, &out) == 0, "cbor");
+		else
+			check(json_value_write_msgpack(val, output_write, &out) == 0,
+				  "msgpack");
+
+		back = cbor ? json_value_parse_cbor(buf, out.size) :
+					  json_value_parse_msgpack(buf, out.size);
+		check(back && json_value_equal_ordered(val, back), "round trip");
+		if (back)
+			json_value_destroy(back);
+
+		ok = 1;
+		for (i = 0; i < out.size; i++)
+		{
+			back = cbor ? json_value_parse_cbor(buf, i) :
+						  json_value_parse_msgpack(buf, i);
+			if (back)
+			{
+				json_value_destroy(back);
+				ok = 0;
+			}
+		}
+
+		check(ok, "truncated data rejected");
+	}
+
+	json_value_destroy(val);
+
+	val = parse("[1,\"a\",null,true]");
+	if (val)
+	{
+		out.size = 0;
+		check(json_value_write_msgpack(val, output_write, &out) == 0 &&
+			  out.size == 6 &&
+			  memcmp(buf, "\x94\x01\xa1\x61\xc0\xc3", 6) == 0,
+			  "msgpack encoding");
+		out.size = 0;
+		check(json_value_write_cbor(val, output_write, &out) == 0 &&
+			  out.size == 6 &&
+			  memcmp(buf, "\x84\x01\x61\x61\xf6\xf5", 6) == 0,
+			  "cbor encoding");
+
+		back = json_value_parse_cbor("\x9f\x01\x61\x61\xf7\xc1\xf5\xff", 8);
+		check(back && json_value_equal_ordered(val, back),
+			  "cbor indefinite length, undefined and tag");
+		if (back)
+			json_value_destroy(back);
+
+		json_value_destroy(val);
+	}
+
+	ok = 1;
+	for (i = 0; i < sizeof bad / sizeof bad[0]; i++)
+	{
+		back = bad[i].cbor ? json_value_parse_cbor(bad[i].data, bad[i].size) :
+					json_value_parse_msgpack(bad[i].data, bad[i].size);
+		if (back)
+		{
+			json_value_destroy(back);
+			ok = 0;
+		}
+	}
+
+	check(ok, "invalid data rejected");
+}
+
+/* @vals[0] and @vals[1] are equal but for the order of members, the
+   others differ from them. */
+void check_equal(json_value_t *vals[])
+{
+	json_value_t *copy;
+	int i;
+
+	check(json_value_equal(vals[0], vals[1]) &&
+		  json_value_equal(vals[1], vals[0]), "members in any order");
+	check(!json_value_equal_ordered(vals[0], vals[1]) &&
+		  json_value_equal_ordered(vals[0], vals[0]), "members in order");
+	check(json_value_hash(vals[0]) == json_value_hash(vals[1]),
+		  "same hash in any order");
+	for (i = 2; i < 6; i++)
+	{
+		check(!json_value_equal(vals[0], vals[i]) &&
+			  !json_value_equal(vals[i], vals[0]) &&
+			  !json_value_equal_ordered(vals[0], vals[i]) &&
+			  json_value_hash(vals[0]) != json_value_hash(vals[i]),
+			  "different values");
+	}
+
+	copy = json_value_copy_alloc(vals[1], test_allocator);
+	if (copy)
+	{
+		check(json_value_sort(copy) == 0 &&
+			  json_value_equal_ordered(vals[0], copy) &&
+			  json_value_hash(copy) == json_value_hash(vals[1]),
+			  "sorted copy");
+		json_value_freeze(copy);
+		json_value_freeze(vals[0]);
+		json_value_freeze(vals[3]);
+		check(json_value_equal(copy, vals[0]) &&
+			  !json_value_equal(copy, vals[3]) &&
+			  json_value_hash(copy) == json_value_hash(vals[1]),
+			  "frozen values");
+		json_value_destroy(copy);
+	}
+}
+
+/* Equality with and without member order, and hashes that follow it,
+   frozen or not. */
+void test_equal(void)
+{
+	json_value_t *vals[6];
+	int i;
+
+	vals[0] = parse("{\"x\":1,\"y\":[1,-0,{\"p\":\"q\",\"r\":null}]}");
+	vals[1] = parse("{\"y\":[1e0,0,{\"r\":null,\"p\":\"q\"}],\"x\":1.0}");
+	vals[2] = parse("{\"x\":1,\"y\":[-0,1,{\"p\":\"q\",\"r\":null}]}");
+	vals[3] = parse("{\"x\":1,\"y\":[1,-0,{\"p\":\"q\"}]}");
+	vals[4] = parse("{\"x\":1,\"y\":[1,-0,{\"p\":\"q\",\"s\":null}]}");
+	vals[5] = parse("{\"x\":1,\"y\":[1,-0,{\"p\":\"q\",\"r\":false}]}");
+	for (i = 0; i < 6 && vals[i]; i++)
+		;
+
+	if (i == 6)
+		check_equal(vals);
+
+	for (i = 0; i < 6; i++)
+	{
+		if (vals[i])
+			json_value_destroy(vals[i]);
+	}
+}
+
+/* Parse @text with numbers kept as @numbers. */
+json_value_t *parse_numbers(const char *text, int numbers)
+{
+	json_parse_options_t options = { NULL };
+
+	options.numbers = numbers;
+	options.allocator = test_allocator;
+	return json_value_parse_options(text, &options);
+}
+
+/* Write @val as a '\0' terminated string in @buf. */
+int write_value(const json_value_t *val, char *buf, size_t size)
+{
+	struct output out = { buf, 0, size - 1 };
+	int ret;
+
+	ret = json_value_write(val, output_write, &out);
+	buf[out.size] = '\0';
+	return ret;
+}
+
+/* Raw numbers keep their text through writing, and compare, hash and
+   read as their doubles. */
+void test_raw_numbers(void)
+{
+	static const char text[] =
+		"[12345678901234567890123,-0.0,1E+2,0.1000000000000000055511,"
+		"{\"n\":-1.5e-7},\"7\"]";
+	json_parse_options_t options = { NULL };
+	const json_value_t *elem;
+	json_value_t *copy;
+	json_value_t *raw;
+	json_value_t *val;
+	char buf[128];
+
+	raw = parse_numbers(text, JSON_NUMBERS_RAW);
+	val = parse(text);
+	if (raw && val)
+	{
+		check(write_value(raw, buf, sizeof buf) == 0 &&
+			  strcmp(buf, text) == 0, "raw numbers written as they were");
+		elem = json_array_next_value(NULL, json_value_array(raw));
+		check(json_value_type(elem) == JSON_VALUE_NUMBER &&
+			  strcmp(json_value_number_text(elem),
+					 "12345678901234567890123") == 0 &&
+			  json_value_number(elem) == 12345678901234567890123.0,
+			  "raw number text and value");
+		elem = json_array_next_value(elem, json_value_array(raw));
+		check(json_value_number(elem) == 0 &&
+			  strcmp(json_value_number_text(elem), "-0.0") == 0,
+			  "raw negative zero");
+		check(json_value_equal_ordered(raw, val) &&
+			  json_value_hash(raw) == json_value_hash(val),
+			  "raw numbers compared as doubles");
+		check(!json_value_number_text(json_array_next_value(NULL,
+											json_value_array(val))) &&
+			  !json_value_number_text(json_array_prev_value(NULL,
+											json_value_array(raw))),
+			  "no text for other values");
+
+		copy = json_value_copy_alloc(raw, test_allocator);
+		check(copy && write_value(copy, buf, sizeof buf) == 0 &&
+			  strcmp(buf, text) == 0, "raw numbers copied");
+		if (copy)
+			json_value_destroy(copy);
+	}
+
+	if (raw)
+		json_value_destroy(raw);
+
+	if (val)
+		json_value_destroy(val);
+
+	options.numbers = JSON_NUMBERS_RAW;
+	options.max_string = 5;
+	options.allocator = test_allocator;
+	val = json_value_parse_options("[123456]", &options);
+	check(!val, "raw text limited as a string");
+	if (val)
+		json_value_destroy(val);
+
+	val = json_value_parse_options("[12345]", &options);
+	check(val != NULL, "raw text within the limit");
+	if (val)
+		json_value_destroy(val);
+}
+
+/* Lazy numbers behave as doubles wherever they are read from. */
+void test_lazy_numbers(void)
+{
+	static const char text[] =
+		"[1,-0,0.1,1E+2,-1.5e-7,123456789012345678901234,"
+		"0.1000000000000000055511151231257827,{\"n\":2.5}]";
+	static const char *invalid[] = { "[01]", "[1.]", "[-]", "[1e]", "[.5]" };
+	const json_value_t *elem;
+	json_value_t *lazy;
+	json_value_t *copy;
+	json_value_t *val;
+	char want[256];
+	char buf[256];
+	size_t i;
+
+	lazy = parse_numbers(text, JSON_NUMBERS_LAZY);
+	val = parse(text);
+	if (lazy && val)
+	{
+		copy = json_value_copy_alloc(lazy, test_allocator);
+		check(write_value(val, want, sizeof want) == 0 &&
+			  write_value(lazy, buf, sizeof buf) == 0 &&
+			  strcmp(buf, want) == 0, "lazy numbers written as doubles");
+		check(json_value_equal_ordered(lazy, val) &&
+			  json_value_hash(lazy) == json_value_hash(val),
+			  "lazy numbers compared as doubles");
+		check(copy && json_value_equal_ordered(copy, val), "copied unread");
+		elem = json_array_prev_value(NULL, json_value_array(lazy));
+		check(json_value_number(find("n", elem)) == 2.5, "lazy number read");
+		if (copy)
+		{
+			json_value_freeze(copy);
+			elem = json_array_next_value(NULL, json_value_array(copy));
+			elem = json_array_next_value(elem, json_value_array(copy));
+			elem = json_array_next_value(elem, json_value_array(copy));
+			check(json_value_number(elem) == 0.1 &&
+				  !json_value_number_text(elem), "read frozen");
+			json_value_destroy(copy);
+		}
+	}
+
+	if (lazy)
+		json_value_destroy(lazy);
+
+	if (val)
+		json_value_destroy(val);
+
+	for (i = 0; i < sizeof invalid / sizeof invalid[0]; i++)
+	{
+		val = parse_numbers(invalid[i], JSON_NUMBERS_LAZY);
+		check(!val, "invalid lazy number");
+		if (val)
+			json_value_destroy(val);
+	}
+}
+
+struct service_request
+{
+	double number;
+	int done;
+};
+
+volatile int service_started;
+volatile int service_gate;
+
+void service_callback(json_value_t *val, void *context)
+{
+	struct service_request *req = (struct service_request *)context;
+
+	if (val)
+	{
+		req->number = json_value_number(val);
+		json_value_destroy(val);
+	}
+
+	req->done = 1;
+}
+
+/* Hold the only worker until the test opens the gate. */
+void blocking_callback(json_value_t *val, void *context)
+{
+	test_store(&service_started, 1);
+	while (!test_load(&service_gate))
+		;
+
+	service_callback(val, context);
+}
+
+/* Texts submitted to a service are all parsed before it is destroyed, and
+   try_submit() fails on a full queue. The counting allocator isn't
+   thread-safe, so documents come from malloc(). Nothing is checked if
+   the library is built without JSON_PARSER_ASYNC. */
+void test_service(void)
+{
+	static char texts[64][8];
+	struct service_request reqs[64];
+	json_service_options_t options = { 0 };
+	json_service_t *service;
+	int ok = 1;
+	int i;
+
+	options.workers = 4;
+	options.queue_size = 8;
+	service = json_service_create(&options);
+	if (!service)
+		return;
+
+	for (i = 0; i < 64; i++)
+	{
+		sprintf(texts[i], i == 13 ? "[%d" : "%d", i);
+		reqs[i].number = -1;
+		reqs[i].done = 0;
+		if (json_service_submit(service, texts[i], service_callback,
+								&reqs[i]) < 0)
+			ok = 0;
+	}
+
+	json_service_destroy(service);
+	for (i = 0; i < 64; i++)
+	{
+		if (!reqs[i].done || reqs[i].number != (i == 13 ? -1 : i))
+			ok = 0;
+	}
+
+	check(ok, "all submitted texts parsed before destroying");
+
+	options.workers = 1;
+	options.queue_size = 2;
+	service = json_service_create(&options);
+	if (!service)
+		return;
+
+	for (i = 0; i < 4; i++)
+	{
+		reqs[i].number = -1;
+		reqs[i].done = 0;
+	}
+
+	test_store(&service_started, 0);
+	test_store(&service_gate, 0);
+	json_service_submit(service, "0", blocking_callback, &reqs[0]);
+	while (!test_load(&service_started))
+		;
+
+	check(json_service_try_submit(service, "1", service_callback,
+								  &reqs[1]) == 0 &&
+		  json_service_try_submit(service, "2", service_callback,
+								  &reqs[2]) == 0, "queued");
+	check(json_service_try_submit(service, "3", service_callback,
+								  &reqs[3]) < 0, "queue full");
+	test_store(&service_gate, 1);
+	json_service_destroy(service);
+	check(reqs[0].number == 0 && reqs[1].number == 1 &&
+		  reqs[2].number == 2 && !reqs[3].done, "queue drained");
+}
+
+void *node_alloc(size_t size, void *context)
+{
+	return malloc(size);
+}
+
+void *node_realloc(void *ptr, size_t size, void *context)
+{
+	return realloc(ptr, size);
+}
+
+void node_free(void *ptr, void *context)
+{
+	free(ptr);
+}
+
+/* Workers pinned to nodes or CPUs parse as the others, and placement
+   options are checked. */
+void test_service_affinity(void)
+{
+	static const json_allocator_t allocator = {
+		node_alloc, node_realloc, node_free, NULL
+	};
+	static const json_allocator_t *const node_allocators[] = {
+		&allocator, NULL,
+	};
+	static const char *texts[] = { "1", "[2]", "{\"a\":3}", "4", "x" };
+	struct service_request reqs[5];
+	json_service_options_t options = { 0 };
+	json_service_t *service;
+	int affinity;
+	int ok;
+	int i;
+
+	options.nodes = -1;
+	check(!json_service_create(&options), "negative number of nodes");
+	options.nodes = 1;
+	check(!json_service_create(&options), "nodes without allocators");
+	options.node_allocators = node_allocators;
+	options.affinity = JSON_AFFINITY_CPU + 1;
+	check(!json_service_create(&options), "invalid affinity");
+
+	options.workers = 2;
+	options.nodes = 2;
+	for (affinity = JSON_AFFINITY_NONE; affinity <= JSON_AFFINITY_CPU;
+		 affinity++)
+	{
+		options.affinity = affinity;
+		service = json_service_create(&options);
+		if (!service)
+			return;
+
+		for (i = 0; i < 5; i++)
+		{
+			reqs[i].number = -1;
+			reqs[i].done = 0;
+			json_service_submit(service, texts[i], service_callback, &reqs[i]);
+		}
+
+		json_service_destroy(service);
+		ok = 1;
+		for (i = 0; i < 5; i++)
+		{
+			if (!reqs[i].done)
+				ok = 0;
+		}
+
+		check(ok && reqs[0].number == 1 && reqs[3].number == 4 &&
+			  reqs[4].number == -1, "texts parsed by placed workers");
+	}
+}
+
+/* Every test runs with malloc(), then again with the documents it parses
+   allocated by a counting allocator, which has to get all its blocks
+   back. */
+int run_tests(void)
+{
+	static const struct
+	{
+		const char *name;
+		void (*run)(void);
+	} tests[] = {
+		{ "pool", test_pool },
+		{ "sharing", test_sharing },
+		{ "freeze", test_freeze },
+		{ "batch", test_batch },
+		{ "batch failure", test_batch_failure },
+		{ "patch", test_patch },
+		{ "diff", test_diff },
+		{ "duplicates", test_duplicates },
+		{ "limits", test_limits },
+		{ "relaxed", test_relaxed },
+		{ "alloc", test_alloc },
+		{ "schema", test_schema },
+		{ "binary", test_binary },
+		{ "interchange", test_interchange },
+		{ "equal", test_equal },
+		{ "raw numbers", test_raw_numbers },
+		{ "lazy numbers", test_lazy_numbers },
+		{ "service", test_service },
+		{ "service affinity", test_service_affinity },
+		{ "writer", test_writer },
+		{ "escape", test_escape },
+		{ "numbers", test_numbers },
+		{ "parse into", test_parse_into },
+	};
+	struct counting_context ctx = { 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof tests / sizeof tests[0]; i++)
+		tests[i].run();
+
+	test_allocator = &allocator;
+	for (i = 0; i < sizeof tests / sizeof tests[0]; i++)
+	{
+		tests[i].run();
+		if (ctx.blocks != 0)
+		{
+			fprintf(stderr, "Test %s: %zu blocks not freed.\n",
+					tests[i].name, ctx.blocks);
+			failures++;
+			ctx.blocks = 0;
+		}
+	}
+
+	test_allocator = NULL;
+	if (failures != 0)
+	{
+		fprintf(stderr, "%d checks failed.\n", failures);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
+
+int main(int argc, char *argv[])
 {
 	static char buf[BUFSIZE];
-	size_t n = fread(buf, 1, BUFSIZE, stdin);
+	struct counting_context ctx = { 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	size_t n;
+
+	if (argc == 2 && strcmp(argv[1], "test") == 0)
+		return run_tests();
+
+	n = fread(buf, 1, BUFSIZE, stdin);
 
 	if (n > 0)
 	{
@@ -161,7 +2002,7 @@ int main()
 		exit(1);
 	}
 
-	json_value_t *val = json_value_parse(buf);
+	json_value_t *val = json_value_parse_alloc(buf, &allocator);
 	if (val)
 	{
 		json_value_t *val1 = json_value_copy(val);
@@ -172,6 +2013,12 @@ int main()
 	else
 		fprintf(stderr, "Invalid JSON document.\n");
 
+	if (ctx.blocks != 0)
+	{
+		fprintf(stderr, "Memory leak: %zu blocks not freed.\n", ctx.blocks);
+		exit(1);
+	}
+
 	return 0;
 }
 
@@ -0,0 +1,887 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#if !defined(_WIN32)
+# include <sys/resource.h>
+#endif
+#include "json_parser.h"
+
+#define MAX_FILES	64
+
+struct buffer
+{
+	char *data;
+	size_t size;
+	size_t capacity;
+};
+
+void buffer_append(struct buffer *buf, const char *data, size_t size)
+{
+	if (buf->size + size >= buf->capacity)
+	{
+		size_t capacity = 2 * buf->capacity + size + 1;
+		char *data = (char *)realloc(buf->data, capacity);
+
+		if (!data)
+		{
+			perror("realloc");
+			exit(1);
+		}
+
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+
+	memcpy(buf->data + buf->size, data, size);
+	buf->size += size;
+	buf->data[buf->size] = '\0';
+}
+
+void buffer_puts(struct buffer *buf, const char *str)
+{
+	buffer_append(buf, str, strlen(str));
+}
+
+void buffer_printf(struct buffer *buf, const char *fmt, ...)
+{
+	char str[1024];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(str, sizeof str, fmt, ap);
+	va_end(ap);
+	if (n < 0 || n >= (int)sizeof str)
+	{
+		fprintf(stderr, "Text too long.\n");
+		exit(1);
+	}
+
+	buffer_append(buf, str, n);
+}
+
+static unsigned long long seed = 88172645463325252ULL;
+
+unsigned int random_next(unsigned int n)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (unsigned int)(seed >> 32) % n;
+}
+
+static const char *words[] = {
+	"json", "parser", "workflow", "hello", "world", "fast", "memory",
+	"network", "server", "client", "東京", "渋谷", "こんにちは", "😀",
+	"café", "naïve", "\\\"quoted\\\"", "line\\nbreak", "tab\\t",
+	"\\u3042\\u3044", "path\\\\to", "#tag", "@user", "https://t.co/x"
+};
+
+#define WORDS	(sizeof words / sizeof words[0])
+
+void gen_text(struct buffer *buf, int count)
+{
+	int i;
+
+	buffer_puts(buf, "\"");
+	for (i = 0; i < count; i++)
+	{
+		const char *word = words[random_next(WORDS)];
+
+		if (i != 0)
+			buffer_puts(buf, " ");
+
+		buffer_puts(buf, word);
+	}
+
+	buffer_puts(buf, "\"");
+}
+
+/* Social network statuses: many small objects, ids, short strings. */
+void gen_twitter(struct buffer *buf, size_t target)
+{
+	unsigned long long id = 505874924095815681ULL;
+	int n = 0;
+
+	buffer_puts(buf, "{\"statuses\":[");
+	while (buf->size < target)
+	{
+		if (n++ != 0)
+			buffer_puts(buf, ",");
+
+		id += random_next(100000);
+		buffer_printf(buf, "{\"created_at\":\"Sun Aug 31 00:%02u:%02u +0000 2014\","
+						   "\"id\":%llu,\"id_str\":\"%llu\",\"text\":",
+					  random_next(60), random_next(60), id, id);
+		gen_text(buf, 4 + random_next(20));
+		buffer_printf(buf, ",\"source\":\"<a href=\\\"http://twitter.com\\\" "
+						   "rel=\\\"nofollow\\\">Twitter for iPhone</a>\","
+						   "\"truncated\":false,\"in_reply_to_status_id\":null,"
+						   "\"user\":{\"id\":%u,\"name\":",
+					  random_next(2000000000));
+		gen_text(buf, 1 + random_next(2));
+		buffer_printf(buf, ",\"screen_name\":\"user_%u\",\"location\":",
+					  random_next(100000));
+		gen_text(buf, 1);
+		buffer_puts(buf, ",\"description\":");
+		gen_text(buf, random_next(16));
+		buffer_printf(buf, ",\"followers_count\":%u,\"friends_count\":%u,"
+						   "\"verified\":%s,\"profile_image_url\":"
+						   "\"http://pbs.twimg.com/profile_images/%u/normal.jpeg\"},"
+						   "\"entities\":{\"hashtags\":[",
+					  random_next(100000), random_next(5000),
+					  random_next(10) ? "false" : "true",
+					  random_next(1000000000));
+		if (random_next(3) == 0)
+		{
+			buffer_puts(buf, "{\"text\":");
+			gen_text(buf, 1);
+			buffer_printf(buf, ",\"indices\":[%u,%u]}", random_next(50),
+						  50 + random_next(50));
+		}
+
+		buffer_printf(buf, "],\"urls\":[],\"user_mentions\":[]},"
+						   "\"retweet_count\":%u,\"favorite_count\":%u,"
+						   "\"favorited\":false,\"retweeted\":false,\"lang\":\"%s\"}",
+					  random_next(100), random_next(100),
+					  random_next(2) ? "ja" : "en");
+	}
+
+	buffer_printf(buf, "],\"search_metadata\":{\"completed_in\":0.087,"
+					   "\"max_id\":%llu,\"count\":%d}}", id, n);
+}
+
+/* GeoJSON polygons: arrays of coordinate pairs with long decimals. */
+void gen_canada(struct buffer *buf, size_t target)
+{
+	int n = 0;
+	int i;
+
+	buffer_puts(buf, "{\"type\":\"FeatureCollection\",\"features\":[");
+	while (buf->size < target)
+	{
+		double lon = -141.0 + random_next(8000) / 100.0;
+		double lat = 42.0 + random_next(4000) / 100.0;
+
+		if (n++ != 0)
+			buffer_puts(buf, ",");
+
+		buffer_puts(buf, "{\"type\":\"Feature\",\"properties\":{\"name\":"
+						 "\"Canada\"},\"geometry\":{\"type\":\"Polygon\","
+						 "\"coordinates\":[[");
+		for (i = 0; i < 1000; i++)
+		{
+			lon += (random_next(2000001) - 1000000.0) / 1e8;
+			lat += (random_next(2000001) - 1000000.0) / 1e8;
+			buffer_printf(buf, "%s[%.*f,%.*f]", i ? "," : "",
+						  12 + (int)random_next(4), lon,
+						  12 + (int)random_next(4), lat);
+		}
+
+		buffer_puts(buf, "]]}}");
+	}
+
+	buffer_puts(buf, "]}");
+}
+
+/* Event catalog: keyed maps, integer ids, nulls, small nested arrays. */
+void gen_citm(struct buffer *buf, size_t target)
+{
+	unsigned int id = 138586341;
+	int n = 0;
+	int i;
+
+	buffer_puts(buf, "{\"areaNames\":{");
+	for (i = 0; i < 20; i++)
+	{
+		buffer_printf(buf, "%s\"%u\":", i ? "," : "", 205705993 + i);
+		gen_text(buf, 2);
+	}
+
+	buffer_puts(buf, "},\"events\":{");
+	for (i = 0; i < 200; i++)
+	{
+		buffer_printf(buf, "%s\"%u\":{\"description\":null,\"id\":%u,"
+						   "\"logo\":\"/images/UE0AAAAACEKo6QAAAAZDSVRN\","
+						   "\"name\":",
+					  i ? "," : "", id + i, id + i);
+		gen_text(buf, 3);
+		buffer_printf(buf, ",\"subTopicIds\":[%u,%u],\"subjectCode\":null,"
+						   "\"subtitle\":null,\"topicIds\":[%u,%u]}",
+					  337184269 + random_next(100), 337184283 + random_next(100),
+					  324846099 + random_next(100), 107888604 + random_next(100));
+	}
+
+	buffer_puts(buf, "},\"performances\":[");
+	while (buf->size < target)
+	{
+		if (n++ != 0)
+			buffer_puts(buf, ",");
+
+		buffer_printf(buf, "{\"eventId\":%u,\"id\":%u,\"logo\":null,"
+						   "\"name\":null,\"prices\":[",
+					  id + random_next(200), 339887544 + n);
+		for (i = 0; i < 1 + (int)random_next(4); i++)
+		{
+			buffer_printf(buf, "%s{\"amount\":%u,\"audienceSubCategoryId\":%u,"
+							   "\"seatCategoryId\":%u}",
+						  i ? "," : "", 10000 + 250 * random_next(400),
+						  337100890, 338937295 + i);
+		}
+
+		buffer_puts(buf, "],\"seatCategories\":[");
+		for (i = 0; i < 1 + (int)random_next(4); i++)
+		{
+			buffer_printf(buf, "%s{\"areas\":[{\"areaId\":%u,\"blockIds\":[]},"
+							   "{\"areaId\":%u,\"blockIds\":[]}],"
+							   "\"seatCategoryId\":%u}",
+						  i ? "," : "", 205705999 + random_next(20),
+						  205705999 + random_next(20), 338937295 + i);
+		}
+
+		buffer_printf(buf, "],\"seatMapImage\":null,\"start\":%llu,"
+						   "\"venueCode\":\"PLEYEL_PLEYEL\"}",
+					  1372701600000ULL + 3600000ULL * random_next(10000));
+	}
+
+	buffer_puts(buf, "]}");
+}
+
+/* Deep nesting: chains of objects and arrays close to the depth limit. */
+void gen_nested(struct buffer *buf, size_t target)
+{
+	int n = 0;
+	int depth;
+	int i;
+
+	buffer_puts(buf, "[");
+	while (buf->size < target)
+	{
+		if (n++ != 0)
+			buffer_puts(buf, ",");
+
+		depth = 100 + random_next(900);
+		for (i = 0; i < depth; i++)
+		{
+			if (i % 2 == 0)
+				buffer_printf(buf, "{\"level\":%d,\"next\":", i);
+			else
+				buffer_puts(buf, "[true,");
+		}
+
+		buffer_puts(buf, "null");
+		for (i = depth - 1; i >= 0; i--)
+			buffer_append(buf, i % 2 == 0 ? "}" : "]", 1);
+	}
+
+	buffer_puts(buf, "]");
+}
+
+/* Long text values with escapes and multi-byte characters. */
+void gen_strings(struct buffer *buf, size_t target)
+{
+	int n = 0;
+
+	buffer_puts(buf, "[");
+	while (buf->size < target)
+	{
+		if (n++ != 0)
+			buffer_puts(buf, ",");
+
+		buffer_puts(buf, "{\"title\":");
+		gen_text(buf, 3 + random_next(8));
+		buffer_puts(buf, ",\"body\":");
+		gen_text(buf, 50 + random_next(1000));
+		buffer_puts(buf, "}");
+	}
+
+	buffer_puts(buf, "]");
+}
+
+struct corpus
+{
+	const char *name;
+	void (*generate)(struct buffer *buf, size_t target);
+};
+
+static const struct corpus corpora[] = {
+	{ "twitter",	gen_twitter	},
+	{ "canada",		gen_canada	},
+	{ "citm",		gen_citm	},
+	{ "nested",		gen_nested	},
+	{ "strings",	gen_strings	},
+};
+
+#define CORPORA	(sizeof corpora / sizeof corpora[0])
+
+/* Counts allocations and live bytes. Every block has a header that keeps
+   its size. */
+struct counting_context
+{
+	size_t allocs;
+	size_t bytes;
+	size_t peak;
+};
+
+#define HEADER_SIZE	16
+
+void *counting_alloc(size_t size, void *context)
+{
+	struct counting_context *ctx = (struct counting_context *)context;
+	char *ptr = (char *)malloc(HEADER_SIZE + size);
+
+	if (!ptr)
+		return NULL;
+
+	*(size_t *)ptr = size;
+	ctx->allocs++;
+	ctx->bytes += size;
+	if (ctx->bytes > ctx->peak)
+		ctx->peak = ctx->bytes;
+
+	return ptr + HEADER_SIZE;
+}
+
+void counting_free(void *ptr, void *context)
+{
+	struct counting_context *ctx = (struct counting_context *)context;
+
+	if (ptr)
+	{
+		ptr = (char *)ptr - HEADER_SIZE;
+		ctx->bytes -= *(size_t *)ptr;
+		free(ptr);
+	}
+}
+
+void *counting_realloc(void *ptr, size_t size, void *context)
+{
+	struct counting_context *ctx = (struct counting_context *)context;
+	size_t old = 0;
+	char *p;
+
+	if (ptr)
+	{
+		ptr = (char *)ptr - HEADER_SIZE;
+		old = *(size_t *)ptr;
+	}
+
+	p = (char *)realloc(ptr, HEADER_SIZE + size);
+	if (!p)
+		return NULL;
+
+	*(size_t *)p = size;
+	ctx->allocs++;
+	ctx->bytes += size - old;
+	if (ctx->bytes > ctx->peak)
+		ctx->peak = ctx->bytes;
+
+	return p + HEADER_SIZE;
+}
+
+struct result
+{
+	const char *name;
+	size_t size;
+	int docs;
+	double parse;
+	double traverse;
+	double copy;
+	double destroy;
+	size_t allocs;
+	size_t peak;
+	long rss;
+};
+
+/* Visit every node the way an application would read the document. */
+double traverse(const json_value_t *val)
+{
+	const json_value_t *v;
+	const char *name;
+	double sum = 0;
+
+	switch (json_value_type(val))
+	{
+	case JSON_VALUE_STRING:
+		return (double)strlen(json_value_string(val));
+	case JSON_VALUE_NUMBER:
+		return json_value_number(val);
+	case JSON_VALUE_OBJECT:
+		json_object_for_each(name, v, json_value_object(val))
+			sum += (double)strlen(name) + traverse(v);
+		break;
+	case JSON_VALUE_ARRAY:
+		json_array_for_each(v, json_value_array(val))
+			sum += 1 + traverse(v);
+		break;
+	default:
+		return 1;
+	}
+
+	return sum;
+}
+
+long peak_rss(void)
+{
+#if !defined(_WIN32)
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+#endif
+
+	return -1;
+}
+
+static double checksum;
+static json_parse_options_t options;
+
+void run(const char *name, const char *text, size_t size, int rep,
+		 struct result *res)
+{
+	struct counting_context ctx = { 0, 0, 0 };
+	json_allocator_t allocator = {
+		counting_alloc, counting_realloc, counting_free, &ctx
+	};
+	json_parse_options_t counting = options;
+	json_value_t *val;
+	json_value_t *copy;
+	clock_t start;
+	int i;
+
+	memset(res, 0, sizeof (struct result));
+	res->name = name;
+	res->size = size;
+	res->docs = rep;
+
+	/* Allocation statistics from one extra pass, so that the timed
+	   passes use the default allocator. */
+	counting.allocator = &allocator;
+	val = json_value_parse_options(text, &counting);
+	if (!val)
+	{
+		fprintf(stderr, "%s: Invalid JSON document.\n", name);
+		exit(1);
+	}
+
+	json_value_destroy(val);
+	res->allocs = ctx.allocs;
+	res->peak = ctx.peak;
+
+	for (i = 0; i < rep; i++)
+	{
+		start = clock();
+		val = json_value_parse_options(text, &options);
+		res->parse += (double)(clock() - start) / CLOCKS_PER_SEC;
+		if (!val)
+		{
+			fprintf(stderr, "%s: Invalid JSON document.\n", name);
+			exit(1);
+		}
+
+		start = clock();
+		checksum += traverse(val);
+		res->traverse += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		copy = json_value_copy(val);
+		res->copy += (double)(clock() - start) / CLOCKS_PER_SEC;
+		if (!copy)
+		{
+			perror("json_value_copy");
+			exit(1);
+		}
+
+		json_value_destroy(copy);
+		start = clock();
+		json_value_destroy(val);
+		res->destroy += (double)(clock() - start) / CLOCKS_PER_SEC;
+	}
+
+	res->rss = peak_rss();
+}
+
+/* The fields an application reads from the twitter-like corpus. */
+struct user
+{
+	long long id;
+	char screen_name[32];
+	int followers_count;
+	int verified;
+};
+
+struct status
+{
+	long long id;
+	char *text;
+	char lang[4];
+	int retweet_count;
+	struct user user;
+};
+
+struct timeline
+{
+	size_t count;
+	struct status statuses[1];
+};
+
+static const json_field_t user_fields[] = {
+	{ "id", JSON_FIELD_INT64, offsetof(struct user, id) },
+	{ "screen_name", JSON_FIELD_CHARS, offsetof(struct user, screen_name),
+	  sizeof (((struct user *)0)->screen_name) },
+	{ "followers_count", JSON_FIELD_INT,
+	  offsetof(struct user, followers_count) },
+	{ "verified", JSON_FIELD_BOOL, offsetof(struct user, verified) },
+};
+
+static const json_field_t status_fields[] = {
+	{ "id", JSON_FIELD_INT64, offsetof(struct status, id) },
+	{ "text", JSON_FIELD_STRING, offsetof(struct status, text) },
+	{ "lang", JSON_FIELD_CHARS, offsetof(struct status, lang),
+	  sizeof (((struct status *)0)->lang) },
+	{ "retweet_count", JSON_FIELD_INT, offsetof(struct status, retweet_count) },
+	{ "user", JSON_FIELD_OBJECT, offsetof(struct status, user), 0,
+	  user_fields, sizeof user_fields / sizeof *user_fields },
+};
+
+static const json_field_t status_element = {
+	NULL, JSON_FIELD_OBJECT, 0, sizeof (struct status),
+	status_fields, sizeof status_fields / sizeof *status_fields
+};
+
+static double bind_dom;
+static double bind_schema;
+
+void copy_chars(char *dest, size_t size, const json_value_t *val)
+{
+	const char *str = val ? json_value_string(val) : NULL;
+
+	if (str)
+	{
+		strncpy(dest, str, size - 1);
+		dest[size - 1] = '\0';
+	}
+}
+
+char *copy_string(const json_value_t *val)
+{
+	const char *str = val ? json_value_string(val) : NULL;
+	char *copy;
+
+	if (!str)
+		return NULL;
+
+	copy = (char *)malloc(strlen(str) + 1);
+	if (!copy)
+	{
+		perror("malloc");
+		exit(1);
+	}
+
+	return strcpy(copy, str);
+}
+
+double find_number(const json_object_t *obj, const char *name)
+{
+	const json_value_t *val = json_object_find(name, obj);
+
+	return val ? json_value_number(val) : 0;
+}
+
+/* What the application does without a schema: parse and look up. */
+void bind_timeline(const json_value_t *doc, struct timeline *tl, size_t max)
+{
+	const json_value_t *statuses;
+	const json_value_t *val;
+	const json_object_t *obj;
+	const json_object_t *user;
+	struct status *st;
+
+	statuses = json_object_find("statuses", json_value_object(doc));
+	tl->count = 0;
+	json_array_for_each(val, json_value_array(statuses))
+	{
+		if (tl->count == max)
+			break;
+
+		st = &tl->statuses[tl->count++];
+		obj = json_value_object(val);
+		st->id = (long long)find_number(obj, "id");
+		st->text = copy_string(json_object_find("text", obj));
+		copy_chars(st->lang, sizeof st->lang, json_object_find("lang", obj));
+		st->retweet_count = (int)find_number(obj, "retweet_count");
+		user = json_value_object(json_object_find("user", obj));
+		st->user.id = (long long)find_number(user, "id");
+		copy_chars(st->user.screen_name, sizeof st->user.screen_name,
+				   json_object_find("screen_name", user));
+		st->user.followers_count = (int)find_number(user, "followers_count");
+		st->user.verified =
+			json_value_type(json_object_find("verified", user)) == JSON_VALUE_TRUE;
+	}
+}
+
+/* Decode the statuses of @text into C structs, once through the DOM and
+   once through a schema. */
+void run_binding(const char *text, int rep)
+{
+	json_field_t fields[1] = {
+		{ "statuses", JSON_FIELD_ARRAY, offsetof(struct timeline, statuses),
+		  0, &status_element, 1, offsetof(struct timeline, count) }
+	};
+	json_schema_t *schema;
+	struct timeline *tl;
+	json_value_t *doc;
+	clock_t start;
+	size_t max = strlen(text) / 256 + 1;
+	size_t j;
+	int i;
+
+	fields[0].size = max * sizeof (struct status);
+	tl = (struct timeline *)calloc(1, offsetof(struct timeline, statuses) +
+									  fields[0].size);
+	schema = json_schema_create(fields, 1);
+	if (!tl || !schema)
+	{
+		perror("json_schema_create");
+		exit(1);
+	}
+
+	for (i = 0; i < rep; i++)
+	{
+		start = clock();
+		doc = json_value_parse(text);
+		if (!doc)
+		{
+			fprintf(stderr, "twitter: Invalid JSON document.\n");
+			exit(1);
+		}
+
+		bind_timeline(doc, tl, max);
+		json_value_destroy(doc);
+		checksum += tl->count;
+		for (j = 0; j < tl->count; j++)
+			free(tl->statuses[j].text);
+
+		tl->count = 0;
+		bind_dom += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		if (json_struct_parse(text, schema, tl) < 0)
+		{
+			fprintf(stderr, "twitter: Binding failed.\n");
+			exit(1);
+		}
+
+		checksum += tl->count;
+		json_struct_free(schema, tl);
+		bind_schema += (double)(clock() - start) / CLOCKS_PER_SEC;
+	}
+
+	bind_dom /= rep;
+	bind_schema /= rep;
+	json_schema_destroy(schema);
+	free(tl);
+}
+
+void print_result(const struct result *res)
+{
+	double mb = (double)res->size / (1024 * 1024);
+
+	printf("%-12s %9.1f %9.1f %9.1f %9.3f %9.3f %9.3f %9.3f %10zu %10zu %10ld\n",
+		   res->name, (double)res->size / 1024,
+		   res->parse > 0 ? mb * res->docs / res->parse : 0,
+		   res->parse > 0 ? res->docs / res->parse : 0,
+		   1000 * res->parse / res->docs, 1000 * res->traverse / res->docs,
+		   1000 * res->copy / res->docs, 1000 * res->destroy / res->docs,
+		   res->allocs, res->peak / 1024, res->rss);
+}
+
+int write_stdout(const char *buf, size_t size, void *context)
+{
+	return fwrite(buf, 1, size, stdout) == size ? 0 : -1;
+}
+
+/* One JSON document with all results, written by the library itself. */
+void write_results(const struct result *results, int n, int rep)
+{
+	json_writer_t *writer = json_writer_create(write_stdout, NULL);
+	const struct result *res;
+	int i;
+
+	if (!writer)
+	{
+		perror("json_writer_create");
+		exit(1);
+	}
+
+	json_writer_append(writer, NULL, JSON_VALUE_OBJECT);
+	json_writer_append(writer, "repeat", JSON_VALUE_NUMBER, (double)rep);
+	json_writer_append(writer, "results", JSON_VALUE_ARRAY);
+	for (i = 0; i < n; i++)
+	{
+		res = &results[i];
+		json_writer_append(writer, NULL, JSON_VALUE_OBJECT);
+		json_writer_append(writer, "corpus", JSON_VALUE_STRING, res->name);
+		json_writer_append(writer, "bytes", JSON_VALUE_NUMBER,
+						   (double)res->size);
+		json_writer_append(writer, "parse_mb_per_s", JSON_VALUE_NUMBER,
+						   res->parse > 0 ? (double)res->size * res->docs /
+											res->parse / (1024 * 1024) : 0.0);
+		json_writer_append(writer, "docs_per_s", JSON_VALUE_NUMBER,
+						   res->parse > 0 ? res->docs / res->parse : 0.0);
+		json_writer_append(writer, "parse_ms", JSON_VALUE_NUMBER,
+						   1000 * res->parse / res->docs);
+		json_writer_append(writer, "traverse_ms", JSON_VALUE_NUMBER,
+						   1000 * res->traverse / res->docs);
+		json_writer_append(writer, "copy_ms", JSON_VALUE_NUMBER,
+						   1000 * res->copy / res->docs);
+		json_writer_append(writer, "destroy_ms", JSON_VALUE_NUMBER,
+						   1000 * res->destroy / res->docs);
+		json_writer_append(writer, "allocs_per_doc", JSON_VALUE_NUMBER,
+						   (double)res->allocs);
+		json_writer_append(writer, "alloc_peak_bytes", JSON_VALUE_NUMBER,
+						   (double)res->peak);
+		json_writer_append(writer, "peak_rss_kb", JSON_VALUE_NUMBER,
+						   (double)res->rss);
+		json_writer_end(writer);
+	}
+
+	json_writer_end(writer);
+	if (bind_dom > 0)
+	{
+		json_writer_append(writer, "binding", JSON_VALUE_OBJECT);
+		json_writer_append(writer, "dom_ms", JSON_VALUE_NUMBER,
+						   1000 * bind_dom);
+		json_writer_append(writer, "schema_ms", JSON_VALUE_NUMBER,
+						   1000 * bind_schema);
+		json_writer_end(writer);
+	}
+
+	json_writer_end(writer);
+	if (json_writer_flush(writer) < 0)
+	{
+		fprintf(stderr, "Writing results failed.\n");
+		exit(1);
+	}
+
+	json_writer_destroy(writer);
+	printf("\n");
+}
+
+char *read_file(const char *path, size_t *size)
+{
+	struct buffer buf = { NULL, 0, 0 };
+	char data[65536];
+	FILE *fp;
+	size_t n;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+	{
+		perror(path);
+		exit(1);
+	}
+
+	while ((n = fread(data, 1, sizeof data, fp)) > 0)
+		buffer_append(&buf, data, n);
+
+	fclose(fp);
+	if (!buf.data)
+		buffer_append(&buf, "", 0);
+
+	*size = buf.size;
+	return buf.data;
+}
+
+int main(int argc, char *argv[])
+{
+	struct result results[CORPORA + MAX_FILES];
+	const char *files[MAX_FILES];
+	int nfiles = 0;
+	double scale = 1;
+	int json = 0;
+	int rep = 10;
+	int n = 0;
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-j") == 0)
+			json = 1;
+		else if (strcmp(argv[i], "-l") == 0)
+			options.numbers = JSON_NUMBERS_LAZY;
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			rep = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			scale = atof(argv[++i]);
+		else if (argv[i][0] != '-' && nfiles < MAX_FILES)
+			files[nfiles++] = argv[i];
+		else
+		{
+			fprintf(stderr, "USAGE: %s [-j] [-l] [-n <repeat times>] "
+							"[-s <corpus MB>] [file ...]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (rep <= 0 || scale <= 0)
+	{
+		fprintf(stderr, "Invalid repeat times or corpus size.\n");
+		exit(1);
+	}
+
+	if (!json)
+	{
+		printf("%-12s %9s %9s %9s %9s %9s %9s %9s %10s %10s %10s\n",
+			   "corpus", "KB", "MB/s", "docs/s", "parse ms", "trav ms",
+			   "copy ms", "free ms", "allocs", "heap KB", "RSS KB");
+	}
+
+	if (nfiles == 0)
+	{
+		for (i = 0; i < (int)CORPORA; i++)
+		{
+			struct buffer buf = { NULL, 0, 0 };
+
+			corpora[i].generate(&buf, (size_t)(scale * 1024 * 1024));
+			run(corpora[i].name, buf.data, buf.size, rep, &results[n]);
+			if (!json)
+				print_result(&results[n]);
+
+			if (corpora[i].generate == gen_twitter)
+				run_binding(buf.data, rep);
+
+			free(buf.data);
+			n++;
+		}
+	}
+
+	for (i = 0; i < nfiles; i++)
+	{
+		size_t size;
+		char *text = read_file(files[i], &size);
+
+		run(files[i], text, size, rep, &results[n]);
+		if (!json)
+			print_result(&results[n]);
+
+		free(text);
+		n++;
+	}
+
+	if (json)
+		write_results(results, n, rep);
+	else if (bind_dom > 0)
+	{
+		printf("\ntwitter into structs: %.3f ms parsing and looking up, "
+			   "%.3f ms with a schema\n", 1000 * bind_dom, 1000 * bind_schema);
+	}
+
+	if (checksum == 0)
+		fprintf(stderr, "Empty documents.\n");
+
+	return 0;
+}
@@ -1,17 +1,1083 @@
+#if defined(__linux__)
+# define _GNU_SOURCE
+#elif !defined(_WIN32)
+# define _POSIX_C_SOURCE 200809L
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#if defined(__linux__)
+# include <sched.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
 #include "json_parser.h"
 
 #define BUFSIZE		(64 * 1024 * 1024)
+#define NUMBERS		(1024 * 1024)
+
+static char buf[BUFSIZE];
+
+struct output
+{
+	char *buf;
+	size_t size;
+};
+
+int output_write(const char *data, size_t size, void *context)
+{
+	struct output *out = (struct output *)context;
+
+	if (out->size + size >= BUFSIZE)
+		return -1;
+
+	memcpy(out->buf + out->size, data, size);
+	out->size += size;
+	return 0;
+}
+
+/* Serialize an array of assorted doubles @rep times, then parse the
+   output back and check that every number is bit-exactly the same. */
+int test_numbers(int rep)
+{
+	static double numbers[NUMBERS];
+	unsigned long long x = 88172645463325252ULL;
+	struct output out = { buf, 0 };
+	const json_value_t *val;
+	json_value_t *arr;
+	json_value_t *res;
+	double number;
+	int errors = 0;
+	int i;
+
+	arr = json_value_create(JSON_VALUE_ARRAY);
+	for (i = 0; i < NUMBERS; i++)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		switch (i % 4)
+		{
+		case 0:
+			memcpy(&number, &x, sizeof (double));
+			if (isfinite(number))
+				break;
+			/* fall through */
+		case 1:
+			number = (double)(long long)(x >> 40) - (1 << 23);
+			break;
+		case 2:
+			number = (double)(x % 100000000) / 1000;
+			break;
+		default:
+			number = (double)(x >> 11) / (1ULL << 53);
+			break;
+		}
+
+		numbers[i] = number;
+		json_array_append(json_value_array(arr), JSON_VALUE_NUMBER, number);
+	}
+
+	clock_t start = clock();
+
+	for (i = 0; i < rep; i++)
+	{
+		out.size = 0;
+		if (json_value_write(arr, output_write, &out) < 0)
+		{
+			fprintf(stderr, "Serializing failed.\n");
+			exit(1);
+		}
+	}
+
+	double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0)
+	{
+		printf("%d numbers in %.3f s, %.1f numbers/s, %.1f MB/s\n",
+			   NUMBERS * rep, sec, NUMBERS * rep / sec,
+			   (double)out.size * rep / sec / (1024 * 1024));
+	}
+
+	buf[out.size] = '\0';
+	res = json_value_parse(buf);
+	if (!res)
+	{
+		fprintf(stderr, "Invalid JSON document.\n");
+		exit(1);
+	}
+
+	i = 0;
+	json_array_for_each(val, json_value_array(res))
+	{
+		number = json_value_number(val);
+		if (memcmp(&number, &numbers[i], sizeof (double)) != 0)
+		{
+			if (errors < 10)
+				fprintf(stderr, "%.17g read back as %.17g\n", numbers[i], number);
+			errors++;
+		}
+
+		i++;
+	}
+
+	printf("round trip: %d of %d numbers differ\n", errors, i);
+	json_value_destroy(res);
+	json_value_destroy(arr);
+	return errors != 0 || i != NUMBERS;
+}
+
+/* Serialize the document @rep times with writer @flags. */
+int test_write(int rep, int flags)
+{
+	static char output[BUFSIZE];
+	struct output out = { output, 0 };
+	json_writer_t *writer;
+	json_value_t *val;
+	int i;
+
+	val = json_value_parse(buf);
+	if (!val)
+	{
+		fprintf(stderr, "Invalid JSON document.\n");
+		exit(1);
+	}
+
+	clock_t start = clock();
+
+	for (i = 0; i < rep; i++)
+	{
+		out.size = 0;
+		writer = json_writer_create(output_write, &out);
+		if (!writer)
+		{
+			perror("json_writer_create");
+			exit(1);
+		}
+
+		json_writer_set_flags(writer, flags);
+		if (json_writer_append(writer, NULL, 0, val) < 0 ||
+			json_writer_flush(writer) < 0)
+		{
+			fprintf(stderr, "Serializing failed.\n");
+			exit(1);
+		}
+
+		json_writer_destroy(writer);
+	}
+
+	double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0)
+	{
+		printf("%d documents written in %.3f s, %.1f docs/s, %.1f MB/s\n",
+			   rep, sec, rep / sec, (double)out.size * rep / sec / (1024 * 1024));
+	}
+
+	json_value_destroy(val);
+	return 0;
+}
+
+/* Decode the binary form of the document @rep times, and open it as
+   a zero-copy view as many times. */
+int test_binary(int rep, size_t n)
+{
+	const json_view_t *view = NULL;
+	json_value_t *val;
+	unsigned char *bin;
+	size_t size;
+	int i;
+
+	val = json_value_parse(buf);
+	if (!val)
+	{
+		fprintf(stderr, "Invalid JSON document.\n");
+		exit(1);
+	}
+
+	size = json_value_encode(val, NULL, 0);
+	bin = (unsigned char *)malloc(size);
+	if (!bin || json_value_encode(val, bin, size) != size)
+	{
+		perror("json_value_encode");
+		exit(1);
+	}
+
+	json_value_destroy(val);
+	printf("%zu bytes of text, %zu bytes of binary\n", n, size);
+
+	clock_t start = clock();
+
+	for (i = 0; i < rep; i++)
+	{
+		val = json_value_decode(bin, size);
+		if (!val)
+		{
+			fprintf(stderr, "Decoding failed.\n");
+			exit(1);
+		}
+
+		json_value_destroy(val);
+	}
+
+	double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0)
+	{
+		printf("%d documents decoded in %.3f s, %.1f docs/s, %.1f MB/s\n",
+			   rep, sec, rep / sec, (double)size * rep / sec / (1024 * 1024));
+	}
+
+	start = clock();
+	for (i = 0; i < rep; i++)
+		view = json_view_root(bin, size);
+
+	sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if (!view)
+	{
+		fprintf(stderr, "Invalid binary document.\n");
+		exit(1);
+	}
+
+	if (sec > 0)
+	{
+		printf("%d views opened in %.3f s, %.1f docs/s, %.1f MB/s\n",
+			   rep, sec, rep / sec, (double)size * rep / sec / (1024 * 1024));
+	}
+
+	free(bin);
+	return 0;
+}
+
+/* Write the document as MessagePack (or CBOR) and parse it back @rep
+   times, against the same round trip through text. */
+int test_convert(int rep, int cbor)
+{
+	static char output[BUFSIZE];
+	struct output out = { output, 0 };
+	json_value_t *val;
+	json_value_t *res;
+	size_t text = 0;
+	int i;
+
+	val = json_value_parse(buf);
+	if (!val)
+	{
+		fprintf(stderr, "Invalid JSON document.\n");
+		exit(1);
+	}
+
+	clock_t start = clock();
+
+	for (i = 0; i < rep; i++)
+	{
+		out.size = 0;
+		if (json_value_write(val, output_write, &out) < 0)
+		{
+			fprintf(stderr, "Serializing failed.\n");
+			exit(1);
+		}
+
+		output[out.size] = '\0';
+		res = json_value_parse(output);
+		if (!res)
+		{
+			fprintf(stderr, "Invalid JSON document.\n");
+			exit(1);
+		}
+
+		json_value_destroy(res);
+		text = out.size;
+	}
+
+	double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0)
+	{
+		printf("text: %zu bytes, %d round trips in %.3f s, %.1f docs/s\n",
+			   text, rep, sec, rep / sec);
+	}
+
+	res = NULL;
+	start = clock();
+
+	for (i = 0; i < rep; i++)
+	{
+		if (res)
+			json_value_destroy(res);
+
+		out.size = 0;
+		if (cbor)
+		{
+			if (json_value_write_cbor(val, output_write, &out) < 0)
+			{
+				fprintf(stderr, "Serializing failed.\n");
+				exit(1);
+			}
+
+			res = json_value_parse_cbor(output, out.size);
+		}
+		else
+		{
+			if (json_value_write_msgpack(val, output_write, &out) < 0)
+			{
+				fprintf(stderr, "Serializing failed.\n");
+				exit(1);
+			}
+
+			res = json_value_parse_msgpack(output, out.size);
+		}
+
+		if (!res)
+		{
+			fprintf(stderr, "Decoding failed.\n");
+			exit(1);
+		}
+	}
+
+	sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0)
+	{
+		printf("%s: %zu bytes, %d round trips in %.3f s, %.1f docs/s\n",
+			   cbor ? "cbor" : "msgpack", out.size, rep, sec, rep / sec);
+	}
+
+	/* Numbers come back as doubles, so the text forms must be identical. */
+	out.size = 0;
+	json_value_write(val, output_write, &out);
+	text = out.size;
+	json_value_write(res, output_write, &out);
+	i = out.size != 2 * text || memcmp(output, output + text, text) != 0;
+	printf("round trip: %s\n", i ? "mismatch" : "ok");
+	json_value_destroy(res);
+
+	json_value_destroy(val);
+	return i;
+}
+
+/* Look up every member of every object in @val by its name. */
+static size_t find_members(const json_value_t *val)
+{
+	const json_value_t *child;
+	json_object_t *obj;
+	const char *name;
+	size_t n = 0;
+
+	if (json_value_type(val) == JSON_VALUE_OBJECT)
+	{
+		obj = json_value_object(val);
+		json_object_for_each(name, child, obj)
+		{
+			n += json_object_find(name, obj) != NULL;
+			n += find_members(child);
+		}
+	}
+	else if (json_value_type(val) == JSON_VALUE_ARRAY)
+	{
+		json_array_for_each(child, json_value_array(val))
+			n += find_members(child);
+	}
+
+	return n;
+}
+
+/* Write the canonical form of the document and look up all its members
+   @rep times, as parsed, once sorted and once frozen. */
+int test_canonical(int rep)
+{
+	static char output[BUFSIZE];
+	struct output out = { output, 0 };
+	char *first = NULL;
+	json_value_t *val;
+	size_t found = 0;
+	size_t size = 0;
+	int stage;
+	int i;
+
+	val = json_value_parse(buf);
+	if (!val)
+	{
+		fprintf(stderr, "Invalid JSON document.\n");
+		exit(1);
+	}
+
+	for (stage = 0; stage < 3; stage++)
+	{
+		clock_t start = clock();
+
+		for (i = 0; i < rep; i++)
+		{
+			out.size = 0;
+			if (json_value_write_canonical(val, output_write, &out) < 0)
+			{
+				fprintf(stderr, "Serializing failed.\n");
+				exit(1);
+			}
+		}
+
+		double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		for (i = 0; i < rep; i++)
+			found = find_members(val);
+
+		double sec2 = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		if (sec > 0 && sec2 > 0)
+		{
+			printf("%s: %d canonical writes in %.3f s, %.1f docs/s; "
+				   "%zu lookups %d times in %.3f s\n",
+				   stage == 0 ? "parsed" : stage == 1 ? "sorted" : "frozen",
+				   rep, sec, rep / sec, found, rep, sec2);
+		}
+
+		if (!first)
+		{
+			size = out.size;
+			first = (char *)malloc(size);
+			memcpy(first, output, size);
+		}
+		else if (out.size != size || memcmp(first, output, size) != 0)
+		{
+			fprintf(stderr, "Canonical forms differ.\n");
+			exit(1);
+		}
+
+		if (stage == 0)
+			json_value_sort(val);
+		else
+			json_value_freeze(val);
+	}
+
+	free(first);
+	json_value_destroy(val);
+	return 0;
+}
+
+/* Hash two parses of the document and compare them @rep times, then do
+   the same once they are frozen. */
+int test_equal(int rep)
+{
+	json_value_t *val[2];
+	int frozen;
+	int equal;
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		val[i] = json_value_parse(buf);
+		if (!val[i])
+		{
+			fprintf(stderr, "Invalid JSON document.\n");
+			exit(1);
+		}
+	}
+
+	for (frozen = 0; frozen < 2; frozen++)
+	{
+		clock_t start = clock();
+
+		for (i = 0; i < rep; i++)
+			json_value_hash(val[i & 1]);
+
+		double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		start = clock();
+		equal = 1;
+		for (i = 0; i < rep; i++)
+			equal &= json_value_equal(val[0], val[1]);
+
+		double sec2 = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		if (sec > 0 && sec2 > 0)
+		{
+			printf("%s: %d hashes in %.3f s, %.1f docs/s; "
+				   "%d comparisons in %.3f s, %.1f docs/s\n",
+				   frozen ? "frozen" : "mutable", rep, sec, rep / sec,
+				   rep, sec2, rep / sec2);
+		}
+
+		if (!equal)
+		{
+			fprintf(stderr, "Documents differ.\n");
+			exit(1);
+		}
+
+		json_value_freeze(val[0]);
+		json_value_freeze(val[1]);
+	}
+
+	printf("hash %016llx\n", json_value_hash(val[0]));
+	json_value_destroy(val[0]);
+	json_value_destroy(val[1]);
+	return 0;
+}
+
+/* Parse the lines of the input as separate documents @rep times, one by
+   one and then as a batch. */
+int test_batch(int rep, size_t n)
+{
+	json_value_t **vals;
+	json_text_t *texts;
+	json_batch_t *batch;
+	size_t count = 0;
+	size_t i, j;
+	char *p;
+
+	texts = (json_text_t *)malloc((n / 2 + 1) * sizeof (json_text_t));
+	vals = (json_value_t **)malloc((n / 2 + 1) * sizeof (json_value_t *));
+	if (!texts || !vals)
+	{
+		perror("malloc");
+		exit(1);
+	}
+
+	/* Lines are terminated in place for the one by one parsing. */
+	for (p = buf; *p; p++)
+	{
+		texts[count].text = p;
+		while (*p && *p != '\n')
+			p++;
+
+		texts[count].size = p - texts[count].text;
+		if (texts[count].size > 0)
+			count++;
+
+		if (!*p)
+			break;
+
+		*p = '\0';
+	}
+
+	clock_t start = clock();
+
+	for (i = 0; i < rep; i++)
+	{
+		for (j = 0; j < count; j++)
+		{
+			vals[j] = json_value_parse(texts[j].text);
+			if (!vals[j])
+			{
+				fprintf(stderr, "Invalid JSON document.\n");
+				exit(1);
+			}
+		}
+
+		for (j = 0; j < count; j++)
+			json_value_destroy(vals[j]);
+	}
+
+	double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (i = 0; i < rep; i++)
+	{
+		batch = json_batch_parse(texts, count, NULL, vals);
+		if (!batch)
+		{
+			perror("json_batch_parse");
+			exit(1);
+		}
+
+		json_batch_destroy(batch);
+	}
+
+	double sec2 = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0 && sec2 > 0)
+	{
+		printf("%zu documents %d times: one by one in %.3f s, %.1f MB/s; "
+			   "as a batch in %.3f s, %.1f MB/s\n", count, rep,
+			   sec, (double)n * rep / sec / (1024 * 1024),
+			   sec2, (double)n * rep / sec2 / (1024 * 1024));
+	}
+
+	free(texts);
+	free(vals);
+	return 0;
+}
+
+static double now_usec(void)
+{
+#if !defined(_WIN32)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#else
+	return (double)clock() * 1e6 / CLOCKS_PER_SEC;
+#endif
+}
+
+struct request
+{
+	double submitted;
+	double latency;
+};
+
+/* Called by the workers of the service. */
+void request_done(json_value_t *val, void *context)
+{
+	struct request *req = (struct request *)context;
+
+	req->latency = now_usec() - req->submitted;
+	if (!val)
+	{
+		fprintf(stderr, "Invalid JSON document.\n");
+		exit(1);
+	}
+
+	json_value_destroy(val);
+}
+
+int compare_latency(const void *a, const void *b)
+{
+	double x = ((const struct request *)a)->latency;
+	double y = ((const struct request *)b)->latency;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Submit as fast as the queue accepts, so latencies include queueing. */
+int test_async(int rep, size_t n, int workers)
+{
+	json_service_options_t options = { 0 };
+	json_service_t *service;
+	struct request *reqs;
+	double blocked = 0;
+	double start, t;
+	int i;
+
+	reqs = (struct request *)malloc(rep * sizeof (struct request));
+	if (!reqs)
+	{
+		perror("malloc");
+		exit(1);
+	}
+
+	options.workers = workers;
+	service = json_service_create(&options);
+	if (!service)
+	{
+		fprintf(stderr, "Cannot create the parse service "
+						"(built without JSON_PARSER_ASYNC?)\n");
+		exit(1);
+	}
+
+	start = now_usec();
+	for (i = 0; i < rep; i++)
+	{
+		t = now_usec();
+		reqs[i].submitted = t;
+		if (json_service_submit(service, buf, request_done, &reqs[i]) < 0)
+		{
+			fprintf(stderr, "json_service_submit failed.\n");
+			exit(1);
+		}
+
+		blocked += now_usec() - t;
+	}
+
+	json_service_destroy(service);
+	double sec = (now_usec() - start) / 1e6;
+
+	qsort(reqs, rep, sizeof (struct request), compare_latency);
+	if (rep > 0 && sec > 0)
+	{
+		printf("%d documents in %.3f s, %.1f MB/s, %.1f docs/s, "
+			   "submitter blocked %.1f%% of the time\n", rep, sec,
+			   (double)n * rep / sec / (1024 * 1024), rep / sec,
+			   blocked / 1e4 / sec);
+		printf("latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+			   reqs[rep / 2].latency / 1e3,
+			   reqs[rep * 9 / 10].latency / 1e3,
+			   reqs[rep * 99 / 100].latency / 1e3,
+			   reqs[rep - 1].latency / 1e3);
+	}
+
+	free(reqs);
+	return 0;
+}
+
+void store_value(json_value_t *val, void *context)
+{
+	*(json_value_t **)context = val;
+}
+
+static size_t walk_values(const json_value_t *val, double *sum)
+{
+	const json_value_t *child;
+	const char *name;
+	size_t n = 1;
+
+	if (json_value_type(val) == JSON_VALUE_NUMBER)
+		*sum += json_value_number(val);
+	else if (json_value_type(val) == JSON_VALUE_OBJECT)
+	{
+		json_object_for_each(name, child, json_value_object(val))
+			n += walk_values(child, sum);
+	}
+	else if (json_value_type(val) == JSON_VALUE_ARRAY)
+	{
+		json_array_for_each(child, json_value_array(val))
+			n += walk_values(child, sum);
+	}
+
+	return n;
+}
+
+#if defined(__linux__)
+#define MAX_NODES		64
+#define ARENA_SIZE		((size_t)1 << 32)
+#define MPOL_BIND		2
+
+/* Address space bound to one NUMA node with mbind(), from which the
+   workers of that node allocate. Blocks are never freed; the arena is
+   unmapped at once. */
+struct node_arena
+{
+	char *base;
+	size_t used;
+	json_allocator_t allocator;
+};
+
+static void *arena_alloc(size_t size, void *context)
+{
+	struct node_arena *arena = (struct node_arena *)context;
+	size_t off;
+
+	/* The size is kept in front of each block for arena_realloc(). */
+	size = (size + 2 * sizeof (size_t) + 15) & ~(size_t)15;
+	off = __atomic_fetch_add(&arena->used, size, __ATOMIC_RELAXED);
+	if (off + size > ARENA_SIZE)
+		return NULL;
+
+	*(size_t *)(arena->base + off) = size - 2 * sizeof (size_t);
+	return arena->base + off + 2 * sizeof (size_t);
+}
+
+static void *arena_realloc(void *ptr, size_t size, void *context)
+{
+	size_t old = ptr ? ((size_t *)ptr)[-2] : 0;
+	void *p = arena_alloc(size, context);
+
+	if (p && ptr)
+		memcpy(p, ptr, old < size ? old : size);
+
+	return p;
+}
+
+static void arena_free(void *ptr, void *context)
+{
+}
+
+/* Map an arena for each NUMA node. Returns the number of entries in
+   @allocators, 0 if no node can be bound. */
+static int create_arenas(struct node_arena arenas[],
+						 const json_allocator_t *allocators[])
+{
+	struct node_arena *arena;
+	unsigned long mask;
+	int nodes = 0;
+	int i;
+
+	for (i = 0; i < MAX_NODES; i++)
+	{
+		arena = &arenas[i];
+		allocators[i] = NULL;
+		arena->base = (char *)mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+								   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+								   -1, 0);
+		if (arena->base == MAP_FAILED)
+			break;
+
+		mask = 1UL << i;
+		if (syscall(SYS_mbind, arena->base, ARENA_SIZE, MPOL_BIND, &mask,
+					sizeof mask * 8, 0) != 0)
+		{
+			munmap(arena->base, ARENA_SIZE);
+			arena->base = NULL;
+			continue;
+		}
+
+		arena->used = 0;
+		arena->allocator.alloc = arena_alloc;
+		arena->allocator.realloc = arena_realloc;
+		arena->allocator.free = arena_free;
+		arena->allocator.context = arena;
+		allocators[i] = &arena->allocator;
+		nodes = i + 1;
+	}
+
+	for (; i < MAX_NODES; i++)
+		arenas[i].base = NULL;
+
+	return nodes;
+}
+
+static void destroy_arenas(struct node_arena arenas[])
+{
+	int i;
+
+	for (i = 0; i < MAX_NODES; i++)
+	{
+		if (arenas[i].base)
+			munmap(arenas[i].base, ARENA_SIZE);
+	}
+}
+
+/* Values of a document, looked up in batches with move_pages(), which
+   only reports the node of each page when given no target nodes. */
+struct placement
+{
+	void *pages[1024];
+	int count;
+	int node;
+	size_t local;
+	size_t remote;
+};
+
+static void placement_flush(struct placement *pl)
+{
+	int status[1024];
+	int i;
+
+	if (pl->count > 0 &&
+		syscall(SYS_move_pages, 0, (unsigned long)pl->count, pl->pages,
+				NULL, status, 0) == 0)
+	{
+		for (i = 0; i < pl->count; i++)
+		{
+			if (status[i] == pl->node)
+				pl->local++;
+			else if (status[i] >= 0)
+				pl->remote++;
+		}
+	}
+
+	pl->count = 0;
+}
+
+static void count_placement(const json_value_t *val, struct placement *pl)
+{
+	static size_t page_size;
+	const json_value_t *child;
+	const char *name;
+
+	if (page_size == 0)
+		page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	pl->pages[pl->count++] = (void *)((size_t)val & ~(page_size - 1));
+	if (pl->count == 1024)
+		placement_flush(pl);
+
+	if (json_value_type(val) == JSON_VALUE_OBJECT)
+	{
+		json_object_for_each(name, child, json_value_object(val))
+			count_placement(child, pl);
+	}
+	else if (json_value_type(val) == JSON_VALUE_ARRAY)
+	{
+		json_array_for_each(child, json_value_array(val))
+			count_placement(child, pl);
+	}
+}
+#endif
+
+/* Parse @rep documents with each affinity of the service, and with node
+   affinity again allocating from arenas bound to the workers' nodes,
+   then traverse them all from this thread, pinned to one CPU, as their
+   consumer would. Reports the traversal time and, on Linux, how many of
+   the values read were on this thread's node and how many on others. */
+int test_affinity(int rep, size_t n, int workers)
+{
+	static const char *names[] = { "none", "node", "cpu", "node+arenas" };
+	json_service_options_t options = { 0 };
+	json_service_t *service;
+	json_value_t **vals;
+	double start, sec, walk;
+	double sum = 0;
+	size_t count;
+	int affinity;
+	int mode;
+	int i;
+#if defined(__linux__)
+	static struct node_arena arenas[MAX_NODES];
+	const json_allocator_t *allocators[MAX_NODES];
+	struct placement *pl;
+	unsigned int cpu, node;
+
+	pl = (struct placement *)malloc(sizeof (struct placement));
+	if (!pl)
+	{
+		perror("malloc");
+		exit(1);
+	}
+#endif
+
+	vals = (json_value_t **)malloc(rep * sizeof (json_value_t *));
+	if (!vals)
+	{
+		perror("malloc");
+		exit(1);
+	}
+
+	options.workers = workers;
+	for (mode = 0; mode < 4; mode++)
+	{
+		affinity = mode < 3 ? mode : JSON_AFFINITY_NODE;
+		options.affinity = affinity;
+		if (mode == 3)
+		{
+#if defined(__linux__)
+			options.nodes = create_arenas(arenas, allocators);
+			options.node_allocators = allocators;
+#endif
+			if (options.nodes == 0)
+			{
+				printf("affinity %s: cannot bind memory to nodes\n",
+					   names[mode]);
+				break;
+			}
+		}
+
+		service = json_service_create(&options);
+		if (!service)
+		{
+			fprintf(stderr, "Cannot create the parse service "
+							"(built without JSON_PARSER_ASYNC?)\n");
+			exit(1);
+		}
+
+#if defined(__linux__)
+		/* Only after creating the service, or its workers would inherit
+		   the mask even when they are not pinned. */
+		if (affinity == JSON_AFFINITY_NONE && sched_getcpu() >= 0)
+		{
+			cpu_set_t set;
+
+			CPU_ZERO(&set);
+			CPU_SET(sched_getcpu(), &set);
+			sched_setaffinity(0, sizeof (cpu_set_t), &set);
+		}
+#endif
+
+		start = now_usec();
+		for (i = 0; i < rep; i++)
+			json_service_submit(service, buf, store_value, &vals[i]);
+
+		json_service_destroy(service);
+		sec = (now_usec() - start) / 1e6;
+
+		count = 0;
+		start = now_usec();
+		for (i = 0; i < rep; i++)
+		{
+			if (!vals[i])
+			{
+				fprintf(stderr, "Invalid JSON document.\n");
+				exit(1);
+			}
+
+			count += walk_values(vals[i], &sum);
+		}
+
+		walk = now_usec() - start;
+		if (sec > 0 && count > 0)
+		{
+			printf("affinity %s: parsed in %.3f s, %.1f MB/s; "
+				   "traversed in %.2f ns per value\n", names[mode],
+				   sec, (double)n * rep / sec / (1024 * 1024),
+				   walk * 1e3 / count);
+		}
+
+#if defined(__linux__)
+		pl->count = 0;
+		pl->local = 0;
+		pl->remote = 0;
+		if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+		{
+			pl->node = (int)node;
+			for (i = 0; i < rep; i++)
+				count_placement(vals[i], pl);
+
+			placement_flush(pl);
+			printf("affinity %s: %zu values read from node %d, "
+				   "%zu from other nodes, %zu not found\n", names[mode],
+				   pl->local, pl->node, pl->remote,
+				   count - pl->local - pl->remote);
+		}
+#endif
+
+		for (i = 0; i < rep; i++)
+			json_value_destroy(vals[i]);
+	}
+
+#if defined(__linux__)
+	if (options.nodes > 0)
+		destroy_arenas(arenas);
+
+	free(pl);
+#endif
+	free(vals);
+	return 0;
+}
 
 int main(int argc, char *argv[])
 {
-	static char buf[BUFSIZE];
+	json_parse_options_t options = { NULL };
+	json_value_t *reuse = NULL;
+	int binary = 0;
+	int convert = -1;
+	int canonical = 0;
+	int equal = 0;
+	int batch = 0;
+	int async = -1;
+	int affinity = -1;
+	int write = -1;
+	int pool = 0;
 	size_t n;
 
-	if (argc != 2)
+	if (argc == 3 && strcmp(argv[2], "pool") == 0)
+		pool = 1;
+	else if (argc == 3 && strcmp(argv[2], "reuse") == 0)
+		reuse = json_value_create(JSON_VALUE_NULL);
+	else if (argc == 3 && strcmp(argv[2], "numbers") == 0)
+		return test_numbers(atoi(argv[1]));
+	else if (argc == 3 && strcmp(argv[2], "raw") == 0)
+		options.numbers = JSON_NUMBERS_RAW;
+	else if (argc == 3 && strcmp(argv[2], "lazy") == 0)
+		options.numbers = JSON_NUMBERS_LAZY;
+	else if (argc == 3 && strcmp(argv[2], "write") == 0)
+		write = 0;
+	else if (argc == 3 && strcmp(argv[2], "ascii") == 0)
+		write = JSON_WRITER_ASCII;
+	else if (argc == 3 && strcmp(argv[2], "binary") == 0)
+		binary = 1;
+	else if (argc == 3 && strcmp(argv[2], "msgpack") == 0)
+		convert = 0;
+	else if (argc == 3 && strcmp(argv[2], "cbor") == 0)
+		convert = 1;
+	else if (argc == 3 && strcmp(argv[2], "equal") == 0)
+		equal = 1;
+	else if (argc == 3 && strcmp(argv[2], "canonical") == 0)
+		canonical = 1;
+	else if (argc == 3 && strcmp(argv[2], "batch") == 0)
+		batch = 1;
+	else if ((argc == 3 || argc == 4) && strcmp(argv[2], "async") == 0)
+		async = argc == 4 ? atoi(argv[3]) : 0;
+	else if ((argc == 3 || argc == 4) && strcmp(argv[2], "affinity") == 0)
+		affinity = argc == 4 ? atoi(argv[3]) : 0;
+	else if (argc != 2)
 	{
-		fprintf(stderr, "USAGE: %s <repeat times>\n", argv[0]);
+		fprintf(stderr, "USAGE: %s <repeat times> "
+						"[pool|reuse|numbers|raw|lazy|write|ascii|binary|"
+						"msgpack|cbor|equal|canonical|batch|"
+						"async [workers]|affinity [workers]]\n", argv[0]);
 		exit(1);
 	}
 
@@ -35,9 +1101,49 @@ int main(int argc, char *argv[])
 	int rep = atoi(argv[1]);
 	int i;
 
+	if (write >= 0)
+		return test_write(rep, write);
+
+	if (binary)
+		return test_binary(rep, n);
+
+	if (convert >= 0)
+		return test_convert(rep, convert);
+
+	if (equal)
+		return test_equal(rep);
+
+	if (canonical)
+		return test_canonical(rep);
+
+	if (batch)
+		return test_batch(rep, n);
+
+	if (async >= 0)
+		return test_async(rep, n, async);
+
+	if (affinity >= 0)
+		return test_affinity(rep, n, affinity);
+
+	if (pool)
+		json_node_pool_enable(1024 * 1024);
+
+	clock_t start = clock();
+
 	for (i = 0; i < rep; i++)
 	{
-		json_value_t *val = json_value_parse(buf);
+		if (reuse)
+		{
+			if (!json_value_parse_into(reuse, buf))
+			{
+				fprintf(stderr, "Invalid JSON document.\n");
+				exit(1);
+			}
+
+			continue;
+		}
+
+		json_value_t *val = json_value_parse_options(buf, &options);
 		if (val)
 		{
 			json_value_destroy(val);
@@ -49,6 +1155,43 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	double sec = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (sec > 0)
+	{
+		printf("%d documents in %.3f s, %.1f docs/s, %.1f MB/s\n", rep, sec,
+			   rep / sec, (double)n * rep / sec / (1024 * 1024));
+	}
+
+	if (pool)
+	{
+		json_node_pool_stats_t stats;
+
+		json_node_pool_stats(&stats);
+		printf("node pool: %zu hits, %zu misses (%.2f%% hit rate), "
+			   "%zu recycled, %zu released, %zu cached\n",
+			   stats.hits, stats.misses,
+			   100.0 * stats.hits / (stats.hits + stats.misses + !stats.hits),
+			   stats.recycled, stats.released, stats.cached);
+		json_node_pool_disable();
+	}
+
+	json_parse_stats_t stats;
+
+	if (json_parse_stats(&stats) == 0)
+	{
+		printf("parse stats: %zu bytes, %zu objects, %zu arrays, "
+			   "%zu strings (%zu escaped, %zu bytes copied), %zu numbers, "
+			   "%zu allocs, max depth %zu, %.1f%% of time in numbers\n",
+			   stats.bytes, stats.nodes[JSON_VALUE_OBJECT],
+			   stats.nodes[JSON_VALUE_ARRAY], stats.nodes[JSON_VALUE_STRING],
+			   stats.escaped_strings, stats.copied_bytes,
+			   stats.nodes[JSON_VALUE_NUMBER], stats.allocs, stats.max_depth,
+			   100.0 * stats.number_ticks / (stats.parse_ticks + !stats.parse_ticks));
+	}
+
+	if (reuse)
+		json_value_destroy(reuse);
+
 	return 0;
 }
-
@@ -12,15 +12,52 @@ end
 set_languages("c99")
 set_warnings("all")
 
+option("stats")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Collect parse statistics")
+    add_defines("JSON_PARSER_STATS")
+option_end()
+
+option("digest")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Cache digests in frozen values")
+    add_defines("JSON_PARSER_DIGEST")
+option_end()
+
+option("index")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Index frozen sorted objects for binary search")
+    add_defines("JSON_PARSER_INDEX")
+option_end()
+
+option("async")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build the asynchronous parse service")
+    add_defines("JSON_PARSER_ASYNC")
+option_end()
+
 target("json-parser")
     set_kind("$(kind)")
     add_files("json_parser.c")
+    add_options("stats", "digest", "index", "async")
+    if has_config("async") then
+        add_syslinks("pthread", {public = true})
+    end
 
 target("test_speed")
     set_kind("binary")
     add_files("test_speed.c")
     add_deps("json-parser")
 
+target("test_bench")
+    set_kind("binary")
+    add_files("test_bench.c")
+    add_deps("json-parser")
+
 target("parse_json")
     set_kind("binary")
     add_files("test.c")